@@ -1,11 +1,15 @@
 
+#include "glsl/vertex-attrib.vert"
+
 varying vec3 fV;
 varying vec3 fN;
 
 void main()
 {
-    fV = vec3(gl_ModelViewMatrix * gl_Vertex);
-    fN = vec3(gl_NormalMatrix    * gl_Normal);
+    vec4 v = vertex_position();
+
+    fV = vec3(gl_ModelViewMatrix * v);
+    fN = vec3(gl_NormalMatrix    * vertex_normal());
 
-    gl_Position = ftransform();
+    gl_Position = gl_ModelViewProjectionMatrix * v;
 }
@@ -1,5 +1,7 @@
 
+#include "glsl/vertex-attrib.vert"
+
 void main()
 {
-    gl_Position = ftransform();
+    gl_Position = gl_ModelViewProjectionMatrix * vertex_position();
 }
@@ -0,0 +1,27 @@
+
+// Light source uniforms. With UNIFORM_BLOCK these are members of LightBlock,
+// held in a single uniform buffer object shared by all programs. Members use
+// the std140 offsets given by wrl::world, so their order must not change.
+
+#ifdef UNIFORM_BLOCK
+
+layout(std140) uniform LightBlock
+{
+    mat4 ShadowMatrix[4];
+    vec4 LightPosition[4];
+    vec2 LightSplit[4];
+    vec2 LightBrightness[4];
+    vec4 LightCutoff;
+    vec4 LightUnit;
+};
+
+#else
+
+uniform mat4 ShadowMatrix[4];
+uniform vec4 LightPosition[4];
+uniform vec2 LightSplit[4];
+uniform vec2 LightBrightness[4];
+uniform vec4 LightCutoff;
+uniform vec4 LightUnit;
+
+#endif
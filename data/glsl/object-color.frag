@@ -1,11 +1,21 @@
 #version 120
 
-uniform vec2 LightSplit[4];
-uniform vec2 LightBrightness[4];
+#include "glsl/light-block.glsl"
 
+// With TEXTURE_ARRAY, material textures are layers of texture arrays, with
+// the layer given by the w texture coordinate.
+
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray  diffuse;
+uniform sampler2DArray  specular;
+uniform sampler2DArray  normal;
+#define material(s) texture2DArray(s, gl_TexCoord[0].xyw)
+#else
 uniform sampler2D       diffuse;
 uniform sampler2D       specular;
 uniform sampler2D       normal;
+#define material(s) texture2D(s, gl_TexCoord[0].xy)
+#endif
 
 uniform sampler2DShadow shadow[4];
 uniform sampler2D       cookie[4];
@@ -73,9 +83,9 @@ vec3 light(vec3 V, vec3 N, vec4 Td, vec4 Ts, int i)
 
 void main()
 {
-    vec4 Td = texture2D(diffuse,  gl_TexCoord[0].xy);
-    vec4 Ts = texture2D(specular, gl_TexCoord[0].xy);
-    vec4 Tn = texture2D(normal,   gl_TexCoord[0].xy);
+    vec4 Td = material(diffuse);
+    vec4 Ts = material(specular);
+    vec4 Tn = material(normal);
 
     vec3 V = normalize(-fV);
     vec3 N = normalize(2.0 * Tn.rgb - 1.0);
@@ -1,9 +1,8 @@
 #version 120
 
-attribute vec3 Tangent;
+#include "glsl/vertex-attrib.vert"
+#include "glsl/light-block.glsl"
 
-uniform vec4  LightPosition[4];
-uniform mat4  ShadowMatrix[4];
 uniform float Highlight;
 
 varying vec3 fV;
@@ -19,13 +18,14 @@ void main()
 {
     // Calculate the tangent space transform and inverse.
 
-    vec3 t = normalize(gl_NormalMatrix * Tangent);
-    vec3 n = normalize(gl_NormalMatrix * gl_Normal);
+    vec3 t = normalize(gl_NormalMatrix * vertex_tangent());
+    vec3 n = normalize(gl_NormalMatrix * vertex_normal());
 
     mat3 I = mat3(t, cross(n, t), n);
     mat3 T = transpose(I);
 
-    vec4 e = gl_ModelViewMatrix * gl_Vertex;
+    vec4 v = vertex_position();
+    vec4 e = gl_ModelViewMatrix * v;
 
     // Tangent-space view vector
 
@@ -47,6 +47,6 @@ void main()
 
     // Built-in vertex position and texture coordinate
 
-    gl_TexCoord[0] = gl_MultiTexCoord0;
-    gl_Position    = gl_ModelViewProjectionMatrix * gl_Vertex;
+    gl_TexCoord[0] = vertex_texcoord();
+    gl_Position    = gl_ModelViewProjectionMatrix * v;
 }
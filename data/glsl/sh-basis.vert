@@ -1,3 +1,5 @@
+#include "glsl/vertex-attrib.vert"
+
 uniform mat4 view_matrix;
 uniform mat4 view_inverse;
 
@@ -6,11 +8,11 @@ varying vec3 N_v;
 
 void main()
 {
-    vec4 V_e =      gl_ModelViewMatrix * gl_Vertex;
-    vec4 N_e = vec4(gl_NormalMatrix    * gl_Normal, 0.0);
+    vec4 V_o =      vertex_position();
+    vec4 N_e = vec4(gl_NormalMatrix    * vertex_normal(), 0.0);
 
-    V_v = (gl_Vertex).xyz;
+    V_v = V_o.xyz;
     N_v = (N_e * view_matrix).xyz;
 
-    gl_Position = ftransform();
+    gl_Position = gl_ModelViewProjectionMatrix * V_o;
 }
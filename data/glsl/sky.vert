@@ -1,6 +1,6 @@
 
-uniform vec4 LightUnit;
-uniform vec4 LightPosition[4];
+#include "glsl/vertex-attrib.vert"
+#include "glsl/light-block.glsl"
 
 varying vec3  P;
 varying vec3 fV;
@@ -12,17 +12,18 @@ void main()
 {
     // Compare this unit ID with the light unit IDs to determine light position.
 
+    vec4 u = vertex_texcoord();
     vec4 L;
 
-    if      (LightUnit.x == gl_MultiTexCoord0.p) L = LightPosition[0];
-    else if (LightUnit.y == gl_MultiTexCoord0.p) L = LightPosition[1];
-    else if (LightUnit.z == gl_MultiTexCoord0.p) L = LightPosition[2];
-    else if (LightUnit.w == gl_MultiTexCoord0.p) L = LightPosition[3];
-    else                                         L = vec4(0.0, 1.0, 0.0, 0.0);
+    if      (LightUnit.x == u.p) L = LightPosition[0];
+    else if (LightUnit.y == u.p) L = LightPosition[1];
+    else if (LightUnit.z == u.p) L = LightPosition[2];
+    else if (LightUnit.w == u.p) L = LightPosition[3];
+    else                         L = vec4(0.0, 1.0, 0.0, 0.0);
 
     // Generate points on the far plane in clip coordinates.
 
-    vec4 c = vec4(gl_MultiTexCoord0.xy, 0.999, 1.0);
+    vec4 c = vec4(u.xy, 0.999, 1.0);
 
     // Compute the world-space view position, view vector, and light position.
 
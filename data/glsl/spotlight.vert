@@ -16,16 +16,18 @@
 // Given this angle, calculate the necessary offset, and sum the position and
 // normal.
 
-uniform vec4 LightUnit;
-uniform vec4 LightCutoff;
+#include "glsl/vertex-attrib.vert"
+#include "glsl/light-block.glsl"
 
 void main()
 {
-	float a = dot(vec4(equal(LightUnit, vec4(gl_MultiTexCoord0.p))), LightCutoff);
+	vec4 u = vertex_texcoord();
+
+	float a = dot(vec4(equal(LightUnit, vec4(u.p))), LightCutoff);
 	float k = tan(radians(a * 0.5)) * 0.70710678;
 
-	vec4 v = vec4(gl_Vertex.xyz + gl_Normal * k, gl_Vertex.w);
+	vec4 v = vertex_position() + vec4(vertex_normal() * k, 0.0);
 
-	gl_TexCoord[0] = gl_MultiTexCoord0;
+	gl_TexCoord[0] = u;
     gl_Position    = gl_ModelViewProjectionMatrix * v;
 }
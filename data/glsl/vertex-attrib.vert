@@ -0,0 +1,195 @@
+
+// Vertex attribute access for batch pool geometry. With VERTEX_COMPACT the
+// pool stores octahedral normal and tangent in attribute Orient and the unit
+// ID in attribute Unit, with bit 23 of the ID flagging a zero normal. Texture
+// coordinates are two halfs. Positions are integers with scale and offset
+// given by attribute Quant.
+//
+// With VERTEX_INSTANCE, InstanceX, InstanceY, and InstanceZ give the rows of
+// the transform of an instanced unit, and InstanceU.x gives its ID. The pool
+// sets these to the identity and -1 for uninstanced geometry.
+//
+// With VERTEX_MULTIDRAW, attribute Node gives the slot of each vertex in the
+// NodeBuffer texture, which holds the rows of the node transform followed by
+// the quantization. The modelview then holds only the view transform.
+//
+// With TEXTURE_ARRAY, attribute Layer gives the texture array layer of each
+// vertex, returned in the w component of vertex_texcoord.
+//
+// vertex_position gives the node-space position, or the world-space position
+// with VERTEX_MULTIDRAW. Shaders must use it in place of gl_Vertex and
+// ftransform.
+
+#ifdef TEXTURE_ARRAY
+
+attribute float Layer;
+
+vec4 texture_layer(vec4 t)
+{
+    return vec4(t.xyz, Layer);
+}
+
+#else
+
+vec4 texture_layer(vec4 t)
+{
+    return t;
+}
+
+#endif
+
+#ifdef VERTEX_MULTIDRAW
+
+attribute float         Node;
+uniform   samplerBuffer NodeBuffer;
+
+vec4 node_row(int i)
+{
+    return texelFetchBuffer(NodeBuffer, int(Node) * 4 + i);
+}
+
+vec4 node_position(vec4 v)
+{
+    return vec4(dot(node_row(0), v), dot(node_row(1), v),
+                dot(node_row(2), v), v.w);
+}
+
+vec3 node_normal(vec3 n)
+{
+    return vec3(dot(node_row(0).xyz, n), dot(node_row(1).xyz, n),
+                                         dot(node_row(2).xyz, n));
+}
+
+#else
+
+vec4 node_position(vec4 v)
+{
+    return v;
+}
+
+vec3 node_normal(vec3 n)
+{
+    return n;
+}
+
+#endif
+
+#ifdef VERTEX_INSTANCE
+
+attribute vec4 InstanceX;
+attribute vec4 InstanceY;
+attribute vec4 InstanceZ;
+attribute vec4 InstanceU;
+
+vec4 instance_position(vec4 v)
+{
+    return vec4(dot(InstanceX, v), dot(InstanceY, v), dot(InstanceZ, v), v.w);
+}
+
+vec3 instance_normal(vec3 n)
+{
+    return vec3(dot(InstanceX.xyz, n), dot(InstanceY.xyz, n),
+                                       dot(InstanceZ.xyz, n));
+}
+
+float instance_unit(float u)
+{
+    return InstanceU.x < 0.0 ? u : InstanceU.x;
+}
+
+#else
+
+vec4 instance_position(vec4 v)
+{
+    return v;
+}
+
+vec3 instance_normal(vec3 n)
+{
+    return n;
+}
+
+float instance_unit(float u)
+{
+    return u;
+}
+
+#endif
+
+#ifdef VERTEX_COMPACT
+
+attribute vec4  Quant;
+attribute vec4  Orient;
+attribute float Unit;
+
+vec4 vertex_quant()
+{
+#ifdef VERTEX_MULTIDRAW
+    return node_row(3);
+#else
+    return Quant;
+#endif
+}
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0,
+                                         v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
+vec4 vertex_position()
+{
+    vec4 q = vertex_quant();
+
+    return node_position(instance_position(vec4(gl_Vertex.xyz * q.w + q.xyz,
+                                                1.0)));
+}
+
+vec3 vertex_normal()
+{
+    return node_normal(instance_normal(oct_decode(Orient.xy)))
+                                    * (Unit < 8388608.0 ? 1.0 : 0.0);
+}
+
+vec3 vertex_tangent()
+{
+    return node_normal(instance_normal(oct_decode(Orient.zw)));
+}
+
+vec4 vertex_texcoord()
+{
+    return texture_layer(vec4(gl_MultiTexCoord0.xy,
+                              instance_unit(mod(Unit, 8388608.0)), 1.0));
+}
+
+#else
+
+attribute vec3 Tangent;
+
+vec4 vertex_position()
+{
+    return node_position(instance_position(gl_Vertex));
+}
+
+vec3 vertex_normal()
+{
+    return node_normal(instance_normal(gl_Normal));
+}
+
+vec3 vertex_tangent()
+{
+    return node_normal(instance_normal(Tangent));
+}
+
+vec4 vertex_texcoord()
+{
+    return texture_layer(vec4(gl_MultiTexCoord0.xy,
+                              instance_unit(gl_MultiTexCoord0.z),
+                              gl_MultiTexCoord0.w));
+}
+
+#endif
@@ -1,6 +1,8 @@
 
+#include "glsl/vertex-attrib.vert"
+
 void main()
 {
     gl_FrontColor = gl_Color;
-    gl_Position = ftransform();
+    gl_Position = gl_ModelViewProjectionMatrix * vertex_position();
 }
@@ -0,0 +1,42 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <SDL.h>
+
+#include <ogl-bvh.hpp>
+#include <ogl-boxes.hpp>
+#include <ogl-mesh.hpp>
+#include <etc-log.hpp>
+
+//-----------------------------------------------------------------------------
+
+// Log the scaling of the culling structures and of vertex caching from a
+// thousand to a million nodes or vertices. Exit with failure if any result
+// disagrees with its reference.
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+
+    for (int n = 1000; n <= 1000000; n *= 10)
+    {
+        ok = ogl::bvh::bench  (n) && ok;
+        ok = ogl::boxes::bench(n) && ok;
+        ok = ogl::mesh::bench (n) && ok;
+    }
+
+    if (!ok) etc::log("bench FAILED");
+
+    return ok ? 0 : 1;
+}
+
+//-----------------------------------------------------------------------------
@@ -27,6 +27,15 @@ namespace app
         file_buffer(std::string);
     };
 
+    // Memory-mapped file system data buffer
+
+    class file_map_buffer : public buffer
+    {
+    public:
+        file_map_buffer(std::string);
+       ~file_map_buffer();
+    };
+
     // File system data archive
 
     class file_archive : public archive
@@ -42,6 +51,9 @@ namespace app
         virtual buffer_p load(std::string)                         const;
         virtual bool     save(std::string, const void *, size_t *) const;
         virtual void     list(std::string, str_set&, str_set&)     const;
+
+        virtual buffer_p map (std::string)                         const;
+        virtual bool     stat(std::string, size_t *, long long *)  const;
     };
 }
 
@@ -40,6 +40,8 @@ namespace app
         virtual bool     save(std::string, const void *, size_t *) const;
         virtual void     list(std::string, str_set&, str_set&)     const;
 
+        virtual bool     stat(std::string, size_t *, long long *)  const;
+
     private:
 
         const void *ptr;
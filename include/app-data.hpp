@@ -101,7 +101,7 @@ namespace app
     public:
 
         buffer();
-       ~buffer();
+        virtual ~buffer();
 
         const void *get(size_t *) const;
     };
@@ -123,6 +123,13 @@ namespace app
         virtual bool     save(std::string, const void *, size_t *) const = 0;
         virtual void     list(std::string, str_set&, str_set&)     const = 0;
 
+        // Archives that can map files into memory should override these. A
+        // stamp is an opaque modification identifier compared for equality.
+
+        virtual buffer_p map (std::string name) const { return load(name); }
+        virtual bool     stat(std::string, size_t *, long long *)   const
+            { return false; }
+
         virtual ~archive() { }
 
         const int priority;
@@ -166,6 +173,8 @@ namespace app
         void add_pack_archive(const void *, size_t, int=50);
 
         const void *load(const std::string&,               size_t * = 0);
+        const void *map (const std::string&,               size_t * = 0);
+        bool        stat(const std::string&, size_t *, long long *);
         bool        save(const std::string&, const void *, size_t * = 0);
         bool        find(const std::string&);
         void        free(const std::string&);
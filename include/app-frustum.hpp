@@ -60,6 +60,7 @@ namespace app
         virtual mat4  get_transform(double, double) const = 0;
 
         const vec4 *get_world_planes() const { return plane;  }
+        const mat4& get_world_clip()   const { return clip;   }
         const vec3 *get_world_points() const { return point;  }
         const vec3 *get_corners()      const { return corner; }
         const vec3  get_eye()          const { return eye;    }
@@ -95,6 +96,7 @@ namespace app
 
         // World-space frustum boundary cache
 
+        mat4 clip;            // World to clip space
         vec4 plane[6];        // N L R B T F
         vec3 point[8];        // BL BR TL TR
 
@@ -109,7 +111,7 @@ namespace app
     {
     public:
 
-        orthogonal_frustum(const ogl::aabb&, const vec3&);
+        orthogonal_frustum(const ogl::aabb&, const vec3&, int=0);
 
         virtual void set_bound(const mat4&, const ogl::aabb&);
 
@@ -27,11 +27,13 @@ namespace ogl
     class program;
     class process;
     class texture;
+    class array;
     class binding;
     class surface;
     class convex;
     class image;
     class frame;
+    class block;
     class pool;
 }
 
@@ -65,6 +67,12 @@ namespace app
             int           ref;
         };
 
+        struct array
+        {
+            ogl::array   *ptr;
+            int           ref;
+        };
+
         struct binding
         {
             ogl::binding *ptr;
@@ -87,6 +95,7 @@ namespace app
         std::map<std::string, program> program_map;
         std::map<std::string, process> process_map;
         std::map<std::string, texture> texture_map;
+        std::map<std::string, array>     array_map;
         std::map<std::string, binding> binding_map;
         std::map<std::string, surface> surface_map;
         std::map<std::string, convex>   convex_map;
@@ -94,6 +103,7 @@ namespace app
         std::set<ogl::pool  *>  pool_set;
         std::set<ogl::image *> image_set;
         std::set<ogl::frame *> frame_set;
+        std::set<ogl::block *> block_set;
 
         void dump();
 
@@ -108,6 +118,7 @@ namespace app
               ogl::process *load_process(const std::string&, int=0);
         const ogl::program *load_program(const std::string&);
         const ogl::texture *load_texture(const std::string&, const std::string&);
+              ogl::array   *load_array  (const std::string&);
         const ogl::binding *load_binding(const std::string&, const std::string&);
         const ogl::surface *load_surface(const std::string&, bool);
               ogl::convex  *load_convex (const std::string&);
@@ -124,6 +135,7 @@ namespace app
         void free_program(const std::string&);
         void free_process(const std::string&);
         void free_texture(const std::string&);
+        void free_array  (const std::string&);
         void free_binding(const std::string&);
         void free_surface(const std::string&);
         void free_convex (const std::string&);
@@ -132,6 +144,7 @@ namespace app
         void free_process(const ogl::process *);
         void free_program(const ogl::program *);
         void free_texture(const ogl::texture *);
+        void free_array  (const ogl::array   *);
         void free_binding(const ogl::binding *);
         void free_surface(const ogl::surface *);
         void free_convex (const ogl::convex  *);
@@ -152,10 +165,12 @@ namespace app
                               bool=true,
                               bool=true,
                               bool=false);
+        ogl::block *new_block(const std::string&, GLuint);
 
         void free_pool (ogl::pool  *);
         void free_image(ogl::image *);
         void free_frame(ogl::frame *);
+        void free_block(ogl::block *);
 
         // Render prep, state flush, and state reload.
 
@@ -66,6 +66,14 @@ namespace app
         int    local_frames;
         int    local_limit;
 
+        unsigned long long local_bytes;
+        unsigned long long local_skips;
+        unsigned long long local_culled;
+
+        int startup;
+
+        void dump_startup(Uint64);
+
     public:
 
         perf(SDL_Window *, int=DEFAULT_PERF_AVERAGE);
@@ -0,0 +1,35 @@
+//  Copyright (C) 2011-2014 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef ETC_TASK_HPP
+#define ETC_TASK_HPP
+
+//------------------------------------------------------------------------------
+
+namespace etc {
+
+    typedef void (*task_func)(void *, int);
+
+    // Call func(data, i) for each i in [0, n) using a pool of worker threads.
+    // The calling thread participates, and the call returns once all tasks
+    // are complete. Nested or concurrent calls run serially on the caller.
+
+    void parallel(int n, task_func func, void *data);
+
+    // Return the number of threads, including the caller, used by parallel.
+
+    int threads();
+}
+
+//------------------------------------------------------------------------------
+
+#endif
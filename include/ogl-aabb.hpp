@@ -41,6 +41,7 @@ namespace ogl
 
         void draw(bool, bool, bool, bool) const;
         void draw()                       const;
+        void fill()                       const;
 
         vec3 center() const { return  (a + z) / 2.0; }
         vec3 offset() const { return -(a + z) / 2.0; }
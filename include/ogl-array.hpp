@@ -0,0 +1,91 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_ARRAY_HPP
+#define OGL_ARRAY_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <ogl-opengl.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    class texture;
+}
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // A set of 2D texture arrays, one per texture unit, each layer of which
+    // holds one texture set: the textures bound to those units by a material.
+    // Materials packed into the same array differ only by layer, so their
+    // batches may be merged. The first set added fixes the size and format of
+    // each unit, and only sets matching it are accepted. Each texture is copied
+    // into its layer on the GPU once resident, or its placeholder if it fails
+    // to load. Layers use the default texture parameters, so no texture with
+    // a parameter file is accepted.
+
+    class array
+    {
+    public:
+
+        typedef std::map<GLenum, const ogl::texture *> unit_texture;
+
+        array(std::string);
+       ~array();
+
+        const std::string& get_name() const { return name; }
+
+        int  add(const unit_texture&);
+        void bind() const;
+
+        bool empty() const { return layers.empty(); }
+
+        void prep();
+        void init();
+        void fini();
+
+    private:
+
+        struct plane
+        {
+            GLenum  unit;
+            GLuint  object;
+            GLsizei w;
+            GLsizei h;
+            GLenum  format;
+            GLint   levels;
+        };
+
+        std::string name;
+
+        std::vector<plane>        planes;
+        std::vector<unit_texture> layers;
+        std::vector<bool>         copied;
+
+        GLsizei cap;
+
+        bool match(const unit_texture&) const;
+        void grow (GLsizei);
+        void copy (size_t);
+        void fill (const plane&, size_t);
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
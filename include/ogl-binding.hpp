@@ -28,6 +28,7 @@ namespace ogl
     class frame;
     class program;
     class texture;
+    class array;
 }
 
 //-----------------------------------------------------------------------------
@@ -47,8 +48,14 @@ namespace ogl
 
         const ogl::program *color_program;  // Color mode shader program
         unit_texture        color_texture;  // Color mode texture bindings
+        ogl::array         *color_array;    // Color mode texture array
+        int                 color_layer;    // Color mode texture array layer
+
+        unsigned long long key;             // Batch sort key
 
         const ogl::program *init_program(app::node, unit_texture&);
+        void                init_array();
+        void                init_key();
 
     public:
 
@@ -63,6 +70,9 @@ namespace ogl
         bool color_eq(const binding *) const;
         bool opaque() const;
 
+        unsigned long long get_key() const { return key; }
+        int              get_layer() const { return color_layer; }
+
         bool bind(bool) const;
 
         const ogl::texture *get_default_texture() const;
@@ -0,0 +1,73 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_BLOCK_HPP
+#define OGL_BLOCK_HPP
+
+#include <string>
+#include <vector>
+
+#include <ogl-opengl.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    class uniform;
+}
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // A uniform buffer object shared by all programs declaring the named
+    // uniform block. Each member uniform is stored at a given std140 offset,
+    // and only those members changed since the last prep are uploaded. The
+    // buffer is attached to a fixed binding point, which programs associate
+    // with the block by name.
+
+    class block
+    {
+    public:
+
+        block(std::string, GLuint);
+       ~block();
+
+        const std::string& get_name() const { return name; }
+
+        void add(const uniform *, GLintptr);
+
+        void prep();
+        void init();
+        void fini();
+
+    private:
+
+        struct member
+        {
+            const uniform *ptr;
+            GLintptr       off;
+            unsigned       ver;
+        };
+
+        std::string name;
+        GLuint      index;
+        GLuint      buffer;
+
+        std::vector<member>  members;
+        std::vector<GLfloat> data;
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
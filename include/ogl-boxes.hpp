@@ -0,0 +1,72 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_BOXES_HPP
+#define OGL_BOXES_HPP
+
+#include <vector>
+
+#include <ogl-aabb.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // A flat set of axis-aligned boxes, each carrying a user pointer, stored
+    // as structure-of-arrays floats and tested against a frustum 4 or 8 at a
+    // time with SSE or AVX. The plane test carries a margin covering float
+    // rounding, so that no box visible to aabb::test is culled.
+
+    class boxes
+    {
+    public:
+
+        boxes();
+
+        int  insert(const aabb&, void *);
+        void remove(int);
+        void move  (int, const aabb&);
+
+        void test(const vec4 *, int, std::vector<unsigned>&) const;
+        void cull(const vec4 *const *, int, int, std::vector<void *>&,
+                                                 std::vector<unsigned>&) const;
+
+        int size() const { return count; }
+
+        static int  width();
+        static bool bench(int);
+
+    private:
+
+        std::vector<float>    ax;
+        std::vector<float>    ay;
+        std::vector<float>    az;
+        std::vector<float>    zx;
+        std::vector<float>    zy;
+        std::vector<float>    zz;
+        std::vector<void *>   data;
+        std::vector<unsigned> live;
+        std::vector<int>      spare;
+
+        int    count;
+        double range;
+
+        mutable std::vector<std::vector<unsigned> > bits;
+
+        void set(int, const aabb&);
+        void run(const vec4 *, int, std::vector<unsigned>&, int) const;
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
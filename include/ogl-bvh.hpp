@@ -0,0 +1,87 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_BVH_HPP
+#define OGL_BVH_HPP
+
+#include <vector>
+
+#include <ogl-aabb.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // A dynamic bounding volume hierarchy of axis-aligned boxes, each leaf
+    // carrying a user pointer. Leaves are inserted beside the sibling of least
+    // surface area cost and the tree is kept balanced by rotation. Leaf boxes
+    // are fattened so that small motions need no update. A box leaving its fat
+    // bound is reinserted. Culling tests up to 32 frusta in one traversal.
+
+    class bvh
+    {
+    public:
+
+        bvh();
+
+        int  insert(const aabb&, void *);
+        void remove(int);
+        bool move  (int, const aabb&);
+
+        void cull(const vec4 *const *, int, int, std::vector<void *>&,
+                                                 std::vector<unsigned>&) const;
+
+        int size() const { return count; }
+
+        static bool bench(int);
+
+    private:
+
+        struct item
+        {
+            aabb  bound;
+            void *data;
+            int   parent;
+            int   child[2];
+            int   height;
+
+            bool leaf() const { return child[0] < 0; }
+        };
+
+        std::vector<item> items;
+
+        int root;
+        int spare;
+        int count;
+
+        struct visit
+        {
+            int      i;
+            unsigned live;
+            unsigned in;
+        };
+
+        mutable std::vector<visit> stack;
+
+        int  alloc();
+        void release(int);
+
+        void insert_leaf(int);
+        void remove_leaf(int);
+        int  balance(int);
+        void refit(int);
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
@@ -34,6 +34,8 @@ namespace ogl
         virtual void fini();
         virtual void draw();
 
+        void copy(const frame *) const;
+
         GLsizei get_w()     const { return w; }
         GLsizei get_h()     const { return h; }
         GLuint  get_color() const { return color; }
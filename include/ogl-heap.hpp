@@ -0,0 +1,71 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_HEAP_HPP
+#define OGL_HEAP_HPP
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <ogl-opengl.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // Suballocator of a linear range of items, such as the vertices or
+    // elements of a buffer object. Block sizes are rounded up to power-of-two
+    // size classes. Freed blocks go to a free list for their class, ordered by
+    // offset, and are reused before the top of the heap advances. The heap
+    // never touches GL. Its user grows the underlying buffer to match.
+
+    class heap
+    {
+    public:
+
+        heap(GLsizei=64);
+
+        GLsizei alloc(GLsizei);
+        void    free (GLsizei);
+        void    clear();
+
+        GLsizei size(GLsizei o) const;
+        bool    fits(GLsizei o, GLsizei n) const;
+
+        GLsizei get_top() const { return top; }
+        GLsizei get_cap() const { return cap; }
+        GLsizei get_use() const { return use; }
+
+        bool defrag(GLsizei&, GLsizei&);
+
+    private:
+
+        typedef std::map<GLsizei, GLsizei> block_m;
+        typedef std::set<GLsizei>          block_s;
+
+        GLsizei min;
+        GLsizei top;
+        GLsizei cap;
+        GLsizei use;
+
+        block_m              live;
+        std::vector<block_s> free_list;
+
+        int  size_class(GLsizei) const;
+        void trim();
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
@@ -20,6 +20,7 @@
 #include <ogl-opengl.hpp>
 #include <ogl-aabb.hpp>
 #include <ogl-binding.hpp>
+#include <ogl-stream.hpp>
 
 //-----------------------------------------------------------------------------
 
@@ -100,6 +101,7 @@ namespace ogl
 
         void apply_offset(const double *);
         void calc_tangent();
+        void optimize(bool);
 
         void add_vert(GLvec3&, GLvec3&, GLvec3&);
         void add_face(GLuint, GLuint, GLuint);
@@ -118,6 +120,10 @@ namespace ogl
         GLsizei count_verts() const { return GLsizei(   vv.size()); }
         GLsizei count_faces() const { return GLsizei(faces.size()); }
         GLsizei count_lines() const { return GLsizei(lines.size()); }
+        GLsizei count_misses() const;
+
+        const GLvec3_v& get_verts() const { return vv;    }
+        const face_v&   get_faces() const { return faces; }
 
         aabb   get_bound() const { return bound; }
         GLuint get_min  () const { return min;   }
@@ -126,11 +132,23 @@ namespace ogl
         // Buffer object writers
 
         void buffv(const GLfloat *, const GLfloat *,
-                   const GLfloat *, const GLfloat *);
-        void buffe(const GLuint  *);
+                   const GLfloat *, const GLfloat *, stream&);
+        void buffe(const GLuint  *, stream&);
+        bool packv(GLshort *, GLshort *, GLushort *, const vec3&, double, bool);
+
+        // Binary cache serialization
+
+        void           save(std::vector<GLubyte>&)       const;
+        const GLubyte *load(const GLubyte *, const GLubyte *);
+
+        static bool bench(int);
 
     private:
 
+        void sort_faces();
+        void sort_clusters();
+        void sort_verts();
+
         const binding *material;
 
         // Vertex buffers
@@ -165,15 +183,6 @@ namespace ogl
     typedef std::vector<mesh *>                 mesh_v;
     typedef std::vector<mesh *>::iterator       mesh_i;
     typedef std::vector<mesh *>::const_iterator mesh_c;
-
-    //-------------------------------------------------------------------------
-
-    struct meshcmp
-    {
-        bool operator()(const mesh *m1, const mesh *m2) const {
-            return (m1->state() < m2->state());
-        }
-    };
 }
 
 //-----------------------------------------------------------------------------
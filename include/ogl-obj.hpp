@@ -24,18 +24,36 @@ namespace obj
 {
     //-------------------------------------------------------------------------
 
-    struct iset
+    // Open-addressing hash of vertex index sets, mapping each distinct v/t/n
+    // triple to the index of its mesh vertex. Clearing is proportional to the
+    // number of entries made since the last clear.
+
+    class iset
     {
-        int vi;
-        int si;
-        int ni;
-        int ii;
+    public:
 
-        iset(int v, int s, int n, int i) : vi(v), si(s), ni(n), ii(i) { }
-    };
+        iset();
+
+        int  find  (int, int, int) const;
+        void insert(int, int, int, int);
+        void clear ();
+
+    private:
+
+        struct slot
+        {
+            int vi;
+            int si;
+            int ni;
+            int i;
+        };
 
-    typedef std::vector<int>  indx_v;
-    typedef std::vector<iset> iset_v;
+        std::vector<slot>   slots;
+        std::vector<size_t> used;
+
+        size_t locate(int, int, int) const;
+        void   resize(size_t);
+    };
 
     //-------------------------------------------------------------------------
 
@@ -49,10 +67,12 @@ namespace obj
         ogl::GLvec3_d sv;
         ogl::GLvec3_d nv;
 
-        indx_v ii;
-        iset_v is;
+        iset is;
+
+        std::vector<GLuint> iv;
 
         double scale;
+        int    optimize;
 
         // Read handlers.
 
@@ -67,8 +87,21 @@ namespace obj
         const char *read_vt (const char *);
         const char *read_vn (const char *);
 
+        int  face_vert(int, int, int);
+        int  line_vert(int, int);
+        void new_mesh (std::string);
+
         void center();
 
+        // Whole-file readers.
+
+        void read_obj  (const std::string&);
+        void read_ser  (const char *);
+        void read_par  (const char *, size_t);
+        void verify    (const std::string&, const char *);
+        bool read_cache(const std::string&, size_t, long long);
+        void save_cache(const std::string&, size_t, long long) const;
+
     public:
 
         obj(std::string, bool);
@@ -0,0 +1,87 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_OCCLUSION_HPP
+#define OGL_OCCLUSION_HPP
+
+#include <vector>
+
+#include <etc-vector.hpp>
+#include <ogl-aabb.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // A low-resolution software depth buffer for occlusion culling. Occluder
+    // triangles are rasterized on the CPU in bands of 8 rows, in parallel and
+    // 4 pixels at a time with SSE. Only pixels lying wholly within a triangle
+    // are written, each with the farthest depth the triangle reaches there,
+    // so the buffer never occludes more than the triangles do. The farthest
+    // depth of each 8x8 tile is kept, allowing most box tests to end early.
+
+    class occlusion
+    {
+    public:
+
+        occlusion(int, int);
+
+        void clear(const mat4&);
+        void add  (const mat4&, const std::vector<vec3>&);
+        void draw ();
+        bool test (const aabb&) const;
+
+        int size() const { return int(tris.size()); }
+
+        const float *get_depth() const { return &depth.front(); }
+
+    private:
+
+        // Edge functions offset so that a pixel center passes if its pixel
+        // lies within the triangle, and the depth plane offset to the farthest
+        // depth within each pixel, all in pixel coordinates.
+
+        struct tri
+        {
+            float ea[3];
+            float eb[3];
+            float ec[3];
+            float za;
+            float zb;
+            float zc;
+            float zz;
+            int   x0;
+            int   x1;
+            int   y0;
+            int   y1;
+        };
+
+        int w;
+        int h;
+
+        mat4 T;
+
+        std::vector<float> depth;
+        std::vector<float> tiles;
+        std::vector<tri>   tris;
+
+        void setup(const vec4&, const vec4&, const vec4&);
+        void clip (const vec4&, const vec4&, const vec4&);
+        void band (int);
+
+        static void band(void *, int);
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
@@ -29,6 +29,19 @@ namespace ogl
     extern bool has_multisample;
     extern bool has_anisotropic;
     extern bool has_s3tc;
+    extern bool has_copy_buffer;
+    extern bool has_map_buffer_range;
+    extern bool has_buffer_storage;
+    extern bool has_half_float_vertex;
+    extern bool has_instanced_arrays;
+    extern bool has_texture_buffer;
+    extern bool has_uniform_buffer;
+    extern bool has_program_binary;
+    extern bool has_pixel_buffer;
+    extern bool has_texture_array;
+    extern bool has_occlusion_query;
+    extern bool has_conditional_render;
+    extern bool has_framebuffer_blit;
 
     extern int  max_lights;
     extern int  max_anisotropy;
@@ -36,6 +49,13 @@ namespace ogl
     extern bool do_texture_compression;
     extern bool do_hdr_tonemap;
     extern bool do_hdr_bloom;
+    extern bool do_compact_vertex;
+    extern bool do_instancing;
+    extern bool do_multidraw;
+    extern bool do_uniform_block;
+    extern bool do_program_cache;
+    extern bool do_texture_array;
+    extern bool do_occlusion_query;
 
     void check_err(const char *, int);
     bool check_ext(const char *);
@@ -43,6 +63,20 @@ namespace ogl
     void init(bool);
     void fini();
 
+    // Binding state tracker
+
+    extern unsigned long long skip_program;
+    extern unsigned long long skip_texture;
+    extern unsigned long long skip_buffer;
+
+    void reset_state();
+
+    void bind_program(GLuint);
+    void drop_program(GLuint);
+    void bind_buffer (GLenum, GLuint);
+    void drop_buffer (GLuint);
+    void drop_texture(GLuint);
+
     void curr_texture(GLenum);
     void bind_texture(GLenum, GLenum, GLuint);
     void xfrm_texture(GLenum, const GLdouble *);
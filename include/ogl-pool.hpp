@@ -21,6 +21,10 @@
 #include <etc-vector.hpp>
 #include <ogl-surface.hpp>
 #include <ogl-mesh.hpp>
+#include <ogl-heap.hpp>
+#include <ogl-bvh.hpp>
+#include <ogl-boxes.hpp>
+#include <ogl-occlusion.hpp>
 
 // This interface, in consort with ogl::mesh, implements a fairly complex
 // mechanism to optimize 3D geometry for rendering with OpenGL vertex buffer
@@ -32,8 +36,8 @@
 // Each unit maintains two sets of meshes, one set of static meshes given by its
 // input OBJ file, and a second set of cached meshes giving transformed versions
 // of that input. These transformed vertex arrays are concatenated giving vertex
-// array buffers. The meshes are sorted by material type and concatenated giving
-// element array buffers.
+// array buffers. The meshes are radix sorted by a key encoding opacity, program,
+// texture set, and material, and concatenated giving element array buffers.
 
 // Material definitions, given by ogl::surface objects, define independent color
 // and depth bindings. Meshes are sorted accordingly, giving a separate set of
@@ -41,6 +45,10 @@
 // and early-Z passes. Alpha-tested geometry is further distinguised, allowing
 // alpha-test geometry to be rendered last.
 
+// Where instancing is enabled, units of a node sharing a surface are grouped.
+// The group caches the surface once, untransformed, and each visible unit is
+// drawn as an instance with its transform given by per-instance attributes.
+
 //-----------------------------------------------------------------------------
 
 namespace ogl
@@ -50,20 +58,50 @@ namespace ogl
     class unit;
     class node;
     class pool;
+    struct inst;
 
     typedef unit                      *unit_p;
     typedef std::set<unit_p>           unit_s;
     typedef std::set<unit_p>::iterator unit_i;
+    typedef std::vector<unit_p>        unit_v;
 
     typedef node                      *node_p;
     typedef std::set<node_p>           node_s;
     typedef std::set<node_p>::iterator node_i;
+    typedef std::vector<node_p>        node_v;
 
     typedef pool                      *pool_p;
     typedef std::set<pool_p>           pool_s;
     typedef std::set<pool_p>::iterator pool_i;
 
-    typedef std::multimap<const mesh *, mesh_p, meshcmp> mesh_m;
+    //-------------------------------------------------------------------------
+    // Source mesh and transformed cache, with a key ordering it for batching
+
+    struct cache
+    {
+        cache(const mesh *s, mesh_p d, unsigned long long k)
+            : src(s), dst(d), key(k) { }
+
+        const mesh        *src;
+        mesh_p             dst;
+        unsigned long long key;
+    };
+
+    typedef std::vector<cache>                 cache_v;
+    typedef std::vector<cache>::iterator       cache_i;
+    typedef std::vector<cache>::const_iterator cache_c;
+
+    //-------------------------------------------------------------------------
+    // Element batches of many nodes sharing state, for glMultiDrawElements
+
+    struct multi
+    {
+        std::vector<GLsizei>        num;
+        std::vector<const GLvoid *> off;
+    };
+
+    typedef std::pair<const binding *, GLenum> multi_k;
+    typedef std::map<multi_k, multi>           multi_m;
 
     //-------------------------------------------------------------------------
     // Drawable / mergable element batch
@@ -80,7 +118,9 @@ namespace ogl
         bool color_eq(const elem&) const;
         void merge   (const elem&);
 
-        void draw(bool) const;
+        void draw(bool)          const;
+        void draw(bool, GLsizei) const;
+        void queue(multi_m&)     const;
 
     private:
 
@@ -115,12 +155,21 @@ namespace ogl
         void set_node(node_p);
         void set_mode(bool);
         void set_ubiq(bool);
+        void set_occl(bool);
 
         bool is_ubiq() const { return ubiquitous; }
+        bool is_mode() const { return active;     }
+        bool is_occl() const { return occluder;   }
+
+        void occlude(occlusion&);
+
+        void        set_inst(const inst *);
+        const inst *get_inst() const { return my_inst; }
 
         void transform(const mat4&, const mat4&);
+        void set_rebuff();
 
-        void merge_batch(mesh_m&);
+        void merge_batch(cache_v&);
 
         void buff(bool);
 
@@ -129,6 +178,9 @@ namespace ogl
         int     get_id() const { return id; }
         aabb get_bound() const { return my_aabb; }
 
+        const surface *get_surf() const { return surf; }
+        const mat4&    get_transform() const { return M; }
+
         mat4                get_world_transform() const;
         const ogl::binding *get_default_binding() const;
 
@@ -143,19 +195,58 @@ namespace ogl
         GLsizei vc;
         GLsizei ec;
 
-        node_p my_node;
-        mesh_m my_mesh;
-        aabb   my_aabb;
+        node_p  my_node;
+        cache_v my_mesh;
+        aabb    my_aabb;
 
         bool rebuff;
         bool active;
         bool ubiquitous;
 
         const surface *surf;
+        const inst    *my_inst;
+
+        // Unit-space occluder triangles, three vertices each. A chosen
+        // occluder gives all of its opaque faces, any other only its largest.
 
+        bool              occluder;
+        bool              reoccl;
+        std::vector<vec3> occl;
+
+        void find_occl();
         void set_mesh();
+        void set_attr() const;
+    };
+
+    //-------------------------------------------------------------------------
+    // Instanced units sharing a surface. The surface's meshes are cached once,
+    // untransformed, and drawn once per visible unit using per-instance
+    // transform attributes.
+
+    struct inst
+    {
+        inst(const surface *s) : surf(s), ibase(0) { }
+       ~inst();
+
+        const surface *surf;
+        unit_v         units;
+        cache_v        meshes;
+        mat4           Q;
+        GLsizei        ibase;
+
+        // Per frustum ID, per unit: cached culler hint, with bit 3 flagging
+        // visibility. An ID with no row has not been tested.
+
+        std::vector<std::vector<GLubyte> > test_cache;
+
+        elem_v opaque_depth;
+        elem_v opaque_color;
+        elem_v masked_depth;
+        elem_v masked_color;
     };
 
+    typedef std::vector<inst *> inst_v;
+
     //-------------------------------------------------------------------------
     // Dynamic batchable
 
@@ -175,36 +266,131 @@ namespace ogl
         void add_unit(unit_p);
         void rem_unit(unit_p);
 
-        void buff(GLfloat *, GLfloat *, GLfloat *, GLfloat *, bool);
-        void sort(GLuint  *, GLuint);
+        void need(unit_v&, bool) const;
+        void buff(GLfloat *, GLfloat *, GLfloat *, GLfloat *, bool, stream&);
+        void upld(GLfloat *, GLfloat *, GLfloat *, GLfloat *, bool, stream&);
+        void pack(GLubyte *, GLubyte *, GLubyte *, bool, stream&);
+        void sort(GLuint  *, GLuint, stream&);
 
-        ogl::aabb view(int, const vec4 *, int);
+        ogl::aabb view(int, int, const vec4 *const *, int,
+                       unsigned, unsigned);
         void      draw(int=0, bool=true, bool=false);
+        void      draw_cond(int, bool, bool, multi_m *);
+        void      queue(int, bool, bool, multi_m&);
+        bool      is_visible(int) const;
+        void      occlude(occlusion&) const;
+        void      hide(int);
+        void      show(int);
+
+        void      poll (int, const vec4&);
+        void      query(int, const vec4&, int);
+        void      drop_query();
+
+        bool is_hidden(int id) const {
+            return (size_t(id) < query_state.size()
+                             && (query_state[id] & query_hidden));
+        }
+
+        bool is_ubiq() const { return ubiquitous; }
+
+        unsigned get_version() const { return version; }
 
         GLsizei vcount() const { return vc; }
         GLsizei ecount() const { return ec; }
 
+        void    group(int);
+        void    ungroup();
+        GLsizei vsize() const { return vs; }
+        GLsizei esize() const { return es; }
+        GLsizei isize() const { return GLsizei(instances.size() / 16); }
+
+        void    set_sbase(GLsizei);
+        GLsizei get_sbase() const { return sbase; }
+        GLsizei ssize() const { return GLsizei(my_inst.size() + 1); }
+        void    index(GLfloat *, stream&);
+        void    layer(GLfloat *, stream&);
+        void    buff_slot(std::vector<GLfloat>&) const;
+
+        void    set_ibase(GLsizei);
+        bool    get_reinst() const { return reinst; }
+        const GLfloat *get_instances() const;
+
+        bool    get_resort() const { return resort; }
+        GLsizei get_vbase () const { return vbase;  }
+        GLsizei get_ebase () const { return ebase;  }
+        void    set_range(GLsizei, GLsizei);
+
         void transform(const mat4&);
 
         mat4 get_world_transform() const;
+        mat4 get_quantization() const { return Q; }
+        aabb get_bound() const;
+
+        void insert(bvh&);
+        void remove(bvh&);
+        void refit (bvh&);
+        void insert(boxes&);
+        void remove(boxes&);
+        void refit (boxes&);
 
     private:
 
         mat4 M;
+        mat4 Q;
 
         GLsizei vc;
         GLsizei ec;
+        GLsizei vs;
+        GLsizei es;
+        GLsizei vbase;
+        GLsizei ebase;
+        GLsizei sbase;
 
         bool ubiquitous;
+        bool resort;
         bool rebuff;
+        bool reinst;
+        bool rebound;
+        int  leaf;
+
+        // Count of changes to the content or transform of this node, allowing
+        // renderings of it to be cached.
+
+        unsigned version;
+
+        pool_p  my_pool;
+        unit_s  my_unit;
+        cache_v my_mesh;
+        aabb    my_aabb;
+
+        std::vector<GLshort> packed;
+        std::vector<GLfloat> instances;
+        std::vector<GLfloat> slots;
+        std::vector<GLfloat> layers;
+        inst_v               my_inst;
+
+        void render (int, bool, bool);
+        void enqueue(int, bool, bool, multi_m&);
+
+        void buff_inst();
+        void view_inst(inst *, int, const vec4 *, int) const;
+        void draw_inst(const inst *, int, bool, bool) const;
+        void set_rebound();
+
+        // Per frustum ID, the pool pass that last found this node visible,
+        // and the cached culler hint.
 
-        pool_p my_pool;
-        unit_s my_unit;
-        mesh_m my_mesh;
-        aabb   my_aabb;
+        std::vector<unsigned> test_cache;
+        std::vector<GLubyte>  hint_cache;
 
-        unsigned int test_cache;
-        unsigned int hint_cache;
+        // Per frustum ID, the occlusion query of this node's bound and its
+        // state: whether the last result found the node hidden, whether a
+        // query is pending, and the frames until a visible node is queried.
+
+        enum { query_hidden = 0x80, query_pending = 0x40, query_wait = 0x3F };
+
+        std::vector<GLuint>  query_object;
+        std::vector<GLubyte> query_state;
 
         elem_v opaque_depth;
         elem_v opaque_color;
@@ -224,19 +410,28 @@ namespace ogl
 
         void set_resort();
         void set_rebuff();
+        void set_rebound(node_p);
         void add_vcount(GLsizei);
         void add_ecount(GLsizei);
 
         void add_node(node_p);
         void rem_node(node_p);
 
-        ogl::aabb view(int, const vec4 *, int);
+        ogl::aabb view(int, int, const vec4 *const *, int);
+        ogl::aabb view(int,      const vec4 *,        int);
+        void      occlude(int, const mat4&);
         void      prep();
 
+        unsigned get_pass(int id) const {
+            return (size_t(id) < passes.size()) ? passes[id] : 0;
+        }
+
         void draw_init();
         void draw(int=0, bool=true, bool=false);
         void draw_fini();
 
+        static unsigned long long get_culled();
+
         void init();
         void fini();
 
@@ -247,14 +442,97 @@ namespace ogl
 
         bool resort;
         bool rebuff;
+        bool packed;
 
         GLuint vbo;
         GLuint ebo;
+        GLuint ibo;
+
+        // Minimum count of units sharing a surface to draw instanced
+
+        int instance;
+
+        // Node transforms in a texture buffer, indexed by a per-vertex slot
+        // attribute, allowing batches of all nodes to be drawn together.
+
+        bool    multidraw;
+        GLuint  tbo;
+        GLuint  tex;
+        multi_m batch;
+
+        std::vector<GLfloat> transforms;
+
+        // Texture array layer of each vertex, allowing batches of bindings
+        // sharing a texture array to be drawn together.
+
+        bool layered;
+
+        // Suballocation of the VBO and EBO among nodes
+
+        typedef std::map<GLsizei, node_p> owner_m;
+
+        heap    vheap;
+        heap    eheap;
+        owner_m vowner;
+        owner_m eowner;
+        bool    compact;
+
+        // Batched upload of dirty buffer ranges
+
+        stream upload;
+
+        // World-space node bounds, in a hierarchy or a flat SIMD-tested set.
+        // Only nodes not culled are tested, each against only the frusta it
+        // may touch.
+
+        enum { cull_linear, cull_tree, cull_flat };
+
+        int                   culling;
+        bvh                   tree;
+        boxes                 flat;
+        node_v                moved;
+        std::vector<void *>   found;
+        std::vector<unsigned> masks;
+
+        // The pass that last tested each frustum ID. A node is visible to an
+        // ID if that pass found it so, or if no pass has yet tested the ID.
+
+        unsigned              serial;
+        std::vector<unsigned> passes;
+
+        // Software depth buffer hiding nodes found visible by the last pass,
+        // behind the nearest occluders up to a triangle budget.
+
+        occlusion *occl;
+        int        occl_faces;
+        node_v     shown;
+
+        std::vector<std::pair<double, node_p> > order;
+
+        // Hardware occlusion queries of node bounds, issued in the opaque
+        // pass and used by the next, or by conditional rendering in this.
+        // Results are read once per pass of each frustum ID.
+
+        bool                  querying;
+        int                   query_interval;
+        multi_m               cond;
+        std::vector<unsigned> polled;
+
+        // Count of nodes culled by either occlusion test
+
+        static unsigned long long culled;
 
         node_s my_node;
 
+        void refit();
+        void place(node_p);
+        void leave(node_p);
+        void reset();
+
         void buff(bool);
         void sort();
+        void defrag();
+        void move();
     };
 }
 
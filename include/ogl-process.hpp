@@ -43,6 +43,8 @@ namespace ogl
 
         virtual void bind_frame() const { }
         virtual void free_frame() const { }
+        virtual void save_frame()       { }
+        virtual bool load_frame() const { return false; }
         virtual void bind(GLenum) const { }
 
         virtual void init() { }
@@ -51,6 +51,7 @@ namespace ogl
         GLenum unit(std::string) const;
 
         bool discards() const { return discard; }
+        bool arrays()   const { return layered; }
 
         void uniform(std::string, int)                     const;
         void uniform(std::string, double)                  const;
@@ -64,9 +65,18 @@ namespace ogl
 
     private:
 
-        typedef std::map<      std::string,    GLenum> texture_map;
-        typedef std::map<const ogl::process *, GLenum> process_map;
-        typedef std::map<      ogl::uniform *, GLint>  uniform_map;
+        // Each uniform location is paired with the version of the value last
+        // applied to it.
+
+        struct location
+        {
+            GLint    loc;
+            unsigned ver;
+        };
+
+        typedef std::map<      std::string,    GLenum>   texture_map;
+        typedef std::map<const ogl::process *, GLenum>   process_map;
+        typedef std::map<      ogl::uniform *, location> uniform_map;
 
         std::string name;
 
@@ -76,10 +86,11 @@ namespace ogl
 
         texture_map textures;
         process_map processes;
-        uniform_map uniforms;
+        mutable uniform_map uniforms;
 
         bool bindable;
         bool discard;
+        bool layered;
 
         bool program_log(GLhandleARB, const std::string&);
         bool  shader_log(GLhandleARB, const std::string&);
@@ -89,10 +100,14 @@ namespace ogl
 
         std::string load(const std::string&);
 
+        bool read_binary(const std::string&, unsigned long long);
+        void save_binary(const std::string&, unsigned long long);
+
         void init_attributes(app::node);
         void init_textures  (app::node);
         void init_processes (app::node);
         void init_uniforms  (app::node);
+        void init_blocks    (app::node);
     };
 }
 
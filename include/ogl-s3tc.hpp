@@ -0,0 +1,34 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_S3TC_HPP
+#define OGL_S3TC_HPP
+
+#include <ogl-opengl.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // CPU encoding of 8-bit RGB images to S3TC DXT1 and RGBA images to DXT5.
+    // Images of any size are accepted, with partial blocks padded by edge
+    // replication. The encoder favors speed over quality, fitting endpoints
+    // to the bounding box of each block.
+
+    GLenum  s3tc_format(GLsizei);
+    GLsizei s3tc_size  (GLsizei, GLsizei, GLsizei);
+    void    s3tc_encode(GLsizei, GLsizei, GLsizei, const GLubyte *, GLubyte *);
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
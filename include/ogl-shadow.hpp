@@ -32,6 +32,8 @@ namespace ogl
         int size;
 
         ogl::frame *buff;
+        ogl::frame *save;
+        bool        saved;
 
     public:
 
@@ -40,7 +42,11 @@ namespace ogl
 
         void bind_frame() const;
         void free_frame() const;
+        void save_frame();
+        bool load_frame() const;
         void bind(GLenum) const;
+
+        void fini();
     };
 }
 
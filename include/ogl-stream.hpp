@@ -0,0 +1,94 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#ifndef OGL_STREAM_HPP
+#define OGL_STREAM_HPP
+
+#include <vector>
+
+#include <ogl-opengl.hpp>
+
+//-----------------------------------------------------------------------------
+
+namespace ogl
+{
+    // Batched upload of many small ranges to the buffer objects bound to the
+    // array and element array targets. Ranges are queued as they are dirtied
+    // and flushed together, with adjacent destinations coalesced into single
+    // copies. Data is staged through a persistently-mapped ring buffer, or an
+    // orphaned ring buffer, where supported, and glBufferSubData otherwise.
+    // Queued source data must remain valid until the flush.
+
+    class stream
+    {
+    public:
+
+        stream();
+       ~stream();
+
+        void add(GLenum, GLintptr, GLsizeiptr, const GLvoid *);
+        void flush();
+
+        void init();
+        void fini();
+
+        static unsigned long long get_bytes();
+
+    private:
+
+        struct range
+        {
+            GLenum         target;
+            GLintptr       off;
+            GLsizeiptr     siz;
+            const GLubyte *dat;
+
+            range(GLenum t, GLintptr o, GLsizeiptr s, const GLubyte *d)
+                : target(t), off(o), siz(s), dat(d) { }
+
+            bool operator<(const range& that) const {
+                if (target == that.target)
+                    return off < that.off;
+                else
+                    return target < that.target;
+            }
+        };
+
+        enum { stream_sub, stream_orphan, stream_persist };
+
+        static const int fences = 4;
+
+        std::vector<range>   queue;
+        std::vector<GLubyte> cache;
+
+        int         mode;
+        GLuint      buffer;
+        GLsizeiptr  size;
+        GLintptr    head;
+        GLubyte    *ptr;
+        GLsync      fence[fences];
+        unsigned    touch;
+
+        static unsigned long long bytes;
+
+        void     write  (size_t, size_t);
+        void     write  (GLenum, GLintptr, GLsizeiptr, const GLubyte *);
+        GLubyte *reserve(GLsizeiptr);
+        void     commit (GLenum, GLintptr, GLsizeiptr);
+        void     wait   (int);
+        void     mark   ();
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+#endif
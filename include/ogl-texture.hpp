@@ -24,6 +24,12 @@
 
 namespace ogl
 {
+    // A 2D texture loaded from an image file with its mipmaps. By default the
+    // image is decoded and its mipmaps built by background worker threads,
+    // while the texture shows a placeholder. The render thread uploads each
+    // finished texture during sync, through a pixel buffer object where
+    // supported.
+
     class texture
     {
         std::string name;
@@ -32,14 +38,31 @@ namespace ogl
         GLsizei w;
         GLsizei h;
         GLsizei c;
+        bool    ready;
+        bool    failed;
+        bool    params;
 
-        void load_png(const void *, size_t, std::vector<GLubyte>&);
-        void load_jpg(const void *, size_t, std::vector<GLubyte>&); // TODO
+        static void load_png(const void *, size_t, std::vector<GLubyte>&,
+                             GLsizei&, GLsizei&, GLsizei&);
+        static void load_jpg(const void *, size_t, std::vector<GLubyte>&,
+                             GLsizei&, GLsizei&, GLsizei&); // TODO
 
         void load_img(std::string, std::map<int, vec4>&);
+        void load_bg (std::string, std::map<int, vec4>&);
         void load_opt(std::string, std::map<int, vec4>&);
         void load_prm(std::string);
 
+        static void make_mip(const void *, size_t, const std::map<int, vec4>&,
+                             std::vector<GLubyte>&, size_t, long long, GLuint);
+        bool load_mip(const GLubyte *, const GLubyte *, bool=false);
+
+        static const GLubyte *map_cache(const std::string&, size_t, long long,
+                                        GLuint, size_t&);
+        static void save_cache(const std::string&,
+                               const std::vector<GLubyte>&);
+
+        static int work(void *);
+
     public:
 
         const std::string& get_name() const { return name; }
@@ -54,6 +77,25 @@ namespace ogl
         void fini();
 
         bool opaque() const { return (c == 1 || c == 3); }
+
+        // Properties of the image, known from its header before it is
+        // resident. A texture whose decode fails becomes ready with its
+        // placeholder. One with a parameter file sets its own wrap and
+        // filter modes.
+
+        GLsizei get_w()      const { return w;      }
+        GLsizei get_h()      const { return h;      }
+        GLuint  get_o()      const { return object; }
+        bool    is_ready()   const { return ready;  }
+        bool    is_failed()  const { return failed; }
+        bool    has_params() const { return params; }
+        GLenum  get_format() const;
+        GLint   get_levels() const;
+
+        static void sync();
+        static int  pending();
+
+        static const GLubyte placeholder[4];
     };
 }
 
@@ -22,6 +22,10 @@
 
 namespace ogl
 {
+    // A named uniform value shared by all programs that declare it. Each
+    // change of value increments the version, allowing programs and blocks
+    // to upload only those values changed since they last looked.
+
     class uniform
     {
     public:
@@ -29,7 +33,9 @@ namespace ogl
         uniform(std::string, GLsizei);
        ~uniform();
 
-        const std::string& get_name() const { return name; }
+        const std::string& get_name()    const { return name; }
+        unsigned           get_version() const { return ver;  }
+        GLsizei            get_size()    const { return len;  }
 
         void set(double);
         void set(const vec2&);
@@ -38,7 +44,8 @@ namespace ogl
         void set(const mat3&);
         void set(const mat4&);
 
-        void apply(GLint) const;
+        void apply(GLint)     const;
+        void pack (GLfloat *) const;
 
     private:
 
@@ -46,6 +53,9 @@ namespace ogl
 
         GLfloat *val;
         GLsizei  len;
+        unsigned ver;
+
+        void store(const GLfloat *);
     };
 }
 
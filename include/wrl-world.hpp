@@ -34,6 +34,7 @@ namespace ogl
     class binding;
     class uniform;
     class process;
+    class block;
 }
 
 //-----------------------------------------------------------------------------
@@ -106,7 +107,8 @@ namespace wrl
 
         // Rendering methods
 
-        void set_light(int, const vec4&, int, app::frustum *);
+        void set_light(int, const vec4&, int, app::frustum *,
+                                             const ogl::aabb&);
 
         int s_light(int, const vec3&, const vec3&, double,
                     int, const app::frustum *const *, const ogl::aabb&);
@@ -151,6 +153,8 @@ namespace wrl
         ogl::pool *line_pool;
         ogl::node *line_node;
 
+        ogl::aabb fill_bound;
+
         void node_insert(int, ogl::unit *, ogl::unit *);
         void node_remove(int, ogl::unit *, ogl::unit *);
 
@@ -166,6 +170,7 @@ namespace wrl
         // Lighting uniforms and processes
 
         int shadow_splits;
+        int shadow_snap;
 
         ogl::uniform *uniform_shadow[4];
         ogl::uniform *uniform_light [4];
@@ -174,9 +179,21 @@ namespace wrl
         ogl::uniform *uniform_highlight;
         ogl::uniform *uniform_spot;
         ogl::uniform *uniform_unit;
+        ogl::block   *block_light;
 
         ogl::process *process_shadow[4];
         ogl::process *process_cookie[4];
+
+        // Static shadow map cache: the light transform, caster planes, and
+        // static node version with which each saved shadow map was rendered.
+
+        bool     shadow_cache;
+        mat4     cache_transform[4];
+        vec4     cache_planes   [4][6];
+        unsigned cache_version  [4];
+        bool     cache_valid    [4];
+
+        void draw_shadow(int);
     };
 }
 
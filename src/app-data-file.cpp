@@ -19,6 +19,7 @@
 #include <io.h>
 #else
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 #include <app-default.hpp>
@@ -63,6 +64,70 @@ app::file_buffer::file_buffer(std::string name)
 
 //-----------------------------------------------------------------------------
 
+// Map the named file into memory. There is no mmap under Windows, so the file
+// is read there instead. In either case, the buffer is read-only.
+
+app::file_map_buffer::file_map_buffer(std::string name)
+{
+    struct stat info;
+    int fd;
+
+#ifndef _WIN32
+    if ((fd = open(name.c_str(), O_RDONLY)) == -1)
+        throw open_error(name);
+#else
+    if ((fd = open(name.c_str(), O_RDONLY | O_BINARY)) == -1)
+        throw open_error(name);
+#endif
+
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw stat_error(name);
+    }
+
+    // An empty file maps to an empty buffer.
+
+    len = (size_t) info.st_size;
+
+    if (len)
+    {
+#ifndef _WIN32
+        void *p;
+
+        if ((p = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED)
+            ptr = (unsigned char *) p;
+        else
+        {
+            close(fd);
+            throw read_error(name);
+        }
+#else
+        ptr = new unsigned char[len + 1];
+
+        memset(ptr, 0, len + 1);
+
+        if (read(fd, ptr, len) < (int) len)
+        {
+            close(fd);
+            throw read_error(name);
+        }
+#endif
+    }
+
+    close(fd);
+}
+
+app::file_map_buffer::~file_map_buffer()
+{
+#ifndef _WIN32
+    if (ptr) munmap(ptr, len);
+    ptr = 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
 app::file_archive::file_archive(std::string path, bool writable, int prio)
     : archive(prio), path(path), writable(writable)
 {
@@ -76,7 +141,7 @@ bool app::file_archive::find(std::string name) const
 
     struct stat info;
 
-    if (stat(curr.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG)
+    if (::stat(curr.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG)
         return true;
     else
         return false;
@@ -89,6 +154,31 @@ app::buffer_p app::file_archive::load(std::string name) const
     return new file_buffer(pathname(path, name));
 }
 
+// Return a mapping of the named data file.
+
+app::buffer_p app::file_archive::map(std::string name) const
+{
+    return new file_map_buffer(pathname(path, name));
+}
+
+// Determine the size and modification time of the named file.
+
+bool app::file_archive::stat(std::string name, size_t *len,
+                                               long long *stamp) const
+{
+    std::string curr = pathname(path, name);
+
+    struct stat info;
+
+    if (::stat(curr.c_str(), &info) == 0)
+    {
+        if (len)   *len   = size_t(info.st_size);
+        if (stamp) *stamp = (long long) info.st_mtime;
+        return true;
+    }
+    return false;
+}
+
 // Save the given buffer.
 
 bool app::file_archive::save(std::string name,
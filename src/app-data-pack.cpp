@@ -245,6 +245,28 @@ app::buffer_p app::pack_archive::load(std::string name) const
     return 0;
 }
 
+// Determine the size and modification stamp of the named file. The stamp is
+// the DOS date and time of the entry, which is sufficient for comparison.
+
+bool app::pack_archive::stat(std::string name, size_t *len,
+                                               long long *stamp) const
+{
+    int n = get_file_count();
+
+    for (const void *p = get_file_first(); p && n; p = get_file_next(p), n--)
+        if (get_file_name(p) == fixpath(name))
+        {
+            const file_header *f = (const file_header *) p;
+
+            if (len)   *len   = size_t(f->sizeof_uncompressed);
+            if (stamp) *stamp = (long long) f->modified_date << 16
+                              | (long long) f->modified_time;
+            return true;
+        }
+
+    return false;
+}
+
 // Save the given buffer to the ZIP archive. This will always fail.
 
 bool app::pack_archive::save(std::string name,
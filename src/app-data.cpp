@@ -191,6 +191,55 @@ const void *app::data::load(const std::string& name, size_t *len)
     }
 }
 
+// Return a buffer mapping the named data file. Archives that cannot map files
+// fall back to loading them. Mapped buffers are NOT null-terminated.
+
+const void *app::data::map(const std::string& name, size_t *len)
+{
+    // If the named buffer has not yet been loaded, map it.
+
+    if (buffers.find(name) == buffers.end())
+    {
+        // Search the list of archives for the first one with the named buffer.
+
+        for (archive_c i = archives.begin(); i != archives.end(); ++i)
+        {
+            const std::string rename = translate(name);
+
+            if ((*i)->find(rename))
+            {
+                buffers[name] = (*i)->map(rename);
+                break;
+            }
+        }
+    }
+
+    // Return the named buffer.
+
+    if (buffers.find(name) != buffers.end())
+        return buffers[name]->get(len);
+    else
+    {
+        throw find_error(name);
+        return 0;
+    }
+}
+
+// Determine the size and modification stamp of the named data file, as seen
+// by the first archive containing it.
+
+bool app::data::stat(const std::string& name, size_t *len, long long *stamp)
+{
+    for (archive_c i = archives.begin(); i != archives.end(); ++i)
+    {
+        const std::string rename = translate(name);
+
+        if ((*i)->find(rename))
+            return (*i)->stat(rename, len, stamp);
+    }
+    return false;
+}
+
 // Scan the archives for the first one containing the named buffer.
 
 bool app::data::find(const std::string& name)
@@ -110,12 +110,14 @@ void app::frustum::cache_basis()
     basis = mat3(x, y, z);
 }
 
-// Calculate and store the bounding planes of the transformed projection.
+// Calculate and store the transformed projection and its bounding planes.
 
 void app::frustum::cache_planes(const mat4& A)
 {
     const mat4 B = transpose(A);
 
+    clip = A;
+
     plane[0] = normal(B * vec4( 0,  0,  1,  1)); // N
     plane[1] = normal(B * vec4( 1,  0,  0,  1)); // L
     plane[2] = normal(B * vec4(-1,  0,  0,  1)); // R
@@ -276,10 +278,34 @@ ogl::aabb app::frustum::get_split_bound(int i, int m) const
 
 //-----------------------------------------------------------------------------
 
+// Expand the range [a, z] to a length rounded up to one of eight steps per
+// octave, divided into k cells, with its ends on cell boundaries. Small changes
+// to the range then usually leave the result unchanged.
+
+static void snap(double& a, double& z, int k)
+{
+    if (k > 0 && z > a)
+    {
+        const double q = pow(2.0, floor(log(z - a) / log(2.0)) - 3.0);
+
+        double s = ceil((z - a) / q) * q;
+
+        while (s < z - a + s / k)
+            s += q;
+
+        a = floor(a / (s / k)) * (s / k);
+        z = a + s;
+    }
+}
+
 // Construct an orthogonal frustum covering bound b as seen from direction v.
 // This is for use in generating shadow maps for directional light sources.
+// Given k, the light-space extent is snapped to a grid of k cells per side. If
+// k divides the shadow map resolution then the grid is texel-aligned. Depth is
+// left to set_bound.
 
-app::orthogonal_frustum::orthogonal_frustum(const ogl::aabb& b, const vec3 &v)
+app::orthogonal_frustum::orthogonal_frustum(const ogl::aabb& b,
+                                            const vec3 &v, int k)
 {
     vec3 x(1, 0, 0);
     vec3 y(0, 1, 0);
@@ -307,6 +333,9 @@ app::orthogonal_frustum::orthogonal_frustum(const ogl::aabb& b, const vec3 &v)
     vec3 p = c.min();
     vec3 q = c.max();
 
+    snap(p[0], q[0], k);
+    snap(p[1], q[1], k);
+
     // This gives the frustum parameters.
 
     f = -p[2];
@@ -320,11 +349,13 @@ app::orthogonal_frustum::orthogonal_frustum(const ogl::aabb& b, const vec3 &v)
     cache_planes(get_transform());
 }
 
-// Compute near and far clipping distances to enclose the given bound.
+// Compute near and far clipping distances to enclose the given bound. The
+// distances are measured along the light direction taken from the basis, not
+// from the near plane, so that they do not vary with the prior depth range.
 
 void app::orthogonal_frustum::set_bound(const mat4& V, const ogl::aabb& bound)
 {
-    const vec4 p = vec4(plane[0][0], plane[0][1], plane[0][2], 0);
+    const vec4 p = vec4(-basis[0][2], -basis[1][2], -basis[2][2], 0);
 
     if (bound.isvalid())
     {
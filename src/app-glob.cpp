@@ -25,6 +25,7 @@
 #include <ogl-uniform.hpp>
 #include <ogl-program.hpp>
 #include <ogl-texture.hpp>
+#include <ogl-array.hpp>
 #include <ogl-binding.hpp>
 #include <ogl-surface.hpp>
 #include <ogl-surface.hpp>
@@ -32,6 +33,7 @@
 
 #include <ogl-image.hpp>
 #include <ogl-frame.hpp>
+#include <ogl-block.hpp>
 #include <ogl-pool.hpp>
 
 #include <app-glob.hpp>
@@ -55,6 +57,7 @@ void app::glob::dump()
     std::map<std::string, process>::iterator qi;
     std::map<std::string, program>::iterator pi;
     std::map<std::string, texture>::iterator ti;
+    std::map<std::string, array  >::iterator ai;
     std::map<std::string, binding>::iterator bi;
     std::map<std::string, surface>::iterator si;
     std::map<std::string, convex >::iterator ci;
@@ -87,6 +90,13 @@ void app::glob::dump()
             fprintf(stderr, "    %s\n", ti->second.ptr->get_name().c_str());
     }
 
+    if (int ac = int(array_map.size()))
+    {
+        fprintf(stderr, "%3d arrays\n", ac);
+        for (ai = array_map.begin(); ai != array_map.end(); ++ai)
+            fprintf(stderr, "    %s\n", ai->second.ptr->get_name().c_str());
+    }
+
     if (int bc = int(binding_map.size()))
     {
         fprintf(stderr, "%3d bindings\n", bc);
@@ -111,6 +121,7 @@ void app::glob::dump()
     if (int qc = int( pool_set.size())) fprintf(stderr, "%3d pools\n",  qc);
     if (int ic = int(image_set.size())) fprintf(stderr, "%3d images\n", ic);
     if (int fc = int(frame_set.size())) fprintf(stderr, "%3d frames\n", fc);
+    if (int bc = int(block_set.size())) fprintf(stderr, "%3d blocks\n", bc);
 }
 
 app::glob::~glob()
@@ -125,8 +136,10 @@ app::glob::~glob()
     assert( pool_set.empty());
     assert(image_set.empty());
     assert(frame_set.empty());
+    assert(block_set.empty());
     assert(surface_map.empty());
     assert(binding_map.empty());
+    assert(array_map.empty());
     assert(texture_map.empty());
     assert(program_map.empty());
     assert(process_map.empty());
@@ -386,6 +399,42 @@ void app::glob::free_texture(const ogl::texture *p)
 
 //-----------------------------------------------------------------------------
 
+ogl::array *app::glob::load_array(const std::string& name)
+{
+    if (array_map.find(name) == array_map.end())
+    {
+        if (ogl::array *p = new ogl::array(name))
+        {
+            array_map[name].ptr = p;
+            array_map[name].ref = 1;
+        }
+    }
+    else   array_map[name].ref++;
+
+    return array_map[name].ptr;
+}
+
+void app::glob::free_array(const std::string& name)
+{
+    std::map<std::string, array>::iterator i;
+
+    if ((i = array_map.find(name)) != array_map.end())
+    {
+        if (--i->second.ref == 0)
+        {
+            delete i->second.ptr;
+            array_map.erase(i);
+        }
+    }
+}
+
+void app::glob::free_array(const ogl::array *p)
+{
+    if (p) free_array(p->get_name());
+}
+
+//-----------------------------------------------------------------------------
+
 const ogl::binding *app::glob::load_binding(const std::string& name,
                                             const std::string& fallback)
 {
@@ -633,12 +682,46 @@ void app::glob::free_frame(ogl::frame *p)
 
 //-----------------------------------------------------------------------------
 
+ogl::block *app::glob::new_block(const std::string& name, GLuint index)
+{
+    ogl::block *p = new ogl::block(name, index);
+
+    block_set.insert(p);
+
+    return p;
+}
+
+void app::glob::free_block(ogl::block *p)
+{
+    std::set<ogl::block *>::iterator i;
+
+    if ((i = block_set.find(p)) != block_set.end())
+    {
+        block_set.erase(i);
+        delete p;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
 void app::glob::prep()
 {
-    // Render pre-pass all OpenGL state.
+    // Render pre-pass all OpenGL state, first uploading any textures that
+    // have finished loading in the background.
 
+    std::set<ogl::block *>::iterator         bi;
+    std::map<std::string, array>::iterator   ai;
     std::map<std::string, program>::iterator pi;
 
+    ogl::texture::sync();
+
+    for (ai = array_map.begin(); ai != array_map.end(); ++ai)
+        if (ai->second.ptr)
+            ai->second.ptr->prep();
+
+    for (bi = block_set.begin(); bi != block_set.end(); ++bi)
+        (*bi)->prep();
+
     for (pi = program_map.begin(); pi != program_map.end(); ++pi)
         if (pi->second.ptr)
             pi->second.ptr->prep();
@@ -651,6 +734,7 @@ void app::glob::init()
     std::set<ogl::frame *>::iterator fi;
     std::set<ogl::image *>::iterator ii;
     std::set<ogl::pool  *>::iterator qi;
+    std::set<ogl::block *>::iterator bi;
 
     for (fi = frame_set.begin(); fi != frame_set.end(); ++fi)
         (*fi)->init();
@@ -661,6 +745,9 @@ void app::glob::init()
     for (qi =  pool_set.begin(); qi !=  pool_set.end(); ++qi)
         (*qi)->init();
 
+    for (bi = block_set.begin(); bi != block_set.end(); ++bi)
+        (*bi)->init();
+
     std::map<std::string, program>::iterator pi;
     std::map<std::string, texture>::iterator ti;
     std::map<std::string, process>::iterator Pi;
@@ -673,6 +760,12 @@ void app::glob::init()
         if (ti->second.ptr)
             ti->second.ptr->init();
 
+    std::map<std::string, array>::iterator ai;
+
+    for (ai = array_map.begin(); ai != array_map.end(); ++ai)
+        if (ai->second.ptr)
+            ai->second.ptr->init();
+
     for (Pi = process_map.begin(); Pi != process_map.end(); ++Pi)
         if (Pi->second.ptr)
             Pi->second.ptr->init();
@@ -687,6 +780,7 @@ void app::glob::fini()
     // Release all OpenGL state.
 
     std::map<std::string, process>::iterator Pi;
+    std::map<std::string, array>::iterator   ai;
     std::map<std::string, texture>::iterator ti;
     std::map<std::string, program>::iterator pi;
 
@@ -694,6 +788,10 @@ void app::glob::fini()
         if (Pi->second.ptr)
             Pi->second.ptr->fini();
 
+    for (ai = array_map.begin(); ai != array_map.end(); ++ai)
+        if (ai->second.ptr)
+            ai->second.ptr->fini();
+
     for (ti = texture_map.begin(); ti != texture_map.end(); ++ti)
         if (ti->second.ptr)
             ti->second.ptr->fini();
@@ -702,10 +800,14 @@ void app::glob::fini()
         if (pi->second.ptr)
             pi->second.ptr->fini();
 
+    std::set<ogl::block *>::iterator bi;
     std::set<ogl::pool  *>::iterator qi;
     std::set<ogl::image *>::iterator ii;
     std::set<ogl::frame *>::iterator fi;
 
+    for (bi = block_set.begin(); bi != block_set.end(); ++bi)
+        (*bi)->fini();
+
     for (qi =  pool_set.begin(); qi !=  pool_set.end(); ++qi)
         (*qi)->fini();
 
@@ -17,6 +17,10 @@
 #include <SDL.h>
 
 #include <ogl-opengl.hpp>
+#include <ogl-stream.hpp>
+#include <ogl-pool.hpp>
+#include <ogl-texture.hpp>
+#include <app-conf.hpp>
 #include <app-perf.hpp>
 
 // TODO: Convert this away from iostream.
@@ -153,6 +157,11 @@ app::perf::perf(SDL_Window *w, int n) : window(w)
     local_start  = c;
     local_frames = 0;
     local_limit  = n;
+    local_bytes  = ogl::stream::get_bytes();
+    local_skips  = ogl::skip_program + ogl::skip_texture + ogl::skip_buffer;
+    local_culled = ogl::pool::get_culled();
+
+    startup = ::conf->get_i("startup_timing", 0) ? 2 : 0;
 }
 
 app::perf::~perf()
@@ -166,6 +175,8 @@ void app::perf::step(bool log)
     local_frames++;
     total_frames++;
 
+    if (startup) dump_startup(SDL_GetPerformanceCounter());
+
     // Report as often as configured.
 
     if (local_frames == local_limit)
@@ -190,7 +201,30 @@ void app::perf::dump(bool log)
     double mn = 1000.0 * dn / total_frames;
     int   fps = int(ceil(local_frames / d1));
 
-    local_start = current;
+    // Calculate the buffer upload rate.
+
+    unsigned long long bytes = ogl::stream::get_bytes();
+
+    double kb = (bytes - local_bytes) / 1024.0 / local_frames;
+
+    // Calculate the rate of redundant binds skipped.
+
+    unsigned long long skips = ogl::skip_program
+                             + ogl::skip_texture
+                             + ogl::skip_buffer;
+
+    int sk = int((skips - local_skips) / local_frames);
+
+    // Calculate the rate of nodes culled by occlusion.
+
+    unsigned long long culled = ogl::pool::get_culled();
+
+    int cu = int((culled - local_culled) / local_frames);
+
+    local_start  = current;
+    local_bytes  = bytes;
+    local_skips  = skips;
+    local_culled = culled;
 
     // Report to a string. Set the window title and log.
 
@@ -198,11 +232,37 @@ void app::perf::dump(bool log)
 
     str << std::fixed << std::setprecision(1) << m1  << "ms "
                                        << "(" << mn  << "ms) "
-                                              << fps << "fps";
+                                              << fps << "fps "
+                                              << kb  << "KB/frame "
+                                              << sk  << "skips/frame "
+                                              << cu  << "culled/frame";
 
     SDL_SetWindowTitle(window, str.str().c_str());
 
     if (log) std::cout << str.str() << std::endl;
 }
 
+// Report the time from startup to the first frame, and to the first frame with
+// all textures resident.
+
+void app::perf::dump_startup(Uint64 current)
+{
+    double ms = 1000.0 * double(current - total_start)
+                       / double(SDL_GetPerformanceFrequency());
+
+    if (startup == 2)
+    {
+        std::cout << "first frame "   << std::fixed << std::setprecision(1)
+                  << ms << "ms (" << ogl::texture::pending()
+                  << " textures pending)" << std::endl;
+        startup = 1;
+    }
+    if (startup == 1 && ogl::texture::pending() == 0)
+    {
+        std::cout << "all resident "  << std::fixed << std::setprecision(1)
+                  << ms << "ms (" << total_frames << " frames)" << std::endl;
+        startup = 0;
+    }
+}
+
 #endif // not NVPM ============================================================
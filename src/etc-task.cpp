@@ -0,0 +1,203 @@
+//  Copyright (C) 2011-2014 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <cstddef>
+#include <vector>
+
+#include <SDL.h>
+
+#include <etc-task.hpp>
+
+//------------------------------------------------------------------------------
+
+// The worker threads sleep on a condition until a new generation of work is
+// published. Tasks are then claimed by atomic increment of a shared counter.
+
+namespace
+{
+    struct task_pool
+    {
+        std::vector<SDL_Thread *> thread;
+
+        SDL_mutex   *mutex;
+        SDL_cond    *wake;
+        SDL_cond    *done;
+
+        etc::task_func func;
+        void          *data;
+        int            size;
+        SDL_atomic_t   next;
+
+        unsigned int generation;
+        int          active;
+        bool         running;
+        bool         quit;
+
+        task_pool();
+       ~task_pool();
+
+        void init();
+        void work();
+    };
+
+    task_pool pool;
+
+    int worker(void *data)
+    {
+        unsigned int seen = 0;
+
+        task_pool *p = (task_pool *) data;
+
+        while (true)
+        {
+            // Wait for a new generation of work or a request to quit.
+
+            SDL_LockMutex(p->mutex);
+            {
+                while (!p->quit && p->generation == seen)
+                    SDL_CondWait(p->wake, p->mutex);
+
+                seen = p->generation;
+            }
+            SDL_UnlockMutex(p->mutex);
+
+            if (p->quit) break;
+
+            // Run tasks until none remain, then check in.
+
+            p->work();
+
+            SDL_LockMutex(p->mutex);
+            {
+                if (--p->active == 0)
+                    SDL_CondSignal(p->done);
+            }
+            SDL_UnlockMutex(p->mutex);
+        }
+        return 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+task_pool::task_pool() :
+    mutex(0), wake(0), done(0), func(0), data(0), size(0),
+    generation(0), active(0), running(false), quit(false)
+{
+}
+
+task_pool::~task_pool()
+{
+    if (mutex)
+    {
+        SDL_LockMutex(mutex);
+        {
+            quit = true;
+            SDL_CondBroadcast(wake);
+        }
+        SDL_UnlockMutex(mutex);
+
+        for (size_t i = 0; i < thread.size(); ++i)
+            SDL_WaitThread(thread[i], 0);
+
+        SDL_DestroyCond (done);
+        SDL_DestroyCond (wake);
+        SDL_DestroyMutex(mutex);
+    }
+}
+
+// Start one worker per additional CPU on first use.
+
+void task_pool::init()
+{
+    if (mutex == 0)
+    {
+        mutex = SDL_CreateMutex();
+        wake  = SDL_CreateCond();
+        done  = SDL_CreateCond();
+
+        for (int i = 1; i < SDL_GetCPUCount(); ++i)
+            if (SDL_Thread *t = SDL_CreateThread(worker, "etc::parallel", this))
+                thread.push_back(t);
+    }
+}
+
+void task_pool::work()
+{
+    int i;
+
+    while ((i = SDL_AtomicAdd(&next, 1)) < size)
+        func(data, i);
+}
+
+//------------------------------------------------------------------------------
+
+void etc::parallel(int n, task_func func, void *data)
+{
+    bool serial = true;
+
+    pool.init();
+
+    // Claim the pool, unless it is already busy or there is no parallelism.
+
+    if (n > 1 && !pool.thread.empty())
+    {
+        SDL_LockMutex(pool.mutex);
+        {
+            if (!pool.running)
+            {
+                pool.running = true;
+                pool.func    = func;
+                pool.data    = data;
+                pool.size    = n;
+                pool.active  = int(pool.thread.size());
+
+                SDL_AtomicSet(&pool.next, 0);
+
+                pool.generation++;
+                SDL_CondBroadcast(pool.wake);
+
+                serial = false;
+            }
+        }
+        SDL_UnlockMutex(pool.mutex);
+    }
+
+    if (serial)
+    {
+        for (int i = 0; i < n; ++i)
+            func(data, i);
+    }
+    else
+    {
+        // Participate in the work and wait for the workers to finish.
+
+        pool.work();
+
+        SDL_LockMutex(pool.mutex);
+        {
+            while (pool.active > 0)
+                SDL_CondWait(pool.done, pool.mutex);
+
+            pool.running = false;
+        }
+        SDL_UnlockMutex(pool.mutex);
+    }
+}
+
+int etc::threads()
+{
+    pool.init();
+    return int(pool.thread.size()) + 1;
+}
+
+//------------------------------------------------------------------------------
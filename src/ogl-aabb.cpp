@@ -211,6 +211,43 @@ void ogl::aabb::draw() const
     glEnd();
 }
 
+void ogl::aabb::fill() const
+{
+    glBegin(GL_QUADS);
+    {
+        glVertex3d(a[0], a[1], a[2]);
+        glVertex3d(a[0], a[1], z[2]);
+        glVertex3d(a[0], z[1], z[2]);
+        glVertex3d(a[0], z[1], a[2]);
+
+        glVertex3d(z[0], a[1], a[2]);
+        glVertex3d(z[0], z[1], a[2]);
+        glVertex3d(z[0], z[1], z[2]);
+        glVertex3d(z[0], a[1], z[2]);
+
+        glVertex3d(a[0], a[1], a[2]);
+        glVertex3d(z[0], a[1], a[2]);
+        glVertex3d(z[0], a[1], z[2]);
+        glVertex3d(a[0], a[1], z[2]);
+
+        glVertex3d(a[0], z[1], a[2]);
+        glVertex3d(a[0], z[1], z[2]);
+        glVertex3d(z[0], z[1], z[2]);
+        glVertex3d(z[0], z[1], a[2]);
+
+        glVertex3d(a[0], a[1], a[2]);
+        glVertex3d(a[0], z[1], a[2]);
+        glVertex3d(z[0], z[1], a[2]);
+        glVertex3d(z[0], a[1], a[2]);
+
+        glVertex3d(a[0], a[1], z[2]);
+        glVertex3d(z[0], a[1], z[2]);
+        glVertex3d(z[0], z[1], z[2]);
+        glVertex3d(a[0], z[1], z[2]);
+    }
+    glEnd();
+}
+
 //-----------------------------------------------------------------------------
 
 double ogl::aabb::max(const vec4& P) const
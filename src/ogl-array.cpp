@@ -0,0 +1,336 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+
+#include <ogl-texture.hpp>
+#include <ogl-array.hpp>
+#include <ogl-s3tc.hpp>
+#include <app-glob.hpp>
+
+//-----------------------------------------------------------------------------
+
+ogl::array::array(std::string name) : name(name), cap(0)
+{
+}
+
+ogl::array::~array()
+{
+    fini();
+
+    // Release the textures of all layers.
+
+    for (size_t i = 0; i < layers.size(); ++i)
+        for (unit_texture::iterator t = layers[i].begin();
+                                    t != layers[i].end(); ++t)
+            ::glob->free_texture(t->second);
+}
+
+//-----------------------------------------------------------------------------
+
+// Determine whether the given texture set matches the units, sizes, and
+// formats of this array.
+
+bool ogl::array::match(const unit_texture& set) const
+{
+    if (set.size() != planes.size())
+        return false;
+
+    std::vector<plane>::const_iterator p = planes.begin();
+
+    for (unit_texture::const_iterator t = set.begin(); t != set.end(); ++t, ++p)
+        if (t->first                != p->unit ||
+            t->second->get_w()      != p->w    ||
+            t->second->get_h()      != p->h    ||
+            t->second->get_format() != p->format)
+            return false;
+
+    return true;
+}
+
+// Add a texture set to this array and return its layer, or -1 if the set does
+// not match, sets its own texture parameters, or the array is full. A set
+// already present shares its layer.
+
+int ogl::array::add(const unit_texture& set)
+{
+    if (set.empty())
+        return -1;
+
+    for (unit_texture::const_iterator t = set.begin(); t != set.end(); ++t)
+        if (t->second->has_params())
+            return -1;
+
+    // The first set determines the planes.
+
+    if (layers.empty())
+    {
+        planes.clear();
+
+        for (unit_texture::const_iterator t = set.begin(); t != set.end(); ++t)
+        {
+            if (t->second->get_w() <= 0 || t->second->get_h() <= 0)
+                return -1;
+
+            plane p;
+
+            p.unit   = t->first;
+            p.object = 0;
+            p.w      = t->second->get_w();
+            p.h      = t->second->get_h();
+            p.format = t->second->get_format();
+            p.levels = t->second->get_levels();
+
+            planes.push_back(p);
+        }
+    }
+    else if (!match(set))
+        return -1;
+
+    // Share the layer of an identical set.
+
+    std::vector<unit_texture>::iterator i;
+
+    if ((i = std::find(layers.begin(), layers.end(), set)) != layers.end())
+        return int(i - layers.begin());
+
+    // Otherwise append a layer, if the limit allows.
+
+    GLint max = 0;
+
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max);
+
+    if (GLint(layers.size()) >= max)
+        return -1;
+
+    for (unit_texture::const_iterator t = set.begin(); t != set.end(); ++t)
+        ::glob->dupe_texture(t->second);
+
+    layers.push_back(set);
+    copied.push_back(false);
+
+    return int(layers.size()) - 1;
+}
+
+void ogl::array::bind() const
+{
+    for (std::vector<plane>::const_iterator p = planes.begin();
+                                            p != planes.end(); ++p)
+        ogl::bind_texture(GL_TEXTURE_2D_ARRAY, p->unit, p->object);
+}
+
+//-----------------------------------------------------------------------------
+
+static bool is_compressed(GLenum f)
+{
+    return (f == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+            f == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+}
+
+// Reallocate all planes with room for N layers, preserving the current layers.
+
+void ogl::array::grow(GLsizei n)
+{
+    for (std::vector<plane>::iterator p = planes.begin(); p != planes.end(); ++p)
+    {
+        GLuint o;
+
+        glGenTextures(1, &o);
+
+        ogl::bind_texture(GL_TEXTURE_2D_ARRAY, GL_TEXTURE0, o);
+
+        // Allocate each level with no data and copy any existing layers.
+
+        GLsizei ww = p->w;
+        GLsizei hh = p->h;
+
+        for (GLint l = 0; l < p->levels; ++l, ww /= 2, hh /= 2)
+        {
+            if (is_compressed(p->format))
+            {
+                GLsizei c = (p->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 3 : 4;
+
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, p->format,
+                                       ww, hh, n, 0,
+                                       ogl::s3tc_size(ww, hh, c) * n, 0);
+            }
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, l, p->format, ww, hh, n, 0,
+                             p->format, GL_UNSIGNED_BYTE, 0);
+
+            if (p->object && cap)
+                glCopyImageSubData(p->object, GL_TEXTURE_2D_ARRAY, l, 0, 0, 0,
+                                   o,         GL_TEXTURE_2D_ARRAY, l, 0, 0, 0,
+                                   ww, hh, cap);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, p->levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                                             GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        if (ogl::has_anisotropic)
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+                                                 ogl::max_anisotropy);
+
+        // Replace the old plane.
+
+        if (p->object)
+        {
+            ogl::drop_texture(p->object);
+            glDeleteTextures(1, &p->object);
+        }
+        p->object = o;
+    }
+    cap = n;
+}
+
+// Copy all levels of the textures of layer I into the planes. A texture that
+// failed to load has only its 1x1 placeholder, which is filled in instead.
+
+void ogl::array::copy(size_t i)
+{
+    for (std::vector<plane>::iterator p = planes.begin(); p != planes.end(); ++p)
+    {
+        const ogl::texture *t = layers[i][p->unit];
+
+        GLsizei ww = p->w;
+        GLsizei hh = p->h;
+
+        if (t->is_failed())
+            fill(*p, i);
+        else
+            for (GLint l = 0; l < p->levels; ++l, ww /= 2, hh /= 2)
+                glCopyImageSubData(t->get_o(), GL_TEXTURE_2D,       l, 0, 0, 0,
+                                   p->object,  GL_TEXTURE_2D_ARRAY, l, 0, 0,
+                                   GLint(i), ww, hh, 1);
+    }
+    copied[i] = true;
+}
+
+// Fill all levels of layer I of plane P with the texture placeholder, encoded
+// in the format of the plane.
+
+void ogl::array::fill(const plane& p, size_t i)
+{
+    GLsizei c;
+
+    switch (p.format)
+    {
+        case GL_LUMINANCE:                     c = 1; break;
+        case GL_LUMINANCE_ALPHA:               c = 2; break;
+        case GL_RGB:                           c = 3; break;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  c = 3; break;
+        default:                               c = 4; break;
+    }
+
+    // Luminance takes the first placeholder channel and alpha the last.
+
+    GLubyte v[4];
+
+    for (GLsizei k = 0; k < c; ++k)
+        v[k] = ogl::texture::placeholder[(k == c - 1 && (c & 1) == 0) ? 3 : k];
+
+    std::vector<GLubyte> src;
+    std::vector<GLubyte> dst;
+
+    ogl::bind_texture(GL_TEXTURE_2D_ARRAY, GL_TEXTURE0, p.object);
+
+    GLsizei ww = p.w;
+    GLsizei hh = p.h;
+
+    for (GLint l = 0; l < p.levels; ++l, ww /= 2, hh /= 2)
+    {
+        src.resize(size_t(ww) * size_t(hh) * size_t(c));
+
+        for (size_t j = 0; j < src.size(); ++j)
+            src[j] = v[j % c];
+
+        if (is_compressed(p.format))
+        {
+            dst.resize(ogl::s3tc_size(ww, hh, c));
+
+            ogl::s3tc_encode(ww, hh, c, &src.front(), &dst.front());
+
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, GLint(i),
+                                      ww, hh, 1, p.format,
+                                      GLsizei(dst.size()), &dst.front());
+        }
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, GLint(i),
+                            ww, hh, 1, p.format, GL_UNSIGNED_BYTE,
+                            &src.front());
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Grow the storage to cover all layers, and copy each layer whose textures
+// have all become resident or failed to load.
+
+void ogl::array::prep()
+{
+    if (ogl::context && !layers.empty())
+    {
+        if (cap < GLsizei(layers.size()))
+        {
+            GLsizei n = std::max(cap, GLsizei(1));
+
+            while (n < GLsizei(layers.size()))
+                n *= 2;
+
+            grow(n);
+        }
+
+        for (size_t i = 0; i < layers.size(); ++i)
+            if (!copied[i])
+            {
+                bool ready = true;
+
+                for (unit_texture::iterator t = layers[i].begin();
+                                            t != layers[i].end(); ++t)
+                    ready = ready && t->second->is_ready();
+
+                if (ready) copy(i);
+            }
+    }
+}
+
+void ogl::array::init()
+{
+    std::fill(copied.begin(), copied.end(), false);
+    cap = 0;
+}
+
+void ogl::array::fini()
+{
+    if (ogl::context)
+    {
+        for (std::vector<plane>::iterator p = planes.begin();
+                                          p != planes.end(); ++p)
+            if (p->object)
+            {
+                ogl::drop_texture(p->object);
+                glDeleteTextures(1, &p->object);
+            }
+    }
+
+    for (std::vector<plane>::iterator p = planes.begin(); p != planes.end(); ++p)
+        p->object = 0;
+
+    std::fill(copied.begin(), copied.end(), false);
+    cap = 0;
+}
+
+//-----------------------------------------------------------------------------
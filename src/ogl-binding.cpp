@@ -11,6 +11,7 @@
 //  General Public License for more details.
 
 #include <SDL.h>
+#include <sstream>
 #include <cmath>
 
 #include <app-default.hpp>
@@ -19,6 +20,7 @@
 #include <app-file.hpp>
 #include <ogl-pool.hpp>
 #include <ogl-texture.hpp>
+#include <ogl-array.hpp>
 #include <ogl-program.hpp>
 #include <ogl-binding.hpp>
 
@@ -62,7 +64,10 @@ const ogl::program *ogl::binding::init_program(app::node p,
 ogl::binding::binding(std::string name) :
     name(name),
     depth_program(0),
-    color_program(0)
+    color_program(0),
+    color_array(0),
+    color_layer(0),
+    key(0)
 {
     std::string path = "material/" + name + ".xml";
 
@@ -82,10 +87,18 @@ ogl::binding::binding(std::string name) :
         if (app::node n = p.find("program", "mode", "color"))
             color_program = init_program(n, color_texture);
     }
+    init_array();
+    init_key();
 }
 
 ogl::binding::~binding()
 {
+    // Free the texture array.
+
+    if (color_array) ::glob->free_array(color_array);
+
+    color_array = 0;
+
     // Free all textures.
 
     unit_texture::iterator i;
@@ -110,6 +123,89 @@ ogl::binding::~binding()
 
 //-----------------------------------------------------------------------------
 
+// If the color program samples texture arrays, then pack the color textures
+// into a layer of an array shared with other bindings of the same program
+// whose textures match in size and format. The array is named by these. If an
+// array is full, then try the next of the same name.
+
+void ogl::binding::init_array()
+{
+    if (color_program && color_program->arrays() && !color_texture.empty())
+    {
+        std::ostringstream str;
+
+        str << color_program->get_name();
+
+        for (unit_texture::const_iterator i = color_texture.begin();
+                                          i != color_texture.end(); ++i)
+            str << " " << (i->first - GL_TEXTURE0)
+                << ":" << i->second->get_w()
+                << "x" << i->second->get_h()
+                << ":" << std::hex << i->second->get_format() << std::dec;
+
+        for (int n = 0; color_array == 0; ++n)
+        {
+            std::ostringstream tag;
+
+            tag << str.str() << " #" << n;
+
+            ogl::array *a = ::glob->load_array(tag.str());
+
+            if ((color_layer = a->add(color_texture)) >= 0)
+                color_array = a;
+            else
+            {
+                // An array rejecting the set while empty never will accept.
+
+                bool empty = a->empty();
+
+                ::glob->free_array(a);
+
+                color_layer = 0;
+
+                if (empty) break;
+            }
+        }
+    }
+}
+
+// FNV-1a hash of a string, continuing the given hash.
+
+static unsigned int hash(const std::string& s, unsigned int h=2166136261U)
+{
+    for (std::string::const_iterator i = s.begin(); i != s.end(); ++i)
+        h = (h ^ (unsigned char) (*i)) * 16777619U;
+
+    return h;
+}
+
+// Compute a key ordering this binding among others for batching. From most to
+// least significant: masked, the color program, the color texture set or the
+// texture array holding it, and the binding itself, with the low 16 bits left
+// clear for use by the batcher. The fields hash names rather than pointers, so
+// the order is the same from run to run, and equivalent bindings sort together.
+
+void ogl::binding::init_key()
+{
+    unsigned int p = color_program ? hash(color_program->get_name()) : 0;
+    unsigned int t = 2166136261U;
+    unsigned int b = hash(name);
+
+    if (color_array)
+        t = hash(color_array->get_name());
+    else
+        for (unit_texture::const_iterator i = color_texture.begin();
+                                          i != color_texture.end(); ++i)
+            t = hash(i->second->get_name(), t ^ i->first);
+
+    key = (opaque() ? 0ULL : 1ULL)                      << 63
+        | (unsigned long long) (p & 0x7FFF)             << 48
+        | (unsigned long long) (t & 0xFFFF)             << 32
+        | (unsigned long long) (b & 0xFFFF)             << 16;
+}
+
+//-----------------------------------------------------------------------------
+
 // Determine whether two bindings are equivalent in depth rendering mode.
 
 bool ogl::binding::depth_eq(const binding *that) const
@@ -145,8 +241,12 @@ bool ogl::binding::color_eq(const binding *that) const
         return true;
 
     // If any programs or textures differ then the bindings are not equivalent.
+    // Textures packed in the same array differ only by per-vertex layer.
 
     if (color_program != that->color_program) return false;
+
+    if (color_array && color_array == that->color_array) return true;
+
     if (color_texture != that->color_texture) return false;
 
     return true;
@@ -174,12 +274,11 @@ bool ogl::binding::opaque() const
 
 //-----------------------------------------------------------------------------
 
-// Apply all program and texture bindings for color or depth mode.
+// Apply all program and texture bindings for color or depth mode. Bindings
+// already current are skipped by the state tracker.
 
 bool ogl::binding::bind(bool c) const
 {
-    // TODO: Minimize rebindings
-
     unit_texture::const_iterator ti;
 
     if (c)
@@ -188,8 +287,16 @@ bool ogl::binding::bind(bool c) const
         {
             color_program->bind();
 
-            for (ti = color_texture.begin(); ti != color_texture.end(); ++ti)
-                ti->second->bind(ti->first);
+            // Geometry drawn without a per-vertex layer uses this one.
+
+            if (color_array)
+            {
+                color_array->bind();
+                glVertexAttrib1f(14, GLfloat(color_layer));
+            }
+            else
+                for (ti = color_texture.begin(); ti != color_texture.end(); ++ti)
+                    ti->second->bind(ti->first);
 
             return true;
         }
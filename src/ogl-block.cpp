@@ -0,0 +1,133 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+#include <cassert>
+
+#include <ogl-uniform.hpp>
+#include <ogl-block.hpp>
+
+//-----------------------------------------------------------------------------
+
+ogl::block::block(std::string name, GLuint index) :
+    name(name), index(index), buffer(0)
+{
+}
+
+ogl::block::~block()
+{
+    fini();
+}
+
+//-----------------------------------------------------------------------------
+
+// Add uniform P to the block at byte offset OFF, which must respect std140.
+
+void ogl::block::add(const uniform *p, GLintptr off)
+{
+    assert(off % sizeof (GLfloat) == 0);
+
+    if (p)
+    {
+        member m;
+
+        m.ptr = p;
+        m.off = off / sizeof (GLfloat);
+        m.ver = 0;
+
+        members.push_back(m);
+
+        // The padded std140 size of a 3x3 matrix is 12 floats. All others
+        // occupy their exact size.
+
+        size_t n = size_t(m.off) + (p->get_size() == 9 ? 12 : p->get_size());
+
+        // Growing the block discards the buffer. Prep will recreate it.
+
+        if (data.size() < n)
+        {
+            data.resize(n, 0.0f);
+            fini();
+        }
+    }
+}
+
+// Copy all changed member values and upload the span of the block covering
+// them. Create the buffer if needed.
+
+void ogl::block::prep()
+{
+    if (buffer == 0)
+        init();
+
+    if (buffer)
+    {
+        size_t lo = data.size();
+        size_t hi = 0;
+
+        for (std::vector<member>::iterator m = members.begin();
+                                           m != members.end(); ++m)
+
+            if (m->ver != m->ptr->get_version())
+            {
+                size_t n = (m->ptr->get_size() == 9 ? 12 : m->ptr->get_size());
+
+                m->ptr->pack(&data[m->off]);
+                m->ver = m->ptr->get_version();
+
+                lo = std::min(lo, size_t(m->off));
+                hi = std::max(hi, size_t(m->off) + n);
+            }
+
+        if (lo < hi)
+        {
+            glBindBuffer   (GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, lo * sizeof (GLfloat),
+                                        (hi - lo) * sizeof (GLfloat),
+                                                          &data[lo]);
+            glBindBuffer   (GL_UNIFORM_BUFFER, 0);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::block::init()
+{
+    if (ogl::context && ogl::do_uniform_block && !data.empty())
+    {
+        glGenBuffers    (1, &buffer);
+        glBindBuffer    (GL_UNIFORM_BUFFER, buffer);
+        glBufferData    (GL_UNIFORM_BUFFER, data.size() * sizeof (GLfloat),
+                                           &data.front(), GL_DYNAMIC_DRAW);
+        glBindBuffer    (GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+
+        // Force all members to upload at the next prep.
+
+        for (std::vector<member>::iterator m = members.begin();
+                                           m != members.end(); ++m)
+            m->ver = 0;
+    }
+}
+
+void ogl::block::fini()
+{
+    if (ogl::context && buffer)
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, index, 0);
+        glDeleteBuffers (1, &buffer);
+    }
+    buffer = 0;
+}
+
+//-----------------------------------------------------------------------------
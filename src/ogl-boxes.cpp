@@ -0,0 +1,418 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BOXES_SSE
+#endif
+
+#if defined(_M_X64)
+#include <immintrin.h>
+#define BOXES_AVX
+#define AVX_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BOXES_AVX
+#define AVX_TARGET __attribute__((target("avx")))
+#endif
+
+#include <SDL.h>
+
+#include <ogl-boxes.hpp>
+#include <app-conf.hpp>
+#include <etc-log.hpp>
+
+//-----------------------------------------------------------------------------
+
+// A plane with its distance offset by the rounding margin. A box is visible
+// if the corner most positive w.r.t. every plane lies on its positive side.
+
+namespace
+{
+    struct plane
+    {
+        float x;
+        float y;
+        float z;
+        float w;
+    };
+}
+
+static void test1(const float *const *A, int m,
+                  const plane *P, int n, unsigned *out)
+{
+    for (int i = 0; i < m; ++i)
+    {
+        unsigned v = 1;
+
+        for (int k = 0; k < n; ++k)
+        {
+            float d = P[k].w + std::max(P[k].x * A[0][i], P[k].x * A[3][i])
+                             + std::max(P[k].y * A[1][i], P[k].y * A[4][i])
+                             + std::max(P[k].z * A[2][i], P[k].z * A[5][i]);
+            v &= (d >= 0.0f);
+        }
+        out[i >> 5] |= v << (i & 31);
+    }
+}
+
+#ifdef BOXES_SSE
+static void test4(const float *const *A, int m,
+                  const plane *P, int n, unsigned *out)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    for (int i = 0; i < m; i += 4)
+    {
+        const __m128 ax = _mm_loadu_ps(A[0] + i);
+        const __m128 ay = _mm_loadu_ps(A[1] + i);
+        const __m128 az = _mm_loadu_ps(A[2] + i);
+        const __m128 zx = _mm_loadu_ps(A[3] + i);
+        const __m128 zy = _mm_loadu_ps(A[4] + i);
+        const __m128 zz = _mm_loadu_ps(A[5] + i);
+
+        __m128 v = ones;
+
+        for (int k = 0; k < n; ++k)
+        {
+            const __m128 x = _mm_set1_ps(P[k].x);
+            const __m128 y = _mm_set1_ps(P[k].y);
+            const __m128 z = _mm_set1_ps(P[k].z);
+            const __m128 w = _mm_set1_ps(P[k].w);
+
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(w, _mm_max_ps(_mm_mul_ps(x, ax),
+                                         _mm_mul_ps(x, zx))),
+                _mm_add_ps(   _mm_max_ps(_mm_mul_ps(y, ay),
+                                         _mm_mul_ps(y, zy)),
+                              _mm_max_ps(_mm_mul_ps(z, az),
+                                         _mm_mul_ps(z, zz))));
+
+            v = _mm_and_ps(v, _mm_cmpge_ps(d, zero));
+        }
+        out[i >> 5] |= unsigned(_mm_movemask_ps(v)) << (i & 31);
+    }
+}
+#endif
+
+#ifdef BOXES_AVX
+AVX_TARGET
+static void test8(const float *const *A, int m,
+                  const plane *P, int n, unsigned *out)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 ones = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+
+    for (int i = 0; i < m; i += 8)
+    {
+        const __m256 ax = _mm256_loadu_ps(A[0] + i);
+        const __m256 ay = _mm256_loadu_ps(A[1] + i);
+        const __m256 az = _mm256_loadu_ps(A[2] + i);
+        const __m256 zx = _mm256_loadu_ps(A[3] + i);
+        const __m256 zy = _mm256_loadu_ps(A[4] + i);
+        const __m256 zz = _mm256_loadu_ps(A[5] + i);
+
+        __m256 v = ones;
+
+        for (int k = 0; k < n; ++k)
+        {
+            const __m256 x = _mm256_broadcast_ss(&P[k].x);
+            const __m256 y = _mm256_broadcast_ss(&P[k].y);
+            const __m256 z = _mm256_broadcast_ss(&P[k].z);
+            const __m256 w = _mm256_broadcast_ss(&P[k].w);
+
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(w, _mm256_max_ps(_mm256_mul_ps(x, ax),
+                                               _mm256_mul_ps(x, zx))),
+                _mm256_add_ps(   _mm256_max_ps(_mm256_mul_ps(y, ay),
+                                               _mm256_mul_ps(y, zy)),
+                                 _mm256_max_ps(_mm256_mul_ps(z, az),
+                                               _mm256_mul_ps(z, zz))));
+
+            v = _mm256_and_ps(v, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+        }
+        out[i >> 5] |= unsigned(_mm256_movemask_ps(v)) << (i & 31);
+    }
+}
+#endif
+
+//-----------------------------------------------------------------------------
+
+ogl::boxes::boxes() : count(0), range(0)
+{
+}
+
+// Add a box with the given bound and data. Return its index, which remains
+// valid until the box is removed. Storage grows 8 boxes at a time.
+
+int ogl::boxes::insert(const aabb& b, void *p)
+{
+    int i;
+
+    if (spare.empty())
+    {
+        i = int(data.size());
+
+        if (i == int(ax.size()))
+        {
+            ax.resize(i + 8, 0.0f);
+            ay.resize(i + 8, 0.0f);
+            az.resize(i + 8, 0.0f);
+            zx.resize(i + 8, 0.0f);
+            zy.resize(i + 8, 0.0f);
+            zz.resize(i + 8, 0.0f);
+            live.resize((i + 8 + 31) / 32, 0);
+        }
+        data.push_back(0);
+    }
+    else
+    {
+        i = spare.back();
+        spare.pop_back();
+    }
+
+    data[i] = p;
+    live[i >> 5] |= 1U << (i & 31);
+    set(i, b);
+    count++;
+    return i;
+}
+
+void ogl::boxes::remove(int i)
+{
+    data[i] = 0;
+    live[i >> 5] &= ~(1U << (i & 31));
+    set(i, aabb(vec3(), vec3()));
+    spare.push_back(i);
+    count--;
+}
+
+void ogl::boxes::move(int i, const aabb& b)
+{
+    set(i, b);
+}
+
+void ogl::boxes::set(int i, const aabb& b)
+{
+    const vec3 a = b.min();
+    const vec3 z = b.max();
+
+    ax[i] = float(a[0]);
+    ay[i] = float(a[1]);
+    az[i] = float(a[2]);
+    zx[i] = float(z[0]);
+    zy[i] = float(z[1]);
+    zz[i] = float(z[2]);
+
+    // Track the largest coordinate magnitude, which bounds rounding error.
+
+    for (int k = 0; k < 3; ++k)
+        range = std::max(range, std::max(fabs(a[k]), fabs(z[k])));
+}
+
+//-----------------------------------------------------------------------------
+
+// Return the number of boxes tested at once: 8 with AVX, 4 with SSE, else 1,
+// limited by the configuration.
+
+int ogl::boxes::width()
+{
+    static int w = 0;
+
+    if (w == 0)
+    {
+        int want = ::conf ? ::conf->get_i("pool_cull_width", 8) : 8;
+
+        w = 1;
+#ifdef BOXES_SSE
+        if (want >= 4) w = 4;
+#endif
+#ifdef BOXES_AVX
+        if (want >= 8 && SDL_HasAVX()) w = 8;
+#endif
+    }
+    return w;
+}
+
+// Set bit i of the output if box i is not wholly outside the given planes.
+
+void ogl::boxes::test(const vec4 *V, int n, std::vector<unsigned>& out) const
+{
+    run(V, n, out, width());
+}
+
+void ogl::boxes::run(const vec4 *V, int n,
+                     std::vector<unsigned>& out, int w) const
+{
+    const int m = int(ax.size());
+
+    out.assign(live.size(), 0);
+
+    if (m)
+    {
+        // Round the planes to float, offsetting each by a margin well above
+        // the error of the float evaluation.
+
+        const float *const A[6] = {
+            &ax.front(), &ay.front(), &az.front(),
+            &zx.front(), &zy.front(), &zz.front()
+        };
+
+        std::vector<plane> P(n);
+
+        for (int k = 0; k < n; ++k)
+        {
+            const double e = (fabs(V[k][3]) + (fabs(V[k][0]) +
+                                               fabs(V[k][1]) +
+                                               fabs(V[k][2])) * range)
+                           / 1048576.0;
+
+            P[k].x = float(V[k][0]);
+            P[k].y = float(V[k][1]);
+            P[k].z = float(V[k][2]);
+            P[k].w = float(V[k][3] + e);
+        }
+
+        const plane *p = n ? &P.front() : 0;
+
+        switch (w)
+        {
+#ifdef BOXES_AVX
+        case 8:  test8(A, m, p, n, &out.front()); break;
+#endif
+#ifdef BOXES_SSE
+        case 4:  test4(A, m, p, n, &out.front()); break;
+#endif
+        default: test1(A, m, p, n, &out.front()); break;
+        }
+
+        for (size_t j = 0; j < out.size(); ++j)
+            out[j] &= live[j];
+    }
+}
+
+// Test up to 32 frusta of n planes each. Append to the output the data of all
+// boxes not wholly outside at least one, with a mask of the frusta they touch.
+
+void ogl::boxes::cull(const vec4 *const *V, int c, int n,
+                      std::vector<void *>&   out,
+                      std::vector<unsigned>& vis) const
+{
+    if (int(bits.size()) < c)
+        bits.resize(c);
+
+    for (int f = 0; f < c; ++f)
+        test(V[f], n, bits[f]);
+
+    for (size_t j = 0; j < live.size(); ++j)
+    {
+        unsigned any = 0;
+
+        for (int f = 0; f < c; ++f)
+            any |= bits[f][j];
+
+        for (unsigned b = any, i = 0; b; b >>= 1, ++i)
+            if (b & 1)
+            {
+                unsigned m = 0;
+
+                for (int f = 0; f < c; ++f)
+                    m |= ((bits[f][j] >> i) & 1) << f;
+
+                out.push_back(data[j * 32 + i]);
+                vis.push_back(m);
+            }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Time the scalar test of n random unit boxes against a frustum, and the test
+// of the same boxes at each width available. Count the boxes culled that the
+// scalar test finds visible, which must be none, and those kept that it culls.
+// Return false if any width misses a visible box.
+
+bool ogl::boxes::bench(int n)
+{
+    const double s = pow(double(n), 1.0 / 3.0) * 4.0;
+    const double f = double(SDL_GetPerformanceFrequency()) / 1000.0;
+    const double r = 1.0 / sqrt(2.0);
+
+    const vec4 V[5] = {
+        vec4(  1,  0,  0, 0),
+        vec4(  0,  1,  0, 0),
+        vec4(  0,  0,  1, 0),
+        vec4( -r, -r,  0, s * r / 2),
+        vec4(  0, -r, -r, s * r / 2),
+    };
+
+    std::vector<aabb>     src(n);
+    std::vector<bool>     ref(n);
+    std::vector<unsigned> out;
+
+    boxes set;
+
+    srand(1);
+
+    for (int i = 0; i < n; ++i)
+    {
+        vec3 p(s * rand() / RAND_MAX,
+               s * rand() / RAND_MAX,
+               s * rand() / RAND_MAX);
+
+        src[i] = aabb(p - vec3(0.5, 0.5, 0.5), p + vec3(0.5, 0.5, 0.5));
+        set.insert(src[i], 0);
+    }
+
+    Uint64 t0 = SDL_GetPerformanceCounter();
+
+    for (int i = 0; i < n; ++i)
+        ref[i] = src[i].test(V, 5);
+
+    Uint64 t1 = SDL_GetPerformanceCounter();
+
+    etc::log("boxes %7d: scalar %7.3fms", n, (t1 - t0) / f);
+
+    bool ok = true;
+
+    for (int w = 1; w <= width(); w *= 2)
+        if (w == 1 || w == 4 || w == 8)
+        {
+            int missed = 0;
+            int extra  = 0;
+
+            Uint64 t2 = SDL_GetPerformanceCounter();
+            set.run(V, 5, out, w);
+            Uint64 t3 = SDL_GetPerformanceCounter();
+
+            for (int i = 0; i < n; ++i)
+            {
+                bool b = (out[i >> 5] >> (i & 31)) & 1;
+
+                if (ref[i] && !b) missed++;
+                if (b && !ref[i]) extra++;
+            }
+
+            etc::log("boxes %7d: x%d %7.3fms missed %d extra %d%s", n, w,
+                     (t3 - t2) / f, missed, extra, missed ? " MISMATCH" : "");
+
+            if (missed) ok = false;
+        }
+    return ok;
+}
+
+//-----------------------------------------------------------------------------
@@ -25,6 +25,7 @@ ogl::buffer::buffer(GLenum t, GLsizei s, GLenum p) : t(t), s(s), p(p)
 
 ogl::buffer::~buffer()
 {
+    ogl::drop_buffer(o);
     glDeleteBuffers(1, &o);
 }
 
@@ -32,22 +33,22 @@ ogl::buffer::~buffer()
 
 void ogl::buffer::bind() const
 {
-    glBindBuffer(t, o);
+    ogl::bind_buffer(t, o);
 }
 
 void ogl::buffer::bind(GLenum target) const
 {
-    glBindBuffer(target, o);
+    ogl::bind_buffer(target, o);
 }
 
 void ogl::buffer::free() const
 {
-    glBindBuffer(t, 0);
+    ogl::bind_buffer(t, 0);
 }
 
 void ogl::buffer::free(GLenum target) const
 {
-    glBindBuffer(target, 0);
+    ogl::bind_buffer(target, 0);
 }
 
 void ogl::buffer::zero() const
@@ -0,0 +1,446 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+
+#include <SDL.h>
+
+#include <ogl-bvh.hpp>
+#include <etc-log.hpp>
+
+//-----------------------------------------------------------------------------
+
+// Leaf bounds are fattened by this fraction of their extent on each side.
+
+static const double margin = 0.1;
+
+static double area(const ogl::aabb& b)
+{
+    vec3 d = b.length();
+    return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+}
+
+static ogl::aabb join(const ogl::aabb& a, const ogl::aabb& b)
+{
+    ogl::aabb c(a);
+    c.merge(b);
+    return c;
+}
+
+static bool contains(const ogl::aabb& a, const ogl::aabb& b)
+{
+    return (a.min()[0] <= b.min()[0] && b.max()[0] <= a.max()[0] &&
+            a.min()[1] <= b.min()[1] && b.max()[1] <= a.max()[1] &&
+            a.min()[2] <= b.min()[2] && b.max()[2] <= a.max()[2]);
+}
+
+static ogl::aabb fatten(const ogl::aabb& b)
+{
+    ogl::aabb c(b);
+    c.inflate(2.0 * margin);
+    return c;
+}
+
+//-----------------------------------------------------------------------------
+
+ogl::bvh::bvh() : root(-1), spare(-1), count(0)
+{
+}
+
+// Add a leaf with the given bound and data. Return its index, which remains
+// valid until the leaf is removed.
+
+int ogl::bvh::insert(const aabb& b, void *data)
+{
+    int i = alloc();
+
+    items[i].bound = fatten(b);
+    items[i].data  = data;
+
+    insert_leaf(i);
+    count++;
+    return i;
+}
+
+void ogl::bvh::remove(int i)
+{
+    remove_leaf(i);
+    release(i);
+    count--;
+}
+
+// Update the bound of leaf i. Reinsert it only if the new bound escapes the
+// fat bound. Return true if the tree changed.
+
+bool ogl::bvh::move(int i, const aabb& b)
+{
+    if (contains(items[i].bound, b))
+        return false;
+
+    remove_leaf(i);
+    items[i].bound = fatten(b);
+    insert_leaf(i);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Test c frusta of n planes each. Append to the output the data of all leaves
+// not wholly outside at least one, with a mask of the frusta they may touch.
+// A subtree wholly inside a frustum is not tested against it again.
+
+void ogl::bvh::cull(const vec4 *const *V, int c, int n,
+                    std::vector<void *>& out, std::vector<unsigned>& vis) const
+{
+    if (root < 0 || c == 0) return;
+
+    visit v;
+
+    v.i    = root;
+    v.live = (c < 32) ? (1U << c) - 1 : ~0U;
+    v.in   = 0;
+
+    stack.clear();
+    stack.push_back(v);
+
+    while (!stack.empty())
+    {
+        v = stack.back();
+        stack.pop_back();
+
+        const item& t = items[v.i];
+
+        for (int f = 0; f < c; ++f)
+        {
+            const unsigned b = 1U << f;
+
+            if ((v.live & b) && !(v.in & b))
+            {
+                double d = std::numeric_limits<double>::max();
+                int    k;
+
+                for (k = 0; k < n; ++k)
+                {
+                    if (t.bound.max(V[f][k]) < 0) break;
+                    d = std::min(d, t.bound.min(V[f][k]));
+                }
+
+                if (k < n) v.live &= ~b;
+                else if (d > 0) v.in |= b;
+            }
+        }
+
+        if (v.live)
+        {
+            if (t.leaf())
+            {
+                out.push_back(t.data);
+                vis.push_back(v.live);
+            }
+            else
+            {
+                v.i = t.child[1]; stack.push_back(v);
+                v.i = t.child[0]; stack.push_back(v);
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+int ogl::bvh::alloc()
+{
+    int i;
+
+    if (spare >= 0)
+    {
+        i     = spare;
+        spare = items[i].parent;
+    }
+    else
+    {
+        i = int(items.size());
+        items.push_back(item());
+    }
+
+    items[i].data     =  0;
+    items[i].parent   = -1;
+    items[i].child[0] = -1;
+    items[i].child[1] = -1;
+    items[i].height   =  0;
+
+    return i;
+}
+
+void ogl::bvh::release(int i)
+{
+    items[i].parent = spare;
+    items[i].height = -1;
+    spare = i;
+}
+
+//-----------------------------------------------------------------------------
+
+// Find the sibling giving the least total surface area, descending while the
+// cost of pushing the leaf further down is lower than pairing it here.
+
+void ogl::bvh::insert_leaf(int l)
+{
+    if (root < 0)
+    {
+        root = l;
+        items[l].parent = -1;
+        return;
+    }
+
+    const aabb b = items[l].bound;
+
+    int s = root;
+
+    while (!items[s].leaf())
+    {
+        const int c0 = items[s].child[0];
+        const int c1 = items[s].child[1];
+
+        const double a = area(items[s].bound);
+        const double j = area(join(items[s].bound, b));
+
+        const double cost    = 2.0 * j;
+        const double inherit = 2.0 * (j - a);
+
+        double cost0 = area(join(items[c0].bound, b)) + inherit;
+        double cost1 = area(join(items[c1].bound, b)) + inherit;
+
+        if (!items[c0].leaf()) cost0 -= area(items[c0].bound);
+        if (!items[c1].leaf()) cost1 -= area(items[c1].bound);
+
+        if (cost < cost0 && cost < cost1)
+            break;
+
+        s = (cost0 < cost1) ? c0 : c1;
+    }
+
+    // Pair the leaf with the sibling under a new parent.
+
+    const int g = items[s].parent;
+    const int p = alloc();
+
+    items[p].parent   = g;
+    items[p].bound    = join(items[s].bound, b);
+    items[p].height   = items[s].height + 1;
+    items[p].child[0] = s;
+    items[p].child[1] = l;
+
+    if (g < 0)
+        root = p;
+    else if (items[g].child[0] == s)
+        items[g].child[0] = p;
+    else
+        items[g].child[1] = p;
+
+    items[s].parent = p;
+    items[l].parent = p;
+
+    refit(p);
+}
+
+void ogl::bvh::remove_leaf(int l)
+{
+    if (l == root)
+    {
+        root = -1;
+        return;
+    }
+
+    const int p = items[l].parent;
+    const int g = items[p].parent;
+    const int s = (items[p].child[0] == l) ? items[p].child[1]
+                                           : items[p].child[0];
+
+    // Replace the parent with the sibling.
+
+    items[s].parent = g;
+
+    if (g < 0)
+        root = s;
+    else
+    {
+        if (items[g].child[0] == p)
+            items[g].child[0] = s;
+        else
+            items[g].child[1] = s;
+
+        refit(g);
+    }
+    release(p);
+}
+
+// Walk from item i to the root, rebalancing and recomputing bounds.
+
+void ogl::bvh::refit(int i)
+{
+    while (i >= 0)
+    {
+        i = balance(i);
+
+        const int c0 = items[i].child[0];
+        const int c1 = items[i].child[1];
+
+        items[i].height = 1 + std::max(items[c0].height, items[c1].height);
+        items[i].bound  = join(items[c0].bound, items[c1].bound);
+
+        i = items[i].parent;
+    }
+}
+
+// If the subtrees of item a differ in height by more than one, rotate the
+// taller child up into its place. Return the index of the new subtree root.
+
+int ogl::bvh::balance(int a)
+{
+    if (items[a].leaf() || items[a].height < 2)
+        return a;
+
+    const int b = items[a].child[0];
+    const int c = items[a].child[1];
+    const int d = items[c].height - items[b].height;
+
+    if (d > -2 && d < 2)
+        return a;
+
+    // x is the taller child and y the shorter. k is the side of x in a.
+
+    const int k = (d > 1) ? 1 : 0;
+    const int x = (d > 1) ? c : b;
+    const int y = (d > 1) ? b : c;
+    const int f = items[x].child[0];
+    const int g = items[x].child[1];
+
+    // Lift x into the place of a.
+
+    items[x].child[0] = a;
+    items[x].parent   = items[a].parent;
+    items[a].parent   = x;
+
+    if (items[x].parent < 0)
+        root = x;
+    else if (items[items[x].parent].child[0] == a)
+        items[items[x].parent].child[0] = x;
+    else
+        items[items[x].parent].child[1] = x;
+
+    // Keep the taller grandchild under x and give the shorter one to a.
+
+    const int u = (items[f].height > items[g].height) ? f : g;
+    const int v = (items[f].height > items[g].height) ? g : f;
+
+    items[x].child[1] = u;
+    items[a].child[k] = v;
+    items[v].parent   = a;
+
+    items[a].bound  = join(items[y].bound, items[v].bound);
+    items[a].height = 1 + std::max(items[y].height, items[v].height);
+    items[x].bound  = join(items[a].bound, items[u].bound);
+    items[x].height = 1 + std::max(items[a].height, items[u].height);
+
+    return x;
+}
+
+//-----------------------------------------------------------------------------
+
+// Time the insertion, refit, and culling of n random unit boxes scattered at
+// constant density, and compare culling against a linear walk of all boxes.
+// The frustum is of fixed size, as is a view of a growing world. Return false
+// if culling misses a visible box.
+
+bool ogl::bvh::bench(int n)
+{
+    const double s = pow(double(n), 1.0 / 3.0) * 4.0;
+    const double f = double(SDL_GetPerformanceFrequency()) / 1000.0;
+
+    std::vector<aabb>     boxes(n);
+    std::vector<int>      leaves(n);
+    std::vector<void *>   found;
+    std::vector<unsigned> mask;
+
+    srand(1);
+
+    for (int i = 0; i < n; ++i)
+    {
+        vec3 p(s * rand() / RAND_MAX,
+               s * rand() / RAND_MAX,
+               s * rand() / RAND_MAX);
+
+        boxes[i] = aabb(p - vec3(0.5, 0.5, 0.5), p + vec3(0.5, 0.5, 0.5));
+    }
+
+    // A frustum at one corner of the volume looking across its diagonal.
+
+    const double r = 1.0 / sqrt(2.0);
+    const double d = 40.0;
+    const vec4 P[5] = {
+        vec4(  1,  0,  0, 0),
+        vec4(  0,  1,  0, 0),
+        vec4(  0,  0,  1, 0),
+        vec4( -r, -r,  0, d),
+        vec4(  0, -r, -r, d),
+    };
+
+    bvh tree;
+
+    Uint64 t0 = SDL_GetPerformanceCounter();
+
+    for (int i = 0; i < n; ++i)
+        leaves[i] = tree.insert(boxes[i], &boxes[i]);
+
+    Uint64 t1 = SDL_GetPerformanceCounter();
+
+    for (int i = 0; i < n; i += 10)
+    {
+        boxes[i] = aabb(boxes[i].min() + vec3(0.5, 0.0, 0.0),
+                        boxes[i].max() + vec3(0.5, 0.0, 0.0));
+        tree.move(leaves[i], boxes[i]);
+    }
+
+    Uint64 t2 = SDL_GetPerformanceCounter();
+
+    int a = 0;
+    int b = 0;
+
+    const vec4 *V = P;
+
+    tree.cull(&V, 1, 5, found, mask);
+
+    for (size_t i = 0; i < found.size(); ++i)
+        if (((aabb *) found[i])->test(P, 5))
+            a++;
+
+    Uint64 t3 = SDL_GetPerformanceCounter();
+
+    for (int i = 0; i < n; ++i)
+        if (boxes[i].test(P, 5))
+            b++;
+
+    Uint64 t4 = SDL_GetPerformanceCounter();
+
+    etc::log("bvh %7d nodes: insert %8.2fms move %7.2fms "
+             "cull %7.3fms (%d of %d) linear %7.3fms (%d)", n,
+             (t1 - t0) / f, (t2 - t1) / f, (t3 - t2) / f, a, int(found.size()),
+             (t4 - t3) / f, b);
+
+    return (a == b);
+}
+
+//-----------------------------------------------------------------------------
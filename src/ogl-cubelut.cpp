@@ -111,6 +111,7 @@ void ogl::cubelut::fini()
     {
         assert(object);
 
+        ogl::drop_texture(object);
         glDeleteTextures(1, &object);
         object = 0;
     }
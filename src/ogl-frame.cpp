@@ -299,16 +299,42 @@ void ogl::frame::fini()
     {
         if (buffer) glDeleteFramebuffersEXT(1, &buffer);
 
+        ogl::drop_texture(color);
+        ogl::drop_texture(depth);
+
         if (color) glDeleteTextures(1, &color);
         if (depth) glDeleteTextures(1, &depth);
     }
 }
 
+// Copy the buffers of the given frame to the same buffers of this one, which
+// must match it in size and format. This requires ogl::has_framebuffer_blit.
+
+void ogl::frame::copy(const frame *that) const
+{
+    GLbitfield mask = 0;
+
+    if (has_color   && that->has_color)   mask |= GL_COLOR_BUFFER_BIT;
+    if (has_depth   && that->has_depth)   mask |= GL_DEPTH_BUFFER_BIT;
+    if (has_stencil && that->has_stencil) mask |= GL_STENCIL_BUFFER_BIT;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, that->buffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER,       buffer);
+
+    glBlitFramebuffer(0, 0, that->w, that->h,
+                      0, 0,       w,       h, mask, GL_NEAREST);
+
+    if (stack.empty())
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    else
+        glBindFramebuffer(GL_FRAMEBUFFER, stack.back());
+}
+
 void ogl::frame::draw()
 {
     glPushAttrib(GL_POLYGON_BIT | GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT);
     {
-        glUseProgram(0);
+        ogl::bind_program(0);
 
         glDisable(GL_LIGHTING);
         glDisable(GL_BLEND);
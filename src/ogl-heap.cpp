@@ -0,0 +1,164 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <cstddef>
+
+#include <ogl-heap.hpp>
+
+//-----------------------------------------------------------------------------
+
+ogl::heap::heap(GLsizei min) : min(min), top(0), cap(0), use(0)
+{
+}
+
+// Return the size class of a block of n items: the smallest k with n no larger
+// than min * 2^k.
+
+int ogl::heap::size_class(GLsizei n) const
+{
+    int k = 0;
+
+    while ((min << k) < n)
+        k++;
+
+    return k;
+}
+
+GLsizei ogl::heap::size(GLsizei o) const
+{
+    block_m::const_iterator i = live.find(o);
+
+    return (i == live.end()) ? 0 : i->second;
+}
+
+// Return true if live block o is of the right class for n items.
+
+bool ogl::heap::fits(GLsizei o, GLsizei n) const
+{
+    block_m::const_iterator i = live.find(o);
+
+    return (i != live.end() && size_class(i->second) == size_class(n));
+}
+
+//-----------------------------------------------------------------------------
+
+// Allocate a block of at least n items and return its offset. Reuse the lowest
+// free block of the right class if possible. Otherwise take the block from the
+// top, doubling the capacity as needed.
+
+GLsizei ogl::heap::alloc(GLsizei n)
+{
+    const int     k = size_class(n);
+    const GLsizei s = min << k;
+
+    GLsizei o;
+
+    if (k < int(free_list.size()) && !free_list[k].empty())
+    {
+        o = *free_list[k].begin();
+        free_list[k].erase(free_list[k].begin());
+    }
+    else
+    {
+        o    = top;
+        top += s;
+
+        while (cap < top)
+            cap = cap ? cap * 2 : s;
+    }
+
+    live[o] = s;
+    use    += s;
+
+    return o;
+}
+
+void ogl::heap::free(GLsizei o)
+{
+    block_m::iterator i = live.find(o);
+
+    if (i != live.end())
+    {
+        const int k = size_class(i->second);
+
+        if (k >= int(free_list.size()))
+            free_list.resize(k + 1);
+
+        free_list[k].insert(o);
+        use -= i->second;
+        live.erase(i);
+
+        trim();
+    }
+}
+
+// Release all blocks and the capacity.
+
+void ogl::heap::clear()
+{
+    live.clear();
+    free_list.clear();
+
+    top = 0;
+    cap = 0;
+    use = 0;
+}
+
+// Lower the top to the end of the highest live block, discarding free blocks
+// above it.
+
+void ogl::heap::trim()
+{
+    const GLsizei t = live.empty() ? 0 : live.rbegin()->first
+                                       + live.rbegin()->second;
+    if (t < top)
+    {
+        for (size_t k = 0; k < free_list.size(); ++k)
+            free_list[k].erase(free_list[k].lower_bound(t), free_list[k].end());
+
+        top = t;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Take one compaction step. Find the highest live block for which a lower free
+// block of the same class exists and move it there. Return its old and new
+// offsets so the owner can relocate its data. Return false if the heap can
+// not be compacted further this way.
+
+bool ogl::heap::defrag(GLsizei& src, GLsizei& dst)
+{
+    for (block_m::reverse_iterator i = live.rbegin(); i != live.rend(); ++i)
+    {
+        const int k = size_class(i->second);
+
+        if (k < int(free_list.size()) && !free_list[k].empty()
+                                      && *free_list[k].begin() < i->first)
+        {
+            src = i->first;
+            dst = *free_list[k].begin();
+
+            free_list[k].erase(free_list[k].begin());
+            free_list[k].insert(src);
+
+            live[dst] = i->second;
+            live.erase(src);
+
+            trim();
+            return true;
+        }
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
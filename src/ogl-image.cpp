@@ -154,6 +154,7 @@ void ogl::image::fini()
 
         // Delete the texture object.
 
+        ogl::drop_texture(object);
         glDeleteTextures(1, &object);
         object = 0;
     }
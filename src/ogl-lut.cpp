@@ -32,6 +32,7 @@ ogl::lut::lut(GLsizei w, GLenum T, GLenum fi, GLenum fe, GLenum t) :
 
 ogl::lut::~lut()
 {
+    ogl::drop_texture(object);
     glDeleteTextures(1, &object);
 }
 
@@ -10,10 +10,21 @@
 //  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
 //  General Public License for more details.
 
+#include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <cstdlib>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+#include <SDL.h>
 
 #include <etc-vector.hpp>
+#include <etc-log.hpp>
 #include <ogl-opengl.hpp>
 #include <ogl-mesh.hpp>
 #include <app-glob.hpp>
@@ -212,10 +223,485 @@ void ogl::mesh::add_line(GLuint i, GLuint j)
 
 //-----------------------------------------------------------------------------
 
-static void transform_vertex(GLfloat *v, const mat4& M, const GLfloat *u)
+// Triangle order optimization follows Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation". Vertices are scored by their position in a simulated LRU
+// cache and by the number of their triangles yet to be emitted, and the best
+// triangle using a cached vertex is emitted next.
+
+#define VCACHE_SIZE 32
+#define VCACHE_FIFO 16
+#define VALENCE_MAX 64
+
+// The score tables are built during static initialization, before any mesh
+// may be sorted in parallel.
+
+static struct vcache_table
+{
+    float cache_score[VCACHE_SIZE];
+    float value_score[VALENCE_MAX];
+
+    vcache_table()
+    {
+        for (int i = 0; i < VCACHE_SIZE; ++i)
+            cache_score[i] = (i < 3) ? 0.75f :
+                powf(1.0f - float(i - 3) / float(VCACHE_SIZE - 3), 1.5f);
+
+        for (int i = 1; i < VALENCE_MAX; ++i)
+            value_score[i] = 2.0f / sqrtf(float(i));
+
+        value_score[0] = 0.0f;
+    }
+} vcache;
+
+static float vcache_score(int p, int n)
+{
+    if (n == 0) return -1.0f;
+
+    return ((p < 0) ? 0.0f : vcache.cache_score[p])
+         + vcache.value_score[std::min(n, VALENCE_MAX - 1)];
+}
+
+void ogl::mesh::sort_faces()
+{
+    const int nf = int(faces.size());
+    const int nv = int(vv.size());
+
+    if (nf == 0) return;
+
+    // Build the vertex-to-face adjacency.
+
+    std::vector<int> count(nv, 0);
+    std::vector<int> first(nv + 1, 0);
+    std::vector<int> adj(nf * 3);
+
+    for (int f = 0; f < nf; ++f)
+    {
+        count[faces[f].i]++;
+        count[faces[f].j]++;
+        count[faces[f].k]++;
+    }
+    for (int v = 0; v < nv; ++v)
+        first[v + 1] = first[v] + count[v];
+
+    std::fill(count.begin(), count.end(), 0);
+
+    for (int f = 0; f < nf; ++f)
+    {
+        const GLuint *t = &faces[f].i;
+
+        for (int c = 0; c < 3; ++c)
+            adj[first[t[c]] + count[t[c]]++] = f;
+    }
+
+    // Initialize the vertex and face scores.
+
+    std::vector<int>   vpos(nv, -1);
+    std::vector<float> vscore(nv);
+    std::vector<float> fscore(nf);
+    std::vector<bool>  done(nf, false);
+
+    for (int v = 0; v < nv; ++v)
+        vscore[v] = vcache_score(-1, count[v]);
+
+    int best = 0;
+
+    for (int f = 0; f < nf; ++f)
+    {
+        fscore[f] = vscore[faces[f].i] + vscore[faces[f].j]
+                                       + vscore[faces[f].k];
+        if (fscore[f] > fscore[best])
+            best = f;
+    }
+
+    // Emit triangles, simulating the cache.
+
+    int cache[VCACHE_SIZE + 3];
+    int csize = 0;
+    int cursor = 0;
+
+    face_v order;
+
+    order.reserve(nf);
+
+    while (best >= 0)
+    {
+        const GLuint *t = &faces[best].i;
+
+        order.push_back(faces[best]);
+        done[best] = true;
+
+        // Remove the emitted face from the adjacency of its vertices.
+
+        for (int c = 0; c < 3; ++c)
+        {
+            int *a = &adj[first[t[c]]];
+            int  n = count[t[c]];
+
+            for (int i = 0; i < n; ++i)
+                if (a[i] == best)
+                {
+                    a[i] = a[n - 1];
+                    count[t[c]]--;
+                    break;
+                }
+        }
+
+        // Move its vertices to the front of the cache.
+
+        int next[VCACHE_SIZE + 3];
+        int nsize = 0;
+
+        for (int c = 0; c < 3; ++c)
+            next[nsize++] = int(t[c]);
+
+        for (int i = 0; i < csize; ++i)
+            if (cache[i] != int(t[0]) &&
+                cache[i] != int(t[1]) &&
+                cache[i] != int(t[2]))
+                next[nsize++] = cache[i];
+
+        // Rescore all vertices that were or are in the cache.
+
+        for (int i = 0; i < nsize; ++i)
+        {
+            const int v = next[i];
+
+            vpos  [v] = (i < VCACHE_SIZE) ? i : -1;
+            vscore[v] = vcache_score(vpos[v], count[v]);
+        }
+
+        // Rescore their faces and find the best.
+
+        best = -1;
+
+        for (int i = 0; i < nsize; ++i)
+        {
+            const int v = next[i];
+
+            for (int j = first[v]; j < first[v] + count[v]; ++j)
+            {
+                const int f = adj[j];
+
+                fscore[f] = vscore[faces[f].i] + vscore[faces[f].j]
+                                               + vscore[faces[f].k];
+
+                if (best < 0 || fscore[f] > fscore[best])
+                    best = f;
+            }
+        }
+
+        csize = std::min(nsize, VCACHE_SIZE);
+        std::copy(next, next + csize, cache);
+
+        // If the cache is exhausted, take the next face in file order.
+
+        if (best < 0)
+        {
+            while (cursor < nf && done[cursor])
+                cursor++;
+
+            if (cursor < nf)
+                best = cursor;
+        }
+    }
+
+    faces.swap(order);
+    dirty_faces = true;
+}
+
+// Overdraw reduction follows Sander, Nehab, and Barczak, "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw". The cache-ordered
+// triangles are split into clusters wherever the cache would be fully missed
+// and the clusters are sorted to render outward-facing surfaces first.
+
+struct face_cluster
+{
+    size_t b;
+    size_t e;
+    double k;
+
+    bool operator<(const face_cluster& that) const { return k > that.k; }
+};
+
+void ogl::mesh::sort_clusters()
+{
+    const size_t nf = faces.size();
+
+    if (nf == 0) return;
+
+    // Split the face list at each triangle that misses the cache entirely.
+
+    std::vector<face_cluster> clusters;
+    std::vector<int>          stamp(vv.size(), -VCACHE_FIFO - 1);
+
+    face_cluster c;
+    int          t = 0;
+
+    c.b = 0;
+    c.k = 0;
+
+    for (size_t f = 0; f < nf; ++f)
+    {
+        const GLuint *v = &faces[f].i;
+        int           m = 0;
+
+        for (int i = 0; i < 3; ++i)
+            if (t - stamp[v[i]] > VCACHE_FIFO)
+            {
+                stamp[v[i]] = t++;
+                m++;
+            }
+
+        if (m == 3 && f > c.b)
+        {
+            c.e = f;
+            clusters.push_back(c);
+            c.b = f;
+        }
+    }
+    c.e = nf;
+    clusters.push_back(c);
+
+    // Sort clusters by the facing of their normal away from the mesh center.
+
+    vec3 o = (bound.min() + bound.max()) / 2.0;
+
+    for (size_t i = 0; i < clusters.size(); ++i)
+    {
+        vec3 p(0, 0, 0);
+        vec3 n(0, 0, 0);
+
+        for (size_t f = clusters[i].b; f < clusters[i].e; ++f)
+        {
+            const GLfloat *a = vv[faces[f].i].v;
+            const GLfloat *b = vv[faces[f].j].v;
+            const GLfloat *d = vv[faces[f].k].v;
+
+            vec3 A(a[0], a[1], a[2]);
+            vec3 B(b[0], b[1], b[2]);
+            vec3 D(d[0], d[1], d[2]);
+
+            p = p + (A + B + D) / 3.0;
+            n = n + cross(B - A, D - A);
+        }
+
+        p = p / double(clusters[i].e - clusters[i].b);
+
+        clusters[i].k = (n * n > 0.0) ? (p - o) * normal(n) : 0.0;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end());
+
+    face_v order;
+
+    order.reserve(nf);
+
+    for (size_t i = 0; i < clusters.size(); ++i)
+        order.insert(order.end(), faces.begin() + clusters[i].b,
+                                  faces.begin() + clusters[i].e);
+    faces.swap(order);
+    dirty_faces = true;
+}
+
+// Renumber vertices in order of first use by faces and then lines. Unused
+// vertices keep their relative order at the end.
+
+void ogl::mesh::sort_verts()
+{
+    const size_t n = vv.size();
+
+    std::vector<GLuint> remap(n, GLuint(-1));
+    GLuint              next = 0;
+
+    for (face_i f = faces.begin(); f != faces.end(); ++f)
+    {
+        if (remap[f->i] == GLuint(-1)) remap[f->i] = next++;
+        if (remap[f->j] == GLuint(-1)) remap[f->j] = next++;
+        if (remap[f->k] == GLuint(-1)) remap[f->k] = next++;
+    }
+    for (line_i l = lines.begin(); l != lines.end(); ++l)
+    {
+        if (remap[l->i] == GLuint(-1)) remap[l->i] = next++;
+        if (remap[l->j] == GLuint(-1)) remap[l->j] = next++;
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (remap[i] == GLuint(-1)) remap[i] = next++;
+
+    // Permute the vertex arrays and remap the elements.
+
+    GLvec3_v v(n), m(n), t(n), u(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        v[remap[i]] = vv[i];
+        m[remap[i]] = nv[i];
+        t[remap[i]] = tv[i];
+        u[remap[i]] = uv[i];
+    }
+    vv.swap(v);
+    nv.swap(m);
+    tv.swap(t);
+    uv.swap(u);
+
+    min = std::numeric_limits<GLuint>::max();
+    max = std::numeric_limits<GLuint>::min();
+
+    for (face_i f = faces.begin(); f != faces.end(); ++f)
+    {
+        f->i = remap[f->i];
+        f->j = remap[f->j];
+        f->k = remap[f->k];
+
+        min = std::min(std::min(min, f->i), std::min(f->j, f->k));
+        max = std::max(std::max(max, f->i), std::max(f->j, f->k));
+    }
+    for (line_i l = lines.begin(); l != lines.end(); ++l)
+    {
+        l->i = remap[l->i];
+        l->j = remap[l->j];
+
+        min = std::min(min, std::min(l->i, l->j));
+        max = std::max(max, std::max(l->i, l->j));
+    }
+
+    dirty_verts = true;
+    dirty_faces = true;
+    dirty_lines = true;
+}
+
+void ogl::mesh::optimize(bool overdraw)
+{
+    sort_faces();
+
+    if (overdraw)
+        sort_clusters();
+
+    sort_verts();
+}
+
+// Count the vertex transforms performed by a FIFO post-transform cache.
+
+GLsizei ogl::mesh::count_misses() const
+{
+    std::vector<int> stamp(vv.size(), -VCACHE_FIFO - 1);
+
+    int t = 0;
+
+    for (face_c f = faces.begin(); f != faces.end(); ++f)
+    {
+        if (t - stamp[f->i] > VCACHE_FIFO) stamp[f->i] = t++;
+        if (t - stamp[f->j] > VCACHE_FIFO) stamp[f->j] = t++;
+        if (t - stamp[f->k] > VCACHE_FIFO) stamp[f->k] = t++;
+    }
+    return GLsizei(t);
+}
+
+//-----------------------------------------------------------------------------
+
+// Vertices are transformed in single precision, each stream in one pass. M
+// holds the columns of the matrix. Positions include the translation column
+// and are divided by w only if the matrix is projective. The componentwise
+// extent of the output is accumulated in lo and hi.
+
+#if defined(__SSE__) || defined(_M_X64)
+
+static void transform_stream(ogl::GLvec3 *d, const ogl::GLvec3 *s, size_t n,
+                             const GLfloat M[4][4], bool point, bool divide,
+                             GLfloat *lo, GLfloat *hi)
+{
+    const __m128 c0 = _mm_loadu_ps(M[0]);
+    const __m128 c1 = _mm_loadu_ps(M[1]);
+    const __m128 c2 = _mm_loadu_ps(M[2]);
+    const __m128 c3 = point ? _mm_loadu_ps(M[3]) : _mm_setzero_ps();
+
+    __m128 a = _mm_set1_ps( std::numeric_limits<float>::max());
+    __m128 z = _mm_set1_ps(-std::numeric_limits<float>::max());
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const GLfloat *u = s[i].v;
+              GLfloat *v = d[i].v;
+
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_load1_ps(u + 0)),
+                                         _mm_mul_ps(c1, _mm_load1_ps(u + 1))),
+                              _mm_add_ps(_mm_mul_ps(c2, _mm_load1_ps(u + 2)),
+                                         c3));
+        if (divide)
+            r = _mm_div_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        _mm_storel_pi((__m64 *) v, r);
+        _mm_store_ss (v + 2, _mm_movehl_ps(r, r));
+
+        a = _mm_min_ps(a, r);
+        z = _mm_max_ps(z, r);
+    }
+
+    if (lo && hi)
+    {
+        GLfloat A[4], Z[4];
+
+        _mm_storeu_ps(A, a);
+        _mm_storeu_ps(Z, z);
+
+        lo[0] = A[0]; lo[1] = A[1]; lo[2] = A[2];
+        hi[0] = Z[0]; hi[1] = Z[1]; hi[2] = Z[2];
+    }
+}
+
+#else
+
+static void transform_stream(ogl::GLvec3 *d, const ogl::GLvec3 *s, size_t n,
+                             const GLfloat M[4][4], bool point, bool divide,
+                             GLfloat *lo, GLfloat *hi)
 {
-    // Transform a GL vertex using a double matrix.
+    const GLfloat t = point ? 1.0f : 0.0f;
+
+    GLfloat a[3] = {  std::numeric_limits<float>::max(),
+                      std::numeric_limits<float>::max(),
+                      std::numeric_limits<float>::max() };
+    GLfloat z[3] = { -std::numeric_limits<float>::max(),
+                     -std::numeric_limits<float>::max(),
+                     -std::numeric_limits<float>::max() };
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const GLfloat *u = s[i].v;
+              GLfloat *v = d[i].v;
+
+        GLfloat r[4];
+
+        for (int k = 0; k < 4; ++k)
+            r[k] = M[0][k] * u[0] + M[1][k] * u[1] + M[2][k] * u[2]
+                                                   + M[3][k] * t;
+        if (divide)
+        {
+            r[0] /= r[3];
+            r[1] /= r[3];
+            r[2] /= r[3];
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            v[k] = r[k];
+            a[k] = std::min(a[k], r[k]);
+            z[k] = std::max(z[k], r[k]);
+        }
+    }
+
+    if (lo && hi)
+    {
+        lo[0] = a[0]; lo[1] = a[1]; lo[2] = a[2];
+        hi[0] = z[0]; hi[1] = z[1]; hi[2] = z[2];
+    }
+}
+
+#endif
 
+// Transform a vertex or normal in double precision. This is the reference
+// for the single-precision kernel above.
+
+static void transform_vertex(GLfloat *v, const mat4& M, const GLfloat *u)
+{
     vec4 t = M * vec4(double(u[0]),
                       double(u[1]),
                       double(u[2]), 1.0);
@@ -227,8 +713,6 @@ static void transform_vertex(GLfloat *v, const mat4& M, const GLfloat *u)
 
 static void transform_normal(GLfloat *v, const mat4& M, const GLfloat *u)
 {
-    // Transform a GL vertex using a double matrix.
-
     vec4 t = M * vec4(double(u[0]),
                       double(u[1]),
                       double(u[2]), 0.0);
@@ -245,6 +729,22 @@ void ogl::mesh::cache_verts(const ogl::mesh *that, const mat4& M,
 {
     const size_t n = that->vv.size();
 
+    // Convert the matrices to single precision columns. Normals and tangents
+    // are transformed by the upper 3x3 of the inverse transpose.
+
+    GLfloat P[4][4];
+    GLfloat N[4][4];
+
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+        {
+            P[c][r] = GLfloat(M[r][c]);
+            N[c][r] = (r < 3 && c < 3) ? GLfloat(I[c][r]) : 0.0f;
+        }
+
+    const bool affine = (M[3][0] == 0.0 && M[3][1] == 0.0 &&
+                         M[3][2] == 0.0 && M[3][3] == 1.0);
+
     // Cache that mesh's transformed vertices here.  Update bounding volume.
 
     vv.resize(n);
@@ -254,18 +754,26 @@ void ogl::mesh::cache_verts(const ogl::mesh *that, const mat4& M,
 
     bound = aabb();
 
-    for (size_t i = 0; i < n; ++i)
+    if (n)
     {
-        transform_vertex(vv[i].v,           M,  that->vv[i].v);
-        transform_normal(nv[i].v, transpose(I), that->nv[i].v);
-        transform_normal(tv[i].v, transpose(I), that->tv[i].v);
-
-        bound.merge(vec3(double(vv[i].v[0]),
-                         double(vv[i].v[1]),
-                         double(vv[i].v[2])));
+        GLfloat lo[3];
+        GLfloat hi[3];
+
+        transform_stream(&vv.front(), &that->vv.front(), n, P, true, !affine,
+                                                                    lo, hi);
+        transform_stream(&nv.front(), &that->nv.front(), n, N, false, false,
+                                                                    0, 0);
+        transform_stream(&tv.front(), &that->tv.front(), n, N, false, false,
+                                                                    0, 0);
+
+        bound = aabb(vec3(double(lo[0]), double(lo[1]), double(lo[2])),
+                     vec3(double(hi[0]), double(hi[1]), double(hi[2])));
+    }
 
-        // Handy trick: Store the unit ID in the texture coordinate.
+    // Handy trick: Store the unit ID in the texture coordinate.
 
+    for (size_t i = 0; i < n; ++i)
+    {
         uv[i].v[0] = that->uv[i].v[0];
         uv[i].v[1] = that->uv[i].v[1];
         uv[i].v[2] = GLfloat(id);
@@ -317,52 +825,130 @@ void ogl::mesh::cache_lines(const ogl::mesh *that, GLuint d)
 
 //-----------------------------------------------------------------------------
 
-static void buffer(GLintptr off, GLsizeiptr siz, const GLvoid *dat)
+void ogl::mesh::buffv(const GLfloat *v,
+                      const GLfloat *n,
+                      const GLfloat *t,
+                      const GLfloat *u, stream& s)
+{
+    // Queue all cached vertex data for the bound array buffer object.
+
+    if (dirty_verts && vv.size())
+    {
+        const GLsizeiptr sz = vv.size() * sizeof (GLvec3);
+
+        s.add(GL_ARRAY_BUFFER, GLintptr(v), sz, &vv.front());
+        s.add(GL_ARRAY_BUFFER, GLintptr(n), sz, &nv.front());
+        s.add(GL_ARRAY_BUFFER, GLintptr(t), sz, &tv.front());
+        s.add(GL_ARRAY_BUFFER, GLintptr(u), sz, &uv.front());
+    }
+    dirty_verts = false;
+}
+
+// Compact vertex encoding: snorm16 position relative to a center and scale,
+// snorm16 octahedral normal and tangent, half-float texture coordinate, and
+// integer unit ID with bit 23 flagging a zero-length normal. Each plane holds
+// eight bytes per vertex.
+
+static GLshort snorm(GLfloat k)
 {
-    const GLubyte   *buf = (const GLubyte *) dat;
-    const GLsizeiptr max = 1024 * 256;
+    k = std::max(std::min(k * 32767.0f, 32767.0f), -32767.0f);
 
-    // This works around an apparent bug under OSX 10.5.6 (using an NVIDIA
-    // GeForce 8800GT) that corrupts uploads larger than about a megabyte.
+    return GLshort(k < 0.0f ? k - 0.5f : k + 0.5f);
+}
 
-    while (siz > 0)
+static bool octahedral(GLshort *e, const GLfloat *v)
+{
+    const GLfloat d = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+
+    GLfloat x = 0.0f;
+    GLfloat y = 0.0f;
+
+    if (d > 0.0f)
     {
-        GLsizeiptr len = std::min(siz, max);
+        x = v[0] / d;
+        y = v[1] / d;
 
-        glBufferSubData(GL_ARRAY_BUFFER, off, len, buf);
+        // Fold the lower hemisphere over the diagonals.
 
-        off += len;
-        buf += len;
-        siz -= len;
+        if (v[2] < 0.0f)
+        {
+            const GLfloat a = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            const GLfloat b = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+
+            x = a;
+            y = b;
+        }
     }
+    e[0] = snorm(x);
+    e[1] = snorm(y);
+
+    return (d > 0.0f);
 }
 
-void ogl::mesh::buffv(const GLfloat *v,
-                      const GLfloat *n,
-                      const GLfloat *t,
-                      const GLfloat *u)
+static GLushort half(GLfloat f)
+{
+    GLuint x;
+
+    memcpy(&x, &f, sizeof (GLuint));
+
+    const GLuint s = (x >> 16) & 0x8000;
+    const GLint  e = GLint((x >> 23) & 0xFF) - 127 + 15;
+    const GLuint m = (x & 0x7FFFFF);
+
+    // Flush tiny values to zero and clamp large ones. Round to nearest.
+
+    if (e <=  0) return GLushort(s);
+    if (e >= 31) return GLushort(s | 0x7BFF);
+
+    GLuint h = (GLuint(e) << 10 | m >> 13) + (m >> 12 & 1);
+
+    return GLushort(s | std::min(h, GLuint(0x7BFF)));
+}
+
+bool ogl::mesh::packv(GLshort *p, GLshort *n, GLushort *u,
+                      const vec3& c, double k, bool force)
 {
-    // Copy all cached vertex data to the bound array buffer object.
+    // Encode all cached vertex data if changed or forced.
 
-    if (dirty_verts)
+    if (dirty_verts || force)
     {
-        buffer(GLintptr(v), vv.size() * sizeof (GLvec3), &vv.front());
-        buffer(GLintptr(n), nv.size() * sizeof (GLvec3), &nv.front());
-        buffer(GLintptr(t), tv.size() * sizeof (GLvec3), &tv.front());
-        buffer(GLintptr(u), uv.size() * sizeof (GLvec3), &uv.front());
+        const GLfloat x = GLfloat(c[0]);
+        const GLfloat y = GLfloat(c[1]);
+        const GLfloat z = GLfloat(c[2]);
+        const GLfloat s = GLfloat(k);
+
+        for (size_t i = 0; i < vv.size(); ++i, p += 4, n += 4, u += 4)
+        {
+            p[0] = snorm((vv[i].v[0] - x) * s);
+            p[1] = snorm((vv[i].v[1] - y) * s);
+            p[2] = snorm((vv[i].v[2] - z) * s);
+            p[3] = 0;
+
+            GLuint id = GLuint(uv[i].v[2]);
+
+            if (!octahedral(n + 0, nv[i].v)) id |= 0x800000;
+            octahedral(n + 2, tv[i].v);
+
+            u[0] = half(uv[i].v[0]);
+            u[1] = half(uv[i].v[1]);
+
+            memcpy(u + 2, &id, sizeof (GLuint));
+        }
+        dirty_verts = false;
+        return true;
     }
-    dirty_verts = false;
+    return false;
 }
 
-void ogl::mesh::buffe(const GLuint *e)
+void ogl::mesh::buffe(const GLuint *e, stream& s)
 {
-    // Copy all cached index data to the bound element array buffer object.
+    // Queue all cached index data for the bound element array buffer object.
 
     if (dirty_faces && faces.size())
     {
         faces_pointer = e;
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(e),
-                           faces.size() * sizeof (face), &faces.front());
+        s.add(GL_ELEMENT_ARRAY_BUFFER, GLintptr(e),
+                 faces.size() * sizeof (face), &faces.front());
     }
 
     e += faces.size() * 3;
@@ -370,8 +956,8 @@ void ogl::mesh::buffe(const GLuint *e)
     if (dirty_lines && lines.size())
     {
         lines_pointer = e;
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(e),
-                           lines.size() * sizeof (line), &lines.front());
+        s.add(GL_ELEMENT_ARRAY_BUFFER, GLintptr(e),
+                 lines.size() * sizeof (line), &lines.front());
     }
 
     dirty_faces = false;
@@ -379,3 +965,226 @@ void ogl::mesh::buffe(const GLuint *e)
 }
 
 //-----------------------------------------------------------------------------
+
+// The binary cache stores each mesh as a count block followed by the raw vertex
+// and element arrays. Reads use memcpy throughout, as the mapped cache gives no
+// alignment guarantee.
+
+struct mesh_head
+{
+    GLuint  vc;
+    GLuint  fc;
+    GLuint  lc;
+    GLuint  min;
+    GLuint  max;
+    GLuint  pad;
+    GLdouble a[3];
+    GLdouble z[3];
+};
+
+static void put(std::vector<GLubyte>& v, const void *p, size_t n)
+{
+    const GLubyte *b = (const GLubyte *) p;
+
+    if (n) v.insert(v.end(), b, b + n);
+}
+
+static const GLubyte *get(const GLubyte *p, const GLubyte *e, void *d, size_t n)
+{
+    if (size_t(e - p) < n)
+        throw std::runtime_error("Truncated mesh cache");
+
+    if (n) memcpy(d, p, n);
+
+    return p + n;
+}
+
+void ogl::mesh::save(std::vector<GLubyte>& v) const
+{
+    mesh_head h;
+
+    h.vc  = GLuint(   vv.size());
+    h.fc  = GLuint(faces.size());
+    h.lc  = GLuint(lines.size());
+    h.min = min;
+    h.max = max;
+    h.pad = 0;
+
+    vec3 a = bound.min();
+    vec3 z = bound.max();
+
+    h.a[0] = a[0]; h.a[1] = a[1]; h.a[2] = a[2];
+    h.z[0] = z[0]; h.z[1] = z[1]; h.z[2] = z[2];
+
+    put(v, &h, sizeof (mesh_head));
+
+    if (h.vc)
+    {
+        put(v, &vv.front(), h.vc * sizeof (GLvec3));
+        put(v, &nv.front(), h.vc * sizeof (GLvec3));
+        put(v, &tv.front(), h.vc * sizeof (GLvec3));
+        put(v, &uv.front(), h.vc * sizeof (GLvec3));
+    }
+    if (h.fc) put(v, &faces.front(), h.fc * sizeof (face));
+    if (h.lc) put(v, &lines.front(), h.lc * sizeof (line));
+}
+
+const GLubyte *ogl::mesh::load(const GLubyte *p, const GLubyte *e)
+{
+    mesh_head h;
+
+    p = get(p, e, &h, sizeof (mesh_head));
+
+    // Copy the vertex and element arrays. Tangents arrive precomputed.
+
+    vv.resize(h.vc);
+    nv.resize(h.vc);
+    tv.resize(h.vc);
+    uv.resize(h.vc);
+
+    faces.resize(h.fc);
+    lines.resize(h.lc);
+
+    if (h.vc)
+    {
+        p = get(p, e, &vv.front(), h.vc * sizeof (GLvec3));
+        p = get(p, e, &nv.front(), h.vc * sizeof (GLvec3));
+        p = get(p, e, &tv.front(), h.vc * sizeof (GLvec3));
+        p = get(p, e, &uv.front(), h.vc * sizeof (GLvec3));
+
+        bound = aabb(vec3(h.a[0], h.a[1], h.a[2]),
+                     vec3(h.z[0], h.z[1], h.z[2]));
+    }
+    if (h.fc) p = get(p, e, &faces.front(), h.fc * sizeof (face));
+    if (h.lc) p = get(p, e, &lines.front(), h.lc * sizeof (line));
+
+    min = h.min;
+    max = h.max;
+
+    dirty_verts = true;
+    dirty_faces = true;
+    dirty_lines = true;
+
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+
+// Return a random unit vector.
+
+static vec3 random_unit()
+{
+    vec3 d;
+
+    do
+        d = vec3(2.0 * rand() / RAND_MAX - 1.0,
+                 2.0 * rand() / RAND_MAX - 1.0,
+                 2.0 * rand() / RAND_MAX - 1.0);
+    while (length(d) < 0.01);
+
+    return normal(d);
+}
+
+// Time the caching of n random vertices under a rigid transform, by the
+// single-precision kernel and by the double-precision reference. Return false
+// unless both give the same vertices, normals, tangents, and bound.
+
+bool ogl::mesh::bench(int n)
+{
+    const double f = double(SDL_GetPerformanceFrequency()) / 1e9;
+    const int    r = std::max(1, 1000000 / n);
+
+    mesh src;
+
+    srand(1);
+
+    for (int i = 0; i < n; ++i)
+    {
+        GLvec3 v, c, u, t;
+
+        const vec3 N = random_unit();
+        const vec3 T = random_unit();
+
+        for (int k = 0; k < 3; ++k)
+        {
+            v.v[k] = GLfloat(100.0 * rand() / RAND_MAX - 50.0);
+            u.v[k] = GLfloat(double(rand()) / RAND_MAX);
+            c.v[k] = GLfloat(N[k]);
+            t.v[k] = GLfloat(T[k]);
+        }
+        src.add_vert(v, c, u);
+        src.tv.back() = t;
+    }
+
+    const mat4 M = translation(vec3(10.0, -5.0, 3.0))
+                 *   yrotation(to_radians(30.0))
+                 *   xrotation(to_radians(15.0));
+    const mat4 I = inverse(M);
+    const mat4 T = transpose(I);
+
+    mesh a;
+    mesh b;
+
+    // Allocate both outputs before timing.
+
+    a.cache_verts(&src, M, I, 1);
+
+    b.vv.resize(n);
+    b.nv.resize(n);
+    b.tv.resize(n);
+
+    // Single precision.
+
+    Uint64 t0 = SDL_GetPerformanceCounter();
+
+    for (int j = 0; j < r; ++j)
+        a.cache_verts(&src, M, I, 1);
+
+    Uint64 t1 = SDL_GetPerformanceCounter();
+
+    // Double precision reference.
+
+    for (int j = 0; j < r; ++j)
+    {
+        b.bound = aabb();
+
+        for (int i = 0; i < n; ++i)
+        {
+            transform_vertex(b.vv[i].v, M, src.vv[i].v);
+            transform_normal(b.nv[i].v, T, src.nv[i].v);
+            transform_normal(b.tv[i].v, T, src.tv[i].v);
+
+            b.bound.merge(vec3(double(b.vv[i].v[0]),
+                               double(b.vv[i].v[1]),
+                               double(b.vv[i].v[2])));
+        }
+    }
+
+    Uint64 t2 = SDL_GetPerformanceCounter();
+
+    // Compare the results.
+
+    double e = 0.0;
+
+    for (int i = 0; i < n; ++i)
+        for (int k = 0; k < 3; ++k)
+        {
+            e = std::max(e, fabs(double(a.vv[i].v[k] - b.vv[i].v[k])));
+            e = std::max(e, fabs(double(a.nv[i].v[k] - b.nv[i].v[k])));
+            e = std::max(e, fabs(double(a.tv[i].v[k] - b.tv[i].v[k])));
+        }
+
+    const double d = std::max(length(a.bound.min() - b.bound.min()),
+                              length(a.bound.max() - b.bound.max()));
+
+    const bool ok = (e <= 1e-4 && d <= 1e-4);
+
+    etc::log("mesh %7d verts: double %6.2fns float %6.2fns per vertex, "
+             "error %.2g bound error %.2g%s", n,
+             (t2 - t1) / f / (double(r) * n),
+             (t1 - t0) / f / (double(r) * n), e, d, ok ? "" : " MISMATCH");
+
+    return ok;
+}
+
+//-----------------------------------------------------------------------------
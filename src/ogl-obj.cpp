@@ -10,12 +10,29 @@
 //  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
 //  General Public License for more details.
 
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+
+#include <SDL.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include <ogl-obj.hpp>
 #include <ogl-aabb.hpp>
 #include <app-data.hpp>
+#include <app-conf.hpp>
+#include <ogl-binding.hpp>
+#include <etc-task.hpp>
+#include <etc-log.hpp>
 
 //-----------------------------------------------------------------------------
 
@@ -44,41 +61,81 @@ void obj::obj::center()
 
 //-----------------------------------------------------------------------------
 
-static bool token_c(const char *p)
-{
-    return (*p && p[0] == '#');
-}
+// Classify a line by its leading keyword.
 
-static bool token_f(const char *p)
-{
-    return (*p && p[0] == 'f' && isspace(p[1]));
-}
+enum { TOK_NONE, TOK_C, TOK_F, TOK_L, TOK_V, TOK_VT, TOK_VN, TOK_USE };
 
-static bool token_l(const char *p)
+static int token(const char *p)
 {
-    return (*p && p[0] == 'l' && isspace(p[1]));
+    switch (p[0])
+    {
+    case '#': return TOK_C;
+    case 'f': return isspace(p[1]) ? TOK_F : TOK_NONE;
+    case 'l': return isspace(p[1]) ? TOK_L : TOK_NONE;
+    case 'u': return strncmp(p, "usemtl", 6) ? TOK_NONE : TOK_USE;
+    case 'v':
+        switch (p[1])
+        {
+        case 't': return isspace(p[2]) ? TOK_VT : TOK_NONE;
+        case 'n': return isspace(p[2]) ? TOK_VN : TOK_NONE;
+        default : return isspace(p[1]) ? TOK_V  : TOK_NONE;
+        }
+    }
+    return TOK_NONE;
 }
 
-static bool token_v(const char *p)
-{
-    return (*p && p[0] == 'v' && isspace(p[1]));
-}
+static bool token_c  (const char *p) { return token(p) == TOK_C;   }
+static bool token_f  (const char *p) { return token(p) == TOK_F;   }
+static bool token_l  (const char *p) { return token(p) == TOK_L;   }
+static bool token_v  (const char *p) { return token(p) == TOK_V;   }
+static bool token_vn (const char *p) { return token(p) == TOK_VN;  }
+static bool token_vt (const char *p) { return token(p) == TOK_VT;  }
 
-static bool token_vn(const char *p)
-{
-    return (*p && p[0] == 'v' && p[1] == 'n' && isspace(p[2]));
-}
+//-----------------------------------------------------------------------------
 
-static bool token_vt(const char *p)
+#if defined(__SSE2__) || defined(_M_X64)
+
+static inline int first_bit(unsigned m)
 {
-    return (*p && p[0] == 'v' && p[1] == 't' && isspace(p[2]));
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, m);
+    return int(i);
+#else
+    return __builtin_ctz(m);
+#endif
 }
 
-static bool token_use(const char *p)
+// Scan sixteen bytes at a time for a newline or the terminator. The loads are
+// aligned, so they never cross into an unmapped page past the terminator.
+
+static const char *scannl(const char *p)
 {
-    return (*p && !strncmp(p, "usemtl", 6));
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i nu = _mm_setzero_si128();
+
+    const size_t   o = size_t(p) & 15;
+    const __m128i *q = (const __m128i *) (p - o);
+
+    __m128i  c = _mm_load_si128(q);
+    unsigned m = unsigned(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, nl),
+                                                         _mm_cmpeq_epi8(c, nu))));
+    m = (m >> o) << o;
+
+    while (m == 0)
+    {
+        c = _mm_load_si128(++q);
+        m = unsigned(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, nl),
+                                                    _mm_cmpeq_epi8(c, nu))));
+    }
+
+    const char *e = (const char *) q + first_bit(m);
+
+    return (*e == '\n') ? e + 1 : e;
 }
 
+#else
+
 static const char *scannl(const char *p)
 {
     while (1)
@@ -90,17 +147,129 @@ static const char *scannl(const char *p)
         }
 }
 
+#endif
+
+//-----------------------------------------------------------------------------
+
+// Parse a decimal integer as strtol with base 0 would. Octal, hexadecimal, and
+// overlong values are deferred to strtol.
+
+static long scan_int(const char *p, char **e)
+{
+    const char *s = p;
+    bool      neg = false;
+    long        v = 0;
+    int         n = 0;
+
+    while (isspace(*p)) p++;
+
+    if      (*p == '-') { neg = true; p++; }
+    else if (*p == '+') {             p++; }
+
+    if (*p == '0' || !isdigit(*p))
+        return strtol(s, e, 0);
+
+    for (; isdigit(*p); p++)
+    {
+        if (++n > 9) return strtol(s, e, 0);
+        v = v * 10 + (*p - '0');
+    }
+
+    *e = (char *) p;
+    return neg ? -v : v;
+}
+
+// Parse a decimal real number as strtod would. A value of at most 15 digits
+// with a power of ten within 22 is exactly representable in both parts, so a
+// single multiply or divide gives the correctly rounded result. Others are
+// deferred to strtod.
+
+static const double pow10_exact[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double scan_float(const char *p, char **e)
+{
+    const char *s = p;
+    bool      neg = false;
+    bool      any = false;
+    long long   m = 0;
+    int         n = 0;
+    int         k = 0;
+
+    while (isspace(*p)) p++;
+
+    if      (*p == '-') { neg = true; p++; }
+    else if (*p == '+') {             p++; }
+
+    // Accumulate the significant digits and the decimal exponent.
+
+    for (; isdigit(*p); p++, any = true)
+        if (m || *p != '0')
+        {
+            if (++n > 15) return strtod(s, e);
+            m = m * 10 + (*p - '0');
+        }
+
+    if (*p == '.')
+        for (p++; isdigit(*p); p++, any = true, k--)
+            if (m || *p != '0')
+            {
+                if (++n > 15) return strtod(s, e);
+                m = m * 10 + (*p - '0');
+            }
+
+    // Defer infinities, NaNs, and hexadecimal to the library.
+
+    if (!any || *p == 'x' || *p == 'X')
+        return strtod(s, e);
+
+    // Apply any exponent.
+
+    if (*p == 'e' || *p == 'E')
+    {
+        const char *q = p + 1;
+        bool        x = false;
+        int         d = 0;
+
+        if      (*q == '-') { x = true; q++; }
+        else if (*q == '+') {           q++; }
+
+        if (isdigit(*q))
+        {
+            for (; isdigit(*q); q++)
+                if ((d = d * 10 + (*q - '0')) > 9999)
+                    return strtod(s, e);
+
+            k += x ? -d : d;
+            p  = q;
+        }
+    }
+
+    double v = double(m);
+
+    if      (k > 0 && k <=  22) v *= pow10_exact[ k];
+    else if (k < 0 && k >= -22) v /= pow10_exact[-k];
+    else if (k != 0 && m)       return strtod(s, e);
+
+    *e = (char *) p;
+    return neg ? -v : v;
+}
+
+//-----------------------------------------------------------------------------
+
 static const char *scanword(const char *p, std::string& word)
 {
-    // Scan for the beginning of a word.
+    // Scan for the beginning of a word on this line.
 
-    const char *b = p + 6;
-    while ( isspace(*b)) b++;
+    const char *b = p;
+    while (*b == ' ' || *b == '\t') b++;
 
     // Scan for the end of the word.
 
     const char *e = b;
-    while (!isspace(*e)) e++;
+    while (*e && !isspace(*e)) e++;
 
     // Move the point forward.
 
@@ -109,91 +278,279 @@ static const char *scanword(const char *p, std::string& word)
     return e;
 }
 
+// If the comment at p begins with the given keyword, return a pointer to the
+// text following it. Otherwise return null.
+
+static const char *scankey(const char *p, const char *key)
+{
+    const size_t n = strlen(key);
+
+    for (p++; *p == ' ' || *p == '\t'; p++)
+        ;
+
+    if (!strncmp(p, key, n) && (p[n] == 0 || isspace(p[n])))
+        return p + n;
+    else
+        return 0;
+}
+
+static bool scanunit(const char *p, double& scale)
+{
+    // Apply a unit specification comment, if this is one.
+
+    if ((p = scankey(p, "unit")))
+    {
+        std::string val;
+
+        scanword(p, val);
+
+        scale = scale_to_meters(val);
+        return true;
+    }
+    return false;
+}
+
+static bool scanopt(const char *p, int& level)
+{
+    // Apply an optimization level comment, if this is one.
+
+    if ((p = scankey(p, "optimize")))
+    {
+        level = int(strtol(p, 0, 10));
+        return true;
+    }
+    return false;
+}
+
 //-----------------------------------------------------------------------------
 
-const char *obj::obj::read_fi(const char *p, int& i)
+// Scan the next index set specification, converting face indices to vector
+// cache indices given the current cache sizes. An absent element is -1.
+// Return false if there is no next index set.
+
+static bool scan_fi(const char *& p, int& vi, int& si, int& ni,
+                    int vc, int sc, int nc)
 {
-    // Read the next index set specification.
+    char *q;
+
+    if ((vi = int(scan_int(p, &q))))
+    {
+        p = q;
 
-    int  vi = 0;
-    int  si = 0;
-    int  ni = 0;
+        si = 0;
+        ni = 0;
+
+        if (*p == '/') { si = int(scan_int(++p, &q)); p = q; }
+        if (*p == '/') { ni = int(scan_int(++p, &q)); p = q; }
+
+        if (vi < 0) vi += vc; else vi--;
+        if (si < 0) si += sc; else si--;
+        if (ni < 0) ni += nc; else ni--;
+
+        return true;
+    }
+    return false;
+}
+
+static bool scan_li(const char *& p, int& vi, int& si, int vc, int sc)
+{
     char *q;
 
-    if ((vi = int(strtol(p, &q, 0))))
+    if ((vi = int(scan_int(p, &q))))
     {
         p = q;
 
-        if (*p == '/') { si = int(strtol(++p, &q, 0)); p = q; }
-        if (*p == '/') { ni = int(strtol(++p, &q, 0)); p = q; }
+        si = 0;
+
+        if (*p == '/') { si = int(scan_int(++p, &q)); p = q; }
+
+        if (vi < 0) vi += vc; else vi--;
+        if (si < 0) si += sc; else si--;
+
+        return true;
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+// A vertex is entered into the index set hash both under its full v/t/n index
+// triple and under its v/t pair with this wildcard normal. Lines match only
+// the pair, taking the most recent vertex with any normal.
+
+#define ANY_NI INT_MIN
+
+static inline size_t hash_iset(int vi, int si, int ni)
+{
+    GLuint h = GLuint(vi) * 0x9E3779B1u;
+
+    h ^= GLuint(si) * 0x85EBCA77u + (h << 6) + (h >> 2);
+    h ^= GLuint(ni) * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+
+    return size_t(h ^ (h >> 16));
+}
+
+obj::iset::iset()
+{
+    resize(1024);
+}
+
+// Find the slot holding the given index set, or the empty slot where it goes.
+
+size_t obj::iset::locate(int vi, int si, int ni) const
+{
+    const size_t m = slots.size() - 1;
 
-        // Convert face indices to vector cache indices.
+    size_t k = hash_iset(vi, si, ni) & m;
 
-        if (vi < 0) vi += vv.size(); else vi--;
-        if (si < 0) si += sv.size(); else si--;
-        if (ni < 0) ni += nv.size(); else ni--;
+    while (slots[k].i != -1 && (slots[k].vi != vi ||
+                                slots[k].si != si ||
+                                slots[k].ni != ni))
+        k = (k + 1) & m;
 
-        // Return any prior occurrance of this set of cache indices.
+    return k;
+}
 
-        for (i = ii[vi]; i != -1; i = is[i].ii)
-            if (is[i].vi == vi &&
-                is[i].si == si &&
-                is[i].ni == ni) return p;
+// Rehash all entries into a table of n slots. N must be a power of two.
 
-        // These indices are new.  Add a new vertex and link a new index set.
+void obj::iset::resize(size_t n)
+{
+    std::vector<slot>   s(n);
+    std::vector<size_t> u;
 
-        i = int(meshes.back()->count_verts());
+    slots.swap(s);
+    used .swap(u);
 
-        meshes.back()->add_vert((vi < 0) ? z3 : vv[vi],
-                                (ni < 0) ? z3 : nv[ni],
-                                (si < 0) ? z3 : sv[si]);
+    for (size_t k = 0; k < n; ++k)
+        slots[k].i = -1;
 
-        is.push_back(iset(vi, si, ni, ii[vi]));
+    for (size_t k = 0; k < u.size(); ++k)
+    {
+        const slot& o = s[u[k]];
+        size_t      j = locate(o.vi, o.si, o.ni);
 
-        ii[vi] = i;
+        slots[j] = o;
+        used.push_back(j);
     }
-    else i = -1;
+}
 
-    return p;
+int obj::iset::find(int vi, int si, int ni) const
+{
+    return slots[locate(vi, si, ni)].i;
 }
 
-const char *obj::obj::read_li(const char *p, int& i)
+void obj::iset::insert(int vi, int si, int ni, int i)
 {
-    // Read the next index set specification.
+    // Keep the load factor at or below one half.
 
-    int  vi = 0;
-    int  si = 0;
-    char *q;
+    if (2 * (used.size() + 1) > slots.size())
+        resize(2 * slots.size());
+
+    size_t k = locate(vi, si, ni);
 
-    if ((vi = int(strtol(p, &q, 0))))
+    if (slots[k].i == -1)
     {
-        p = q;
+        slots[k].vi = vi;
+        slots[k].si = si;
+        slots[k].ni = ni;
+        used.push_back(k);
+    }
+    slots[k].i = i;
+}
+
+void obj::iset::clear()
+{
+    for (size_t k = 0; k < used.size(); ++k)
+        slots[used[k]].i = -1;
+
+    used.clear();
+}
 
-        if (*p == '/') { si = int(strtol(++p, &q, 0)); p = q; }
+//-----------------------------------------------------------------------------
 
-        // Convert face indices to vector cache indices.
+int obj::obj::face_vert(int vi, int si, int ni)
+{
+    int i;
 
-        if (vi < 0) vi += vv.size(); else vi--;
-        if (si < 0) si += sv.size(); else si--;
+    // Return any prior occurrance of this set of cache indices.
 
-        // Return any prior occurrance of this set of cache indices.
+    if ((i = is.find(vi, si, ni)) != -1)
+        return i;
 
-        for (i = ii[vi]; i != -1; i = is[i].ii)
-            if (is[i].vi == vi &&
-                is[i].si == si) return p;
+    // These indices are new.  Add a new vertex and hash it.
 
-        // These indices are new.  Add a new vertex and link a new index set.
+    i = int(meshes.back()->count_verts());
 
-        i = int(meshes.back()->count_verts());
+    meshes.back()->add_vert((vi < 0) ? z3 : vv[vi],
+                            (ni < 0) ? z3 : nv[ni],
+                            (si < 0) ? z3 : sv[si]);
 
-        meshes.back()->add_vert((vi < 0) ? z3 : vv[vi], z3,
-                                (si < 0) ? z3 : sv[si]);
+    is.insert(vi, si, ni,     i);
+    is.insert(vi, si, ANY_NI, i);
 
-        is.push_back(iset(vi, si, -1, ii[vi]));
+    return i;
+}
 
-        ii[vi] = i;
-    }
-    else i = -1;
+int obj::obj::line_vert(int vi, int si)
+{
+    int i;
+
+    // Return any prior occurrance of this pair of cache indices.
+
+    if ((i = is.find(vi, si, ANY_NI)) != -1)
+        return i;
+
+    // These indices are new.  Add a new vertex and hash it.
+
+    i = int(meshes.back()->count_verts());
+
+    meshes.back()->add_vert((vi < 0) ? z3 : vv[vi], z3,
+                            (si < 0) ? z3 : sv[si]);
+
+    is.insert(vi, si, -1,     i);
+    is.insert(vi, si, ANY_NI, i);
+
+    return i;
+}
+
+void obj::obj::new_mesh(std::string name)
+{
+    meshes.push_back(new ogl::mesh(name));
+
+    // Disallow vertex optimization across mesh boundaries.
+
+    is.clear();
+}
+
+//-----------------------------------------------------------------------------
+
+const char *obj::obj::read_fi(const char *p, int& i)
+{
+    int vi = 0;
+    int si = 0;
+    int ni = 0;
+
+    // Read the next index set specification and find its vertex.
+
+    if (scan_fi(p, vi, si, ni, int(vv.size()), int(sv.size()), int(nv.size())))
+        i = face_vert(vi, si, ni);
+    else
+        i = -1;
+
+    return p;
+}
+
+const char *obj::obj::read_li(const char *p, int& i)
+{
+    int vi = 0;
+    int si = 0;
+
+    // Read the next index set specification and find its vertex.
+
+    if (scan_li(p, vi, si, int(vv.size()), int(sv.size())))
+        i = line_vert(vi, si);
+    else
+        i = -1;
 
     return p;
 }
@@ -206,14 +563,9 @@ const char *obj::obj::read_use(const char *p)
 
     // Create a new mesh using the named material.
 
-    p = scanword(p, name);
+    p = scanword(p + 6, name);
 
-    meshes.push_back(new ogl::mesh(name));
-
-    // Disallow vertex optimization across mesh boundaries?
-
-    for (indx_v::iterator i = ii.begin(); i != ii.end(); ++i)
-        *i = -1;
+    new_mesh(name);
 
     return scannl(p);
 }
@@ -226,13 +578,11 @@ const char *obj::obj::read_c(const char *p)
 
     while (token_c(p))
     {
-        std::string key;
-        std::string val;
-
-        p = scannl(scanword(scanword(p, key), val));
-
-        if (key == "unit") scale = scale_to_meters(val);
+        if (!scanunit(p, scale))
+            scanopt(p, optimize);
+        p = scannl(p);
     }
+
     return p;
 }
 
@@ -245,12 +595,11 @@ const char *obj::obj::read_v(const char *p)
 
     while (token_v(p))
     {
-        v.v[0] = GLfloat(scale * strtod(p + 1, &q)); p = q;
-        v.v[1] = GLfloat(scale * strtod(p,     &q)); p = q;
-        v.v[2] = GLfloat(scale * strtod(p,     &q)); p = scannl(q);
+        v.v[0] = GLfloat(scale * scan_float(p + 1, &q)); p = q;
+        v.v[1] = GLfloat(scale * scan_float(p,     &q)); p = q;
+        v.v[2] = GLfloat(scale * scan_float(p,     &q)); p = scannl(q);
 
-        vv.push_back( v);
-        ii.push_back(-1);
+        vv.push_back(v);
     }
 
     return p;
@@ -265,8 +614,8 @@ const char *obj::obj::read_vt(const char *p)
 
     while (token_vt(p))
     {
-        v.v[0] = GLfloat(strtod(p + 2, &q)); p = q;
-        v.v[1] = GLfloat(strtod(p,     &q)); p = scannl(q);
+        v.v[0] = GLfloat(scan_float(p + 2, &q)); p = q;
+        v.v[1] = GLfloat(scan_float(p,     &q)); p = scannl(q);
         v.v[2] = 0.f;
 
         sv.push_back(v);
@@ -284,9 +633,9 @@ const char *obj::obj::read_vn(const char *p)
 
     while (token_vn(p))
     {
-        v.v[0] = GLfloat(strtod(p + 2, &q)); p = q;
-        v.v[1] = GLfloat(strtod(p,     &q)); p = q;
-        v.v[2] = GLfloat(strtod(p,     &q)); p = scannl(q);
+        v.v[0] = GLfloat(scan_float(p + 2, &q)); p = q;
+        v.v[1] = GLfloat(scan_float(p,     &q)); p = q;
+        v.v[2] = GLfloat(scan_float(p,     &q)); p = scannl(q);
 
         nv.push_back(v);
     }
@@ -307,7 +656,7 @@ const char *obj::obj::read_f(const char *p)
 
     while (token_f(p))
     {
-        std::vector<GLuint> iv;
+        iv.clear();
 
         p++;
 
@@ -341,7 +690,7 @@ const char *obj::obj::read_l(const char *p)
 
     while (token_l(p))
     {
-        std::vector<GLuint> iv;
+        iv.clear();
 
         p++;
 
@@ -366,40 +715,384 @@ const char *obj::obj::read_l(const char *p)
 
 //-----------------------------------------------------------------------------
 
-obj::obj::obj(std::string name, bool c) : scale(1)
+void obj::obj::read_ser(const char *p)
+{
+    // Process data until the end of the file is reached.
+
+    while (*p)
+    {
+        switch (token(p))
+        {
+        case TOK_C:   p = read_c  (p); break;
+        case TOK_F:   p = read_f  (p); break;
+        case TOK_L:   p = read_l  (p); break;
+        case TOK_V:   p = read_v  (p); break;
+        case TOK_VT:  p = read_vt (p); break;
+        case TOK_VN:  p = read_vn (p); break;
+        case TOK_USE: p = read_use(p); break;
+        default:      p = scannl  (p); break;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// The parallel reader splits the file into chunks at line boundaries. A first
+// pass counts the vectors of each chunk so that each may be parsed directly
+// into its place in the vector caches. Faces, lines, and material changes are
+// recorded as resolved cache indices and replayed serially in file order,
+// giving exactly the meshes produced by the serial reader.
+
+enum { REC_FACE, REC_LINE, REC_USE };
+
+struct obj_chunk
+{
+    const char *b;
+    const char *e;
+
+    int    vc, sc, nc;  // Vector counts within this chunk
+    int    v0, s0, n0;  // Vector counts preceding this chunk
+    bool   unit;        // Does this chunk give a unit?
+    int    opt;         // Last optimization level given in this chunk
+    double scale0;      // Scale in effect at the start of this chunk
+    double scale1;      // Scale in effect at the end of this chunk
+
+    std::vector<int>         rec;
+    std::vector<std::string> use;
+};
+
+struct obj_read
+{
+    std::vector<obj_chunk> chunks;
+
+    ogl::GLvec3_d *vv;
+    ogl::GLvec3_d *sv;
+    ogl::GLvec3_d *nv;
+};
+
+static void count_chunk(void *data, int k)
+{
+    obj_chunk& c = ((obj_read *) data)->chunks[k];
+
+    c.vc = c.sc = c.nc = 0;
+    c.unit   = false;
+    c.opt    = -1;
+    c.scale1 = 1.0;
+
+    for (const char *p = c.b; p < c.e; )
+    {
+        switch (token(p))
+        {
+        case TOK_V:  c.vc++; break;
+        case TOK_VT: c.sc++; break;
+        case TOK_VN: c.nc++; break;
+        case TOK_C:
+
+            if (scanunit(p, c.scale1))
+                c.unit = true;
+            else
+                scanopt(p, c.opt);
+            break;
+        }
+
+        p = scannl(p);
+    }
+}
+
+static void parse_chunk(void *data, int k)
+{
+    obj_read  *r = (obj_read *) data;
+    obj_chunk& c = r->chunks[k];
+
+    int    vc    = c.v0;
+    int    sc    = c.s0;
+    int    nc    = c.n0;
+    double scale = c.scale0;
+
+    char *q;
+
+    for (const char *p = c.b; p < c.e; )
+    {
+        int t = token(p);
+
+        switch (t)
+        {
+        case TOK_C:
+
+            scanunit(p, scale);
+            break;
+
+        case TOK_F:
+        case TOK_L:
+            {
+                size_t n  = c.rec.size();
+                int    vi = 0;
+                int    si = 0;
+                int    ni = 0;
+
+                // Record the cache indices of each index set of the element.
+
+                c.rec.push_back(t == TOK_F ? REC_FACE : REC_LINE);
+                c.rec.push_back(0);
+
+                if (t == TOK_F)
+                    for (p++; scan_fi(p, vi, si, ni, vc, sc, nc); c.rec[n + 1]++)
+                    {
+                        c.rec.push_back(vi);
+                        c.rec.push_back(si);
+                        c.rec.push_back(ni);
+                    }
+                else
+                    for (p++; scan_li(p, vi, si, vc, sc); c.rec[n + 1]++)
+                    {
+                        c.rec.push_back(vi);
+                        c.rec.push_back(si);
+                    }
+            }
+            break;
+
+        case TOK_V:
+            {
+                GLfloat *v = (*r->vv)[vc++].v;
+
+                v[0] = GLfloat(scale * scan_float(p + 1, &q)); p = q;
+                v[1] = GLfloat(scale * scan_float(p,     &q)); p = q;
+                v[2] = GLfloat(scale * scan_float(p,     &q)); p = q;
+            }
+            break;
+
+        case TOK_VT:
+            {
+                GLfloat *v = (*r->sv)[sc++].v;
+
+                v[0] = GLfloat(scan_float(p + 2, &q)); p = q;
+                v[1] = GLfloat(scan_float(p,     &q)); p = q;
+                v[2] = 0.f;
+            }
+            break;
+
+        case TOK_VN:
+            {
+                GLfloat *v = (*r->nv)[nc++].v;
+
+                v[0] = GLfloat(scan_float(p + 2, &q)); p = q;
+                v[1] = GLfloat(scan_float(p,     &q)); p = q;
+                v[2] = GLfloat(scan_float(p,     &q)); p = q;
+            }
+            break;
+
+        case TOK_USE:
+            {
+                c.rec.push_back(REC_USE);
+                c.rec.push_back(int(c.use.size()));
+                c.use.push_back(std::string());
+
+                p = scanword(p + 6, c.use.back());
+            }
+            break;
+        }
+        p = scannl(p);
+    }
+}
+
+static void tangent_mesh(void *data, int k)
+{
+    (*((ogl::mesh_v *) data))[k]->calc_tangent();
+}
+
+static void optimize_mesh(void *data, int k)
+{
+    (*((ogl::mesh_v *) data))[k]->optimize(false);
+}
+
+static void optimize_mesh_overdraw(void *data, int k)
+{
+    (*((ogl::mesh_v *) data))[k]->optimize(true);
+}
+
+//-----------------------------------------------------------------------------
+
+void obj::obj::read_par(const char *p, size_t n)
+{
+    obj_read r;
+
+    // Split the file into chunks at line boundaries.
+
+    size_t m = size_t(etc::threads()) * 4;
+
+    r.chunks.resize(m);
+
+    for (size_t k = 0; k < m; ++k)
+    {
+        r.chunks[k].b = (k == 0) ? p : r.chunks[k - 1].e;
+        r.chunks[k].e = (k == m - 1) ? p + n : std::max(r.chunks[k].b,
+                                                        p + n * (k + 1) / m);
+        if (*r.chunks[k].e)
+            r.chunks[k].e = scannl(r.chunks[k].e);
+    }
+
+    // Count the vectors of each chunk and accumulate the chunk offsets.
+
+    etc::parallel(int(m), count_chunk, &r);
+
+    int    vc = int(vv.size());
+    int    sc = int(sv.size());
+    int    nc = int(nv.size());
+    double s  = scale;
+
+    for (size_t k = 0; k < m; ++k)
+    {
+        obj_chunk& c = r.chunks[k];
+
+        c.v0 = vc; vc += c.vc;
+        c.s0 = sc; sc += c.sc;
+        c.n0 = nc; nc += c.nc;
+
+        c.scale0 = s;
+        if (c.unit)
+            s = c.scale1;
+        if (c.opt >= 0)
+            optimize = c.opt;
+    }
+    scale = s;
+
+    // Parse all vectors in place and record all elements.
+
+    vv.resize(vc);
+    sv.resize(sc);
+    nv.resize(nc);
+
+    r.vv = &vv;
+    r.sv = &sv;
+    r.nv = &nv;
+
+    etc::parallel(int(m), parse_chunk, &r);
+
+    // Replay the element records in file order.
+
+    for (size_t k = 0; k < m; ++k)
+    {
+        const obj_chunk& c = r.chunks[k];
+        const int       *d = c.rec.empty() ? 0 : &c.rec.front();
+        const int       *e = d + c.rec.size();
+
+        while (d < e)
+        {
+            if (d[0] == REC_USE)
+            {
+                new_mesh(c.use[d[1]]);
+                d += 2;
+            }
+            else
+            {
+                // Make sure we've got a mesh to receive elements.
+
+                if (meshes.empty())
+                    meshes.push_back(new ogl::mesh());
+
+                int i;
+                int t = d[0];
+                int l = d[1];
+
+                iv.clear();
+                d += 2;
+
+                if (t == REC_FACE)
+                {
+                    for (i = 0; i < l; ++i, d += 3)
+                        iv.push_back(GLuint(face_vert(d[0], d[1], d[2])));
+
+                    for (i = 0; i < l - 2; ++i)
+                        meshes.back()->add_face(iv[0], iv[i + 1], iv[i + 2]);
+                }
+                else
+                {
+                    for (i = 0; i < l; ++i, d += 2)
+                        iv.push_back(GLuint(line_vert(d[0], d[1])));
+
+                    for (i = 0; i < l - 1; ++i)
+                        meshes.back()->add_line(iv[i], iv[i + 1]);
+                }
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+static std::string material(const ogl::mesh *m)
+{
+    return m->state() ? m->state()->get_name() : "";
+}
+
+// Confirm that the parallel reader gave exactly the meshes of the serial one.
+
+void obj::obj::verify(const std::string& name, const char *p)
+{
+    ogl::mesh_v par;
+
+    par.swap(meshes);
+
+    vv.clear();
+    sv.clear();
+    nv.clear();
+    is.clear();
+
+    scale = 1;
+
+    read_ser(p);
+
+    bool ok = (par.size() == meshes.size());
+
+    for (size_t i = 0; ok && i < par.size(); ++i)
+    {
+        std::vector<GLubyte> a;
+        std::vector<GLubyte> b;
+
+        par   [i]->save(a);
+        meshes[i]->save(b);
+
+        ok = (a == b) && (material(par[i]) == material(meshes[i]));
+    }
+
+    if (!ok) etc::log("OBJ parallel read mismatch: %s", name.c_str());
+
+    // Keep the serial result either way.
+
+    for (ogl::mesh_i i = par.begin(); i != par.end(); ++i)
+        delete (*i);
+}
+
+//-----------------------------------------------------------------------------
+
+// Files smaller than this are read serially.
+
+#define PARALLEL_MIN (1024 * 1024)
+
+void obj::obj::read_obj(const std::string& name)
 {
-    // Reserving the vector caches gives only about about 2% improvement.
-/*
-    vv.reserve(1024 * 1024);
-    sv.reserve(1024 * 1024);
-    nv.reserve(1024 * 1024);
-    ii.reserve(1024 * 1024);
-    is.reserve(1024 * 1024);
-*/
     // Initialize the input file.
 
     const char *p = (const char *) ::data->load(name);
+    size_t      n = strlen(p);
 
-    // Process data until the end of the file is reached.
+    // Read it in parallel if possible.
 
-    while (*p)
+    if (::conf && ::conf->get_i("obj_parallel", 1) && etc::threads() > 1
+                                                   && n >= PARALLEL_MIN)
     {
-        if      (token_c  (p)) p = read_c  (p);
-        else if (token_f  (p)) p = read_f  (p);
-        else if (token_l  (p)) p = read_l  (p);
-        else if (token_v  (p)) p = read_v  (p);
-        else if (token_vt (p)) p = read_vt (p);
-        else if (token_vn (p)) p = read_vn (p);
-        else if (token_use(p)) p = read_use(p);
-        else                   p = scannl(p);
+        read_par(p, n);
+
+        if (::conf->get_i("obj_verify", 0))
+            verify(name, p);
     }
+    else read_ser(p);
 
 	// Release the cached data.
 
     vv.clear();
     sv.clear();
     nv.clear();
-    ii.clear();
     is.clear();
 
     // Release the open data file.
@@ -408,8 +1101,214 @@ obj::obj::obj(std::string name, bool c) : scale(1)
 
     // Initialize post-load state.
 
-    for (ogl::mesh_i i = meshes.begin(); i != meshes.end(); ++i)
-        (*i)->calc_tangent();
+    etc::parallel(int(meshes.size()), tangent_mesh, &meshes);
+
+    // Optimize the meshes for the vertex cache and report the result.
+
+    if (optimize < 0)
+        optimize = (::conf ? ::conf->get_i("obj_optimize", 0) : 0);
+
+    if (optimize > 0)
+    {
+        GLsizei fc = 0;
+        GLsizei m0 = 0;
+        GLsizei m1 = 0;
+
+        for (ogl::mesh_i i = meshes.begin(); i != meshes.end(); ++i)
+        {
+            fc += (*i)->count_faces();
+            m0 += (*i)->count_misses();
+        }
+
+        etc::parallel(int(meshes.size()), (optimize > 1) ?
+                      optimize_mesh_overdraw : optimize_mesh, &meshes);
+
+        for (ogl::mesh_i i = meshes.begin(); i != meshes.end(); ++i)
+            m1 += (*i)->count_misses();
+
+        if (fc)
+            etc::log("%s ACMR %.3f -> %.3f", name.c_str(), double(m0) / fc,
+                                                          double(m1) / fc);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// The binary cache holds the final meshes of an OBJ, tagged with the size and
+// modification stamp of the source and the configured optimization level so
+// that a stale cache is never used. All values are native-endian. A change in
+// layout must increment the version.
+
+#define CACHE_MAGIC   0x434A424F // "OBJC"
+#define CACHE_VERSION 4
+
+struct cache_head
+{
+    GLuint    magic;
+    GLuint    version;
+    GLuint    meshes;
+    GLuint    optimize;
+    long long len;
+    long long stamp;
+};
+
+static std::string cache_name(const std::string& name)
+{
+    return name + ".cache";
+}
+
+bool obj::obj::read_cache(const std::string& name, size_t len, long long stamp)
+{
+    const std::string path = cache_name(name);
+    const int         opt  = ::conf->get_i("obj_optimize", 0);
+
+    if (::data->find(path))
+    {
+        size_t         n;
+        const GLubyte *p = (const GLubyte *) ::data->map(path, &n);
+        const GLubyte *e = p + n;
+
+        cache_head h;
+
+        try
+        {
+            // Confirm that the cache is current.
+
+            if (n >= sizeof (cache_head))
+            {
+                memcpy(&h, p, sizeof (cache_head));
+                p +=          sizeof (cache_head);
+
+                if (h.magic   == CACHE_MAGIC   &&
+                    h.version == CACHE_VERSION &&
+                    h.optimize == GLuint(opt) &&
+                    h.len     == (long long) len && h.stamp == stamp)
+                {
+                    // Create each mesh with its material and copy its data.
+
+                    for (GLuint i = 0; i < h.meshes; ++i)
+                    {
+                        GLuint k;
+
+                        if (size_t(e - p) < sizeof (GLuint))
+                            throw std::runtime_error("Truncated mesh cache");
+
+                        memcpy(&k, p, sizeof (GLuint));
+                        p +=          sizeof (GLuint);
+
+                        if (size_t(e - p) < k)
+                            throw std::runtime_error("Truncated mesh cache");
+
+                        std::string material((const char *) p, k);
+                        p += k;
+
+                        meshes.push_back(material.empty() ?
+                                         new ogl::mesh() :
+                                         new ogl::mesh(material));
+
+                        p = meshes.back()->load(p, e);
+                    }
+
+                    ::data->free(path);
+                    return true;
+                }
+            }
+        }
+        catch (std::runtime_error&)
+        {
+            for (ogl::mesh_i i = meshes.begin(); i != meshes.end(); ++i)
+                delete (*i);
+
+            meshes.clear();
+        }
+        ::data->free(path);
+    }
+    return false;
+}
+
+void obj::obj::save_cache(const std::string& name, size_t len,
+                                                   long long stamp) const
+{
+    std::vector<GLubyte> v;
+
+    const int opt = ::conf->get_i("obj_optimize", 0);
+
+    cache_head h;
+
+    h.magic   = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.meshes  = GLuint(meshes.size());
+    h.optimize = GLuint(opt);
+    h.len     = (long long) len;
+    h.stamp   = stamp;
+
+    v.insert(v.end(), (const GLubyte *) &h, (const GLubyte *) (&h + 1));
+
+    // Write each mesh preceded by the name of its material.
+
+    for (ogl::mesh_c i = meshes.begin(); i != meshes.end(); ++i)
+    {
+        const std::string name = material(*i);
+        const GLuint k = GLuint(name.size());
+
+        v.insert(v.end(), (const GLubyte *) &k, (const GLubyte *) (&k + 1));
+        v.insert(v.end(), name.begin(), name.end());
+
+        (*i)->save(v);
+    }
+
+    // The cache is an optimization. Failure to write it is not an error.
+
+    try
+    {
+        size_t n = v.size();
+        ::data->save(cache_name(name), &v.front(), &n);
+    }
+    catch (std::runtime_error&)
+    {
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+obj::obj::obj(std::string name, bool c) : scale(1), optimize(-1)
+{
+    size_t    len   = 0;
+    long long stamp = 0;
+    Uint64    t0    = SDL_GetPerformanceCounter();
+    bool      hit   = false;
+
+    // Use the binary cache if it is current. Otherwise parse and recache.
+
+    bool cache = (::conf && ::conf->get_i("obj_cache", 1)
+                         && ::data->stat(name, &len, &stamp));
+
+    if (!cache || !(hit = read_cache(name, len, stamp)))
+    {
+        read_obj(name);
+
+        if (cache) save_cache(name, len, stamp);
+    }
+
+    // Optionally report the load time, for benchmarking the loader.
+
+    if (::conf && ::conf->get_i("obj_timing", 0))
+    {
+        Uint64 t1 = SDL_GetPerformanceCounter();
+        size_t vc = 0;
+        size_t fc = 0;
+
+        for (ogl::mesh_i i = meshes.begin(); i != meshes.end(); ++i)
+        {
+            vc += (*i)->count_verts();
+            fc += (*i)->count_faces();
+        }
+
+        etc::log("%s %s: %d meshes %d verts %d faces in %.1fms", name.c_str(),
+                 hit ? "cached" : "parsed", int(meshes.size()), int(vc),
+                 int(fc), 1000.0 * double(t1 - t0)
+                                 / double(SDL_GetPerformanceFrequency()));
+    }
 
     // Optionally center the object about the origin.
 
@@ -0,0 +1,376 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+#include <ogl-occlusion.hpp>
+#include <etc-task.hpp>
+
+//-----------------------------------------------------------------------------
+
+// Tile size in pixels, which is also the height of a rasterizer band.
+
+static const int tile = 8;
+
+// Margins covering float rounding, in pixels and in depth.
+
+static const double edge_margin  = 1.0 / 256.0;
+static const double depth_margin = 1.0e-6;
+
+static vec4 lerp(const vec4& a, const vec4& b, double t)
+{
+    return vec4(a[0] + (b[0] - a[0]) * t,
+                a[1] + (b[1] - a[1]) * t,
+                a[2] + (b[2] - a[2]) * t,
+                a[3] + (b[3] - a[3]) * t);
+}
+
+//-----------------------------------------------------------------------------
+
+ogl::occlusion::occlusion(int W, int H) :
+    w(std::max(tile, (W + tile - 1) / tile * tile)),
+    h(std::max(tile, (H + tile - 1) / tile * tile)),
+    depth(w * h, FLT_MAX),
+    tiles((w / tile) * (h / tile), FLT_MAX)
+{
+}
+
+// Begin a new frame with the given world-to-clip transform.
+
+void ogl::occlusion::clear(const mat4& A)
+{
+    T = A;
+    tris.clear();
+}
+
+// Add the triangles of the given vertex list, three vertices each, moved to
+// world space by the given transform.
+
+void ogl::occlusion::add(const mat4& M, const std::vector<vec3>& v)
+{
+    const mat4 A = T * M;
+
+    for (size_t i = 0; i + 2 < v.size(); i += 3)
+        clip(A * vec4(v[i    ], 1),
+             A * vec4(v[i + 1], 1),
+             A * vec4(v[i + 2], 1));
+}
+
+// Rasterize all triangles added since the last clear.
+
+void ogl::occlusion::draw()
+{
+    etc::parallel(h / tile, band, this);
+}
+
+//-----------------------------------------------------------------------------
+
+// Clip a clip-space triangle to the near plane and set up the result.
+
+void ogl::occlusion::clip(const vec4& a, const vec4& b, const vec4& c)
+{
+    const vec4  *p[3] = { &a, &b, &c };
+    const double d[3] = { a[2] + a[3], b[2] + b[3], c[2] + c[3] };
+
+    if (d[0] >= 0 && d[1] >= 0 && d[2] >= 0)
+        setup(a, b, c);
+
+    else if (d[0] >= 0 || d[1] >= 0 || d[2] >= 0)
+    {
+        vec4 q[4];
+        int  n = 0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const int j = (i + 1) % 3;
+
+            if (d[i] >= 0)
+                q[n++] = *p[i];
+            if ((d[i] >= 0) != (d[j] >= 0))
+                q[n++] = lerp(*p[i], *p[j], d[i] / (d[i] - d[j]));
+        }
+
+        if (n >= 3) setup(q[0], q[1], q[2]);
+        if (n == 4) setup(q[0], q[2], q[3]);
+    }
+}
+
+// Project a clipped triangle to the screen and compute its edge functions and
+// conservative depth plane, relative to the first pixel of its bound.
+
+void ogl::occlusion::setup(const vec4& a, const vec4& b, const vec4& c)
+{
+    const vec4 *p[3] = { &a, &b, &c };
+
+    double x[3];
+    double y[3];
+    double z[3];
+
+    for (int k = 0; k < 3; ++k)
+    {
+        const vec4& v = *p[k];
+
+        if (v[3] <= 0)
+            return;
+
+        x[k] = (v[0] / v[3] * 0.5 + 0.5) * w;
+        y[k] = (v[1] / v[3] * 0.5 + 0.5) * h;
+        z[k] = (v[2] / v[3] * 0.5 + 0.5);
+    }
+
+    // Orient the triangle counter-clockwise. A triangle with less than a
+    // pixel of area cannot cover a pixel.
+
+    double s = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+    if (s < 0)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        s = -s;
+    }
+    if (s < 2.0)
+        return;
+
+    // Find the range of pixels that may lie wholly within the triangle.
+
+    const double xa = std::min(std::min(x[0], x[1]), x[2]);
+    const double xz = std::max(std::max(x[0], x[1]), x[2]);
+    const double ya = std::min(std::min(y[0], y[1]), y[2]);
+    const double yz = std::max(std::max(y[0], y[1]), y[2]);
+
+    tri t;
+
+    t.x0 = int(ceil (std::max(xa, 0.0)));
+    t.y0 = int(ceil (std::max(ya, 0.0)));
+    t.x1 = int(floor(std::min(xz, double(w)))) - 1;
+    t.y1 = int(floor(std::min(yz, double(h)))) - 1;
+
+    if (t.x0 > t.x1 || t.y0 > t.y1)
+        return;
+
+    // Offset each edge so that a pixel passes only if its farthest corner
+    // lies inside. Evaluate at pixel centers.
+
+    const double ox = t.x0 + 0.5;
+    const double oy = t.y0 + 0.5;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const int j = (i + 1) % 3;
+
+        const double A = y[i] - y[j];
+        const double B = x[j] - x[i];
+
+        t.ea[i] = float(A);
+        t.eb[i] = float(B);
+        t.ec[i] = float(A * (ox - x[i]) + B * (oy - y[i])
+                      - (0.5 + edge_margin) * (fabs(A) + fabs(B)));
+    }
+
+    // Offset the depth plane to its farthest value within each pixel, and
+    // bound it by the farthest vertex.
+
+    const double dx = ((z[1] - z[0]) * (y[2] - y[0]) -
+                       (z[2] - z[0]) * (y[1] - y[0])) / s;
+    const double dy = ((z[2] - z[0]) * (x[1] - x[0]) -
+                       (z[1] - z[0]) * (x[2] - x[0])) / s;
+
+    t.za = float(dx);
+    t.zb = float(dy);
+    t.zc = float(z[0] + dx * (ox - x[0]) + dy * (oy - y[0])
+                      + 0.5 * (fabs(dx) + fabs(dy)) + depth_margin);
+    t.zz = float(std::max(std::max(z[0], z[1]), z[2]) + depth_margin);
+
+    tris.push_back(t);
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::occlusion::band(void *data, int i)
+{
+    ((occlusion *) data)->band(i);
+}
+
+// Clear and rasterize band i, then find the farthest depth of each of its
+// tiles.
+
+void ogl::occlusion::band(int i)
+{
+    const int y0 = i * tile;
+    const int y1 = i * tile + tile - 1;
+
+    std::fill(depth.begin() + y0 * w, depth.begin() + (y1 + 1) * w, FLT_MAX);
+
+    for (size_t k = 0; k < tris.size(); ++k)
+    {
+        const tri& t = tris[k];
+
+        if (t.y1 < y0 || y1 < t.y0)
+            continue;
+
+        for (int y = std::max(y0, t.y0); y <= std::min(y1, t.y1); ++y)
+        {
+            const float fy = float(y - t.y0);
+
+            const float e0 = t.ec[0] + t.eb[0] * fy;
+            const float e1 = t.ec[1] + t.eb[1] * fy;
+            const float e2 = t.ec[2] + t.eb[2] * fy;
+            const float zr = t.zc    + t.zb    * fy;
+
+            float *row = &depth[y * w];
+            int    x   = t.x0 & ~3;
+
+#ifdef OCCLUSION_SSE
+            // Four pixels at a time. Rows are a multiple of 8 pixels wide.
+
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 step = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+            for (; x <= t.x1; x += 4)
+            {
+                const __m128 fx = _mm_add_ps(_mm_set1_ps(float(x - t.x0)),
+                                             step);
+                const __m128 a0 = _mm_add_ps(_mm_set1_ps(e0),
+                                  _mm_mul_ps(_mm_set1_ps(t.ea[0]), fx));
+                const __m128 a1 = _mm_add_ps(_mm_set1_ps(e1),
+                                  _mm_mul_ps(_mm_set1_ps(t.ea[1]), fx));
+                const __m128 a2 = _mm_add_ps(_mm_set1_ps(e2),
+                                  _mm_mul_ps(_mm_set1_ps(t.ea[2]), fx));
+
+                const __m128 m = _mm_and_ps(_mm_cmpge_ps(a0, zero),
+                                 _mm_and_ps(_mm_cmpge_ps(a1, zero),
+                                            _mm_cmpge_ps(a2, zero)));
+
+                if (_mm_movemask_ps(m))
+                {
+                    const __m128 d = _mm_min_ps(_mm_set1_ps(t.zz),
+                                     _mm_add_ps(_mm_set1_ps(zr),
+                                     _mm_mul_ps(_mm_set1_ps(t.za), fx)));
+                    const __m128 o = _mm_loadu_ps(row + x);
+
+                    _mm_storeu_ps(row + x, _mm_or_ps(
+                                           _mm_and_ps(m, _mm_min_ps(o, d)),
+                                           _mm_andnot_ps(m, o)));
+                }
+            }
+#endif
+            for (; x <= t.x1; ++x)
+            {
+                const float fx = float(x - t.x0);
+
+                if (e0 + t.ea[0] * fx >= 0 &&
+                    e1 + t.ea[1] * fx >= 0 &&
+                    e2 + t.ea[2] * fx >= 0)
+                {
+                    const float d = std::min(t.zz, zr + t.za * fx);
+
+                    if (row[x] > d)
+                        row[x] = d;
+                }
+            }
+        }
+    }
+
+    // Find the farthest depth of each tile of this band.
+
+    for (int tx = 0; tx < w / tile; ++tx)
+    {
+        float m = -FLT_MAX;
+
+        for (int y = y0; y <= y1; ++y)
+            for (int x = tx * tile; x < tx * tile + tile; ++x)
+                m = std::max(m, depth[y * w + x]);
+
+        tiles[i * (w / tile) + tx] = m;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Return false if the given world-space box is certainly hidden. A box that
+// reaches the near plane or lies off-screen is not.
+
+bool ogl::occlusion::test(const aabb& b) const
+{
+    const vec3 a = b.min();
+    const vec3 l = b.length();
+
+    // Transform the minimum corner and the edges meeting there, giving each
+    // corner as a sum.
+
+    const vec4 o = T * vec4(a, 1);
+    const vec4 e[3] = { T * vec4(l[0], 0, 0, 0),
+                        T * vec4(0, l[1], 0, 0),
+                        T * vec4(0, 0, l[2], 0) };
+
+    double xa =  DBL_MAX, ya =  DBL_MAX, za = DBL_MAX;
+    double xz = -DBL_MAX, yz = -DBL_MAX;
+
+    for (int k = 0; k < 8; ++k)
+    {
+        vec4 p = o;
+
+        for (int i = 0; i < 3; ++i)
+            if (k & (1 << i))
+                p = vec4(p[0] + e[i][0], p[1] + e[i][1],
+                         p[2] + e[i][2], p[3] + e[i][3]);
+
+        if (p[3] <= 0 || p[2] + p[3] < 0)
+            return true;
+
+        const double x = (p[0] / p[3] * 0.5 + 0.5) * w;
+        const double y = (p[1] / p[3] * 0.5 + 0.5) * h;
+
+        xa = std::min(xa, x);
+        xz = std::max(xz, x);
+        ya = std::min(ya, y);
+        yz = std::max(yz, y);
+        za = std::min(za, p[2] / p[3] * 0.5 + 0.5);
+    }
+
+    if (xz < 0 || xa >= w || yz < 0 || ya >= h)
+        return true;
+
+    // Test the covered pixels of each tile not wholly nearer than the box.
+
+    const int x0 = std::max(int(floor(xa)), 0);
+    const int y0 = std::max(int(floor(ya)), 0);
+    const int x1 = std::min(int(floor(xz)), w - 1);
+    const int y1 = std::min(int(floor(yz)), h - 1);
+
+    const float d = float(za - depth_margin);
+
+    for (int ty = y0 / tile; ty <= y1 / tile; ++ty)
+        for (int tx = x0 / tile; tx <= x1 / tile; ++tx)
+            if (tiles[ty * (w / tile) + tx] >= d)
+            {
+                for (int y = std::max(y0, ty * tile);
+                         y <= std::min(y1, ty * tile + tile - 1); ++y)
+                    for (int x = std::max(x0, tx * tile);
+                             x <= std::min(x1, tx * tile + tile - 1); ++x)
+                        if (depth[y * w + x] >= d)
+                            return true;
+            }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
@@ -27,6 +27,19 @@ bool ogl::has_depth_stencil;
 bool ogl::has_multisample;
 bool ogl::has_anisotropic;
 bool ogl::has_s3tc;
+bool ogl::has_copy_buffer;
+bool ogl::has_map_buffer_range;
+bool ogl::has_buffer_storage;
+bool ogl::has_half_float_vertex;
+bool ogl::has_instanced_arrays;
+bool ogl::has_texture_buffer;
+bool ogl::has_uniform_buffer;
+bool ogl::has_program_binary;
+bool ogl::has_pixel_buffer;
+bool ogl::has_texture_array;
+bool ogl::has_occlusion_query;
+bool ogl::has_conditional_render;
+bool ogl::has_framebuffer_blit;
 
 int  ogl::max_lights;
 int  ogl::max_anisotropy;
@@ -34,6 +47,13 @@ int  ogl::max_anisotropy;
 bool ogl::do_texture_compression;
 bool ogl::do_hdr_tonemap;
 bool ogl::do_hdr_bloom;
+bool ogl::do_compact_vertex;
+bool ogl::do_instancing;
+bool ogl::do_multidraw;
+bool ogl::do_uniform_block;
+bool ogl::do_program_cache;
+bool ogl::do_texture_array;
+bool ogl::do_occlusion_query;
 
 //-----------------------------------------------------------------------------
 
@@ -45,6 +65,13 @@ static void init_opt()
     ogl::do_texture_compression = false;
     ogl::do_hdr_tonemap         = false;
     ogl::do_hdr_bloom           = false;
+    ogl::do_compact_vertex      = false;
+    ogl::do_instancing          = false;
+    ogl::do_multidraw           = false;
+    ogl::do_uniform_block       = false;
+    ogl::do_program_cache       = false;
+    ogl::do_texture_array       = false;
+    ogl::do_occlusion_query     = false;
 
     // Query GL capabilities.
 
@@ -53,6 +80,37 @@ static void init_opt()
 	ogl::has_anisotropic   = glewIsSupported("GL_EXT_texture_filter_anisotropic") ? true : false;
 	ogl::has_s3tc          = glewIsSupported("GL_EXT_texture_compression_s3tc")   ? true : false;
 
+    ogl::has_copy_buffer       = glewIsSupported("GL_ARB_copy_buffer")       ? true : false;
+    ogl::has_map_buffer_range  = glewIsSupported("GL_ARB_map_buffer_range")  ? true : false;
+    ogl::has_half_float_vertex = glewIsSupported("GL_ARB_half_float_vertex") ? true : false;
+    ogl::has_buffer_storage    = glewIsSupported("GL_ARB_buffer_storage "
+                                                 "GL_ARB_sync")              ? true : false;
+    ogl::has_instanced_arrays  = glewIsSupported("GL_ARB_instanced_arrays "
+                                                 "GL_ARB_draw_instanced")    ? true : false;
+    ogl::has_texture_buffer    = glewIsSupported("GL_ARB_texture_buffer_object "
+                                                 "GL_EXT_gpu_shader4")       ? true : false;
+    ogl::has_uniform_buffer    = glewIsSupported("GL_ARB_uniform_buffer_object") ? true : false;
+    ogl::has_program_binary    = glewIsSupported("GL_ARB_get_program_binary")    ? true : false;
+    ogl::has_pixel_buffer      = glewIsSupported("GL_ARB_pixel_buffer_object")   ? true : false;
+    ogl::has_texture_array     = glewIsSupported("GL_EXT_texture_array "
+                                                 "GL_ARB_copy_image")        ? true : false;
+
+    ogl::has_occlusion_query    = glewIsSupported("GL_VERSION_1_5") ? true : false;
+    ogl::has_conditional_render = glewIsSupported("GL_VERSION_3_0") ? true : false;
+    ogl::has_framebuffer_blit   = glewIsSupported("GL_VERSION_3_0") ||
+                                  glewIsSupported("GL_ARB_framebuffer_object");
+
+    // A driver may support program binaries but offer no format for them.
+
+    if (ogl::has_program_binary)
+    {
+        GLint n = 0;
+
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+
+        ogl::has_program_binary = (n > 0);
+    }
+
     // The light count is constrained by both uniform and varying limits.
 
     GLint maxl;
@@ -83,6 +141,41 @@ static void init_opt()
 
     ogl::do_hdr_tonemap = (::conf->get_i("hdr_tonemap", 0) != 0);
     ogl::do_hdr_bloom   = (::conf->get_i("hdr_bloom",   0) != 0);
+
+    // Quantized vertex data
+
+    if (ogl::has_half_float_vertex && ::conf->get_i("pool_compact", 0))
+        ogl::do_compact_vertex = true;
+
+    // Instanced rendering of repeated surfaces
+
+    if (ogl::has_instanced_arrays && ::conf->get_i("pool_instance", 0) > 0)
+        ogl::do_instancing = true;
+
+    // Multi-draw of all nodes with transforms in a texture buffer
+
+    if (ogl::has_texture_buffer && ::conf->get_i("pool_multidraw", 0))
+        ogl::do_multidraw = true;
+
+    // Shared uniforms in uniform buffer objects
+
+    if (ogl::has_uniform_buffer && ::conf->get_i("uniform_block", 1))
+        ogl::do_uniform_block = true;
+
+    // On-disk cache of linked program binaries
+
+    if (ogl::has_program_binary && ::conf->get_i("program_cache", 1))
+        ogl::do_program_cache = true;
+
+    // Packing of material textures into texture arrays
+
+    if (ogl::has_texture_array && ::conf->get_i("texture_array", 0))
+        ogl::do_texture_array = true;
+
+    // Hardware occlusion queries of pool node bounds
+
+    if (ogl::has_occlusion_query && ::conf->get_i("pool_query", 0))
+        ogl::do_occlusion_query = true;
 }
 
 static void init_state(bool multisample)
@@ -99,6 +192,7 @@ void ogl::init(bool multisample)
 {
     init_opt();
     init_state(multisample);
+    reset_state();
 
     ogl::context = true;
 }
@@ -110,10 +204,108 @@ void ogl::fini()
 
 //-----------------------------------------------------------------------------
 
-#define MAX_TEXTURE_UNITS 16
+// The binding state tracker. Program, texture, and array and element array
+// buffer bindings made through the functions below are cached, and any bind
+// that would not change the current state is skipped and counted. GL calls
+// made elsewhere must not change these bindings, or must call reset_state.
 
-static GLenum current_object[MAX_TEXTURE_UNITS];
+#define MAX_TEXTURE_UNITS   32
+#define MAX_TEXTURE_TARGETS  7
+
+static GLuint current_object[MAX_TEXTURE_UNITS][MAX_TEXTURE_TARGETS];
 static GLenum current_unit = GL_TEXTURE0;
+static GLuint current_program;
+static GLuint current_array;
+static GLuint current_element;
+
+unsigned long long ogl::skip_program = 0;
+unsigned long long ogl::skip_texture = 0;
+unsigned long long ogl::skip_buffer  = 0;
+
+// Return the cache index of a texture target, or -1 if it is not tracked.
+
+static int texture_index(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_1D:           return 0;
+    case GL_TEXTURE_2D:           return 1;
+    case GL_TEXTURE_3D:           return 2;
+    case GL_TEXTURE_CUBE_MAP:     return 3;
+    case GL_TEXTURE_RECTANGLE:    return 4;
+    case GL_TEXTURE_BUFFER_ARB:   return 5;
+    case GL_TEXTURE_2D_ARRAY:     return 6;
+    }
+    return -1;
+}
+
+void ogl::reset_state()
+{
+    // Forget all cached bindings. The next bind of each will go through.
+
+    for (int u = 0; u < MAX_TEXTURE_UNITS; ++u)
+        for (int t = 0; t < MAX_TEXTURE_TARGETS; ++t)
+            current_object[u][t] = GLuint(-1);
+
+    current_unit    = GL_TEXTURE0;
+    current_program = GLuint(-1);
+    current_array   = GLuint(-1);
+    current_element = GLuint(-1);
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::bind_program(GLuint program)
+{
+    if (current_program != program)
+    {
+        current_program  = program;
+        glUseProgram(program);
+    }
+    else skip_program++;
+}
+
+void ogl::bind_buffer(GLenum target, GLuint object)
+{
+    // Only the array and element array bindings are tracked.
+
+    GLuint *p = 0;
+
+    if      (target == GL_ARRAY_BUFFER)         p = &current_array;
+    else if (target == GL_ELEMENT_ARRAY_BUFFER) p = &current_element;
+
+    if (p && *p == object)
+        skip_buffer++;
+    else
+    {
+        if (p) *p = object;
+        glBindBuffer(target, object);
+    }
+}
+
+void ogl::drop_program(GLuint program)
+{
+    // Forget a program about to be deleted, as its name may be reused.
+
+    if (current_program == program)
+        current_program = GLuint(-1);
+}
+
+void ogl::drop_buffer(GLuint object)
+{
+    if (current_array   == object) current_array   = GLuint(-1);
+    if (current_element == object) current_element = GLuint(-1);
+}
+
+void ogl::drop_texture(GLuint object)
+{
+    for (int u = 0; u < MAX_TEXTURE_UNITS; ++u)
+        for (int t = 0; t < MAX_TEXTURE_TARGETS; ++t)
+            if (current_object[u][t] == object)
+                current_object[u][t] = GLuint(-1);
+}
+
+//-----------------------------------------------------------------------------
 
 void ogl::curr_texture(GLenum unit)
 {
@@ -131,26 +323,29 @@ void ogl::bind_texture(GLenum target, GLenum unit, GLuint object)
 {
     // Bind a texture OBJECT to TARGET of texture UNIT with as little state
     // change as possible.  If UNIT is zero, then use whatever is current.
-/*
+    // The current unit is restored afterward.
+
     int u = unit ? int(unit         - GL_TEXTURE0)
                  : int(current_unit - GL_TEXTURE0);
+    int t = texture_index(target);
 
-    if (current_object[u] != object)
+    if (0 <= t && 0 <= u && u < MAX_TEXTURE_UNITS)
     {
-        current_object[u]  = object;
-        curr_texture(unit);
-
-        glBindTexture(target, object);
+        if (current_object[u][t] == object)
+        {
+            skip_texture++;
+            return;
+        }
+        current_object[u][t] = object;
     }
-*/
 
-    if (unit == GL_TEXTURE0) // HACK: the above optimization breaks user code.
+    if (unit == 0 || unit == current_unit)
         glBindTexture(target, object);
     else
     {
         glActiveTexture(unit);
         glBindTexture(target, object);
-        glActiveTexture(GL_TEXTURE0);
+        glActiveTexture(current_unit);
     }
 }
 
@@ -168,7 +363,11 @@ void ogl::xfrm_texture(GLenum unit, const GLdouble *M)
 
 void ogl::free_texture()
 {
-    for (int u = MAX_TEXTURE_UNITS - 1; u >= 0; --u)
+    GLint n = 0;
+
+    glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &n);
+
+    for (int u = std::min(int(n), MAX_TEXTURE_UNITS) - 1; u >= 0; --u)
     {
         glActiveTexture(GL_TEXTURE0 + u);
 
@@ -178,7 +377,21 @@ void ogl::free_texture()
         glBindTexture(GL_TEXTURE_CUBE_MAP,  0);
         glBindTexture(GL_TEXTURE_RECTANGLE, 0);
 
-        current_object[u] = 0;
+        if (ogl::has_texture_array)
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // Forget everything, then note the bindings just made.
+
+    reset_state();
+
+    for (int u = std::min(int(n), MAX_TEXTURE_UNITS) - 1; u >= 0; --u)
+    {
+        for (int t = 0; t < 5; ++t)
+            current_object[u][t] = 0;
+
+        if (ogl::has_texture_array)
+            current_object[u][6] = 0;
     }
 }
 
@@ -10,18 +10,17 @@
 //  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
 //  General Public License for more details.
 
+#include <algorithm>
+#include <cstring>
+
 #include <etc-vector.hpp>
+#include <app-conf.hpp>
 #include <app-glob.hpp>
+#include <etc-task.hpp>
 #include <ogl-pool.hpp>
 
 //=============================================================================
 
-#define get_bit(b, i) (((b) >> ((i)    )) & 1)
-#define get_oct(b, i) (((b) >> ((i) * 3)) & 7)
-
-#define set_bit(b, i, n) (((b) & (~(1 << ((i)    )))) | ((n) << ((i)    )))
-#define set_oct(b, i, n) (((b) & (~(7 << ((i) * 3)))) | ((n) << ((i) * 3)))
-
 //-----------------------------------------------------------------------------
 
 ogl::elem::elem(const binding *b,
@@ -76,6 +75,162 @@ void ogl::elem::draw(bool color) const
     glDrawRangeElements(typ, min, max, num, GL_UNSIGNED_INT, off);
 }
 
+void ogl::elem::draw(bool color, GLsizei n) const
+{
+    // Bind this batch's state and render n instances of all elements.
+
+    if (bnd)
+        bnd->bind(color);
+
+    glDrawElementsInstancedARB(typ, num, GL_UNSIGNED_INT, off, n);
+}
+
+void ogl::elem::queue(multi_m& batch) const
+{
+    // Append this batch's elements to the multi-draw of its state.
+
+    multi& m = batch[multi_k(bnd, typ)];
+
+    m.num.push_back(num);
+    m.off.push_back(off);
+}
+
+// Select the batch vector for the given draw mode.
+
+static void select(const ogl::elem_v& opaque_depth,
+                   const ogl::elem_v& opaque_color,
+                   const ogl::elem_v& masked_depth,
+                   const ogl::elem_v& masked_color, bool color, bool alpha,
+                   ogl::elem_i& b, ogl::elem_i& e)
+{
+    if (color)
+        if (alpha) { b = masked_color.begin(); e = masked_color.end(); }
+        else       { b = opaque_color.begin(); e = opaque_color.end(); }
+    else
+        if (alpha) { b = masked_depth.begin(); e = masked_depth.end(); }
+        else       { b = opaque_depth.begin(); e = opaque_depth.end(); }
+}
+
+// Draw each non-empty multi-draw batch with its state.
+
+static void draw_multi(const ogl::multi_m& batch, bool color)
+{
+    for (ogl::multi_m::const_iterator i = batch.begin(); i != batch.end(); ++i)
+        if (!i->second.num.empty())
+        {
+            if (i->first.first)
+                i->first.first->bind(color);
+
+            glMultiDrawElements(i->first.second, &i->second.num.front(),
+                                GL_UNSIGNED_INT, &i->second.off.front(),
+                                GLsizei(i->second.num.size()));
+        }
+}
+
+// Empty each multi-draw batch, keeping the storage of the map.
+
+static void clear_multi(ogl::multi_m& batch)
+{
+    for (ogl::multi_m::iterator i = batch.begin(); i != batch.end(); ++i)
+    {
+        i->second.num.clear();
+        i->second.off.clear();
+    }
+}
+
+// Return the near clipping plane of the current projection and modelview.
+
+static vec4 get_near()
+{
+    mat4 P;
+    mat4 V;
+
+    glGetDoublev(GL_PROJECTION_MATRIX, &P[0][0]);
+    glGetDoublev(GL_MODELVIEW_MATRIX,  &V[0][0]);
+
+    const mat4 A = transpose(P) * transpose(V);
+
+    return vec4(A[3][0] + A[2][0], A[3][1] + A[2][1],
+                A[3][2] + A[2][2], A[3][3] + A[2][3]);
+}
+
+//-----------------------------------------------------------------------------
+
+// Set the current values of the per-instance attributes, 9 through 12, to the
+// first three rows of the given transform and the given unit ID. Uninstanced
+// geometry is drawn with the identity and an ID of -1.
+
+static void set_instance(const mat4& T, double id)
+{
+    glVertexAttrib4d( 9, T[0][0], T[0][1], T[0][2], T[0][3]);
+    glVertexAttrib4d(10, T[1][0], T[1][1], T[1][2], T[1][3]);
+    glVertexAttrib4d(11, T[2][0], T[2][1], T[2][2], T[2][3]);
+    glVertexAttrib4d(12, id, 0.0, 0.0, 0.0);
+}
+
+// Set the current value of attribute 5 to the given quantization.
+
+static void set_quant(const mat4& Q)
+{
+    glVertexAttrib4d(5, Q[0][3], Q[1][3], Q[2][3], Q[0][0]);
+}
+
+//-----------------------------------------------------------------------------
+
+// Return the batch sort key of a source mesh: its binding's key, with bit 15
+// set to keep line-only meshes apart from faces, allowing maximal merging.
+
+static unsigned long long mesh_key(const ogl::mesh *m)
+{
+    unsigned long long k = m->state() ? m->state()->get_key() : 0;
+
+    if (m->count_faces() == 0 && m->count_lines() > 0)
+        k |= 0x8000;
+
+    return k;
+}
+
+// Sort the given caches by key using a stable LSD radix sort, eight bits at a
+// time, skipping each digit shared by all keys.
+
+static void sort_caches(ogl::cache_v& v)
+{
+    if (v.size() > 1)
+    {
+        ogl::cache_v t(v);
+
+        for (int d = 0; d < 64; d += 8)
+        {
+            size_t c[256];
+
+            std::fill(c, c + 256, 0);
+
+            for (ogl::cache_c i = v.begin(); i != v.end(); ++i)
+                c[(i->key >> d) & 0xFF]++;
+
+            if (c[(v.front().key >> d) & 0xFF] == v.size())
+                continue;
+
+            for (size_t j = 0, o = 0; j < 256; ++j)
+            {
+                size_t n = c[j];
+                c[j] = o;
+                o   += n;
+            }
+
+            for (ogl::cache_c i = v.begin(); i != v.end(); ++i)
+                t[c[(i->key >> d) & 0xFF]++] = *i;
+
+            v.swap(t);
+        }
+    }
+}
+
+static bool unit_lt(const ogl::unit *a, const ogl::unit *b)
+{
+    return a->get_id() < b->get_id();
+}
+
 //=============================================================================
 
 int ogl::unit::serial = 0;
@@ -88,7 +243,10 @@ ogl::unit::unit(std::string name, bool center) :
     rebuff(true),
     active(true),
     ubiquitous(false),
-    surf(glob->load_surface(name, center))
+    surf(glob->load_surface(name, center)),
+    my_inst(0),
+    occluder(false),
+    reoccl(true)
 {
     set_mesh();
 }
@@ -101,7 +259,10 @@ ogl::unit::unit(const unit& that) :
     rebuff(true),
     active(true),
     ubiquitous(false),
-    surf(glob->dupe_surface(that.surf))
+    surf(glob->dupe_surface(that.surf)),
+    my_inst(0),
+    occluder(that.occluder),
+    reoccl(true)
 {
     M = that.M;
     I = that.I;
@@ -113,8 +274,8 @@ ogl::unit::~unit()
 {
     // Delete all cache meshes.
 
-    for (mesh_m::iterator i = my_mesh.begin(); i != my_mesh.end(); ++i)
-        delete i->second;
+    for (cache_i i = my_mesh.begin(); i != my_mesh.end(); ++i)
+        delete i->dst;
 
     glob->free_surface(surf);
 }
@@ -127,20 +288,46 @@ ogl::unit::~unit()
 
 void ogl::unit::draw_lines() const
 {
-    for (mesh_m::const_iterator i = my_mesh.begin(); i != my_mesh.end(); ++i)
+    const cache_v& meshes = my_inst ? my_inst->meshes : my_mesh;
+
+    set_attr();
+
+    for (cache_c i = meshes.begin(); i != meshes.end(); ++i)
     {
-        i->first->state()->bind(true);
-        i->second->draw_lines();
+        i->src->state()->bind(true);
+        i->dst->draw_lines();
     }
+
+    if (my_inst) set_instance(mat4(), -1.0);
 }
 
 void ogl::unit::draw_faces() const
 {
-    for (mesh_m::const_iterator i = my_mesh.begin(); i != my_mesh.end(); ++i)
+    const cache_v& meshes = my_inst ? my_inst->meshes : my_mesh;
+
+    set_attr();
+
+    for (cache_c i = meshes.begin(); i != meshes.end(); ++i)
+    {
+        i->src->state()->bind(true);
+        i->dst->draw_faces();
+    }
+
+    if (my_inst) set_instance(mat4(), -1.0);
+}
+
+// Set the attributes giving the quantization of this unit's vertex data and,
+// if it is instanced, its transform.
+
+void ogl::unit::set_attr() const
+{
+    if (my_inst)
     {
-        i->first->state()->bind(true);
-        i->second->draw_faces();
+        set_quant(my_inst->Q);
+        set_instance(M, id);
     }
+    else if (my_node)
+        set_quant(my_node->get_quantization());
 }
 
 // Return a default binding for this unit. For determinism, this should only be
@@ -148,7 +335,7 @@ void ogl::unit::draw_faces() const
 
 const ogl::binding *ogl::unit::get_default_binding() const
 {
-    return my_mesh.empty() ? 0 : my_mesh.begin()->first->state();
+    return my_mesh.empty() ? 0 : my_mesh.begin()->src->state();
 }
 
 //-----------------------------------------------------------------------------
@@ -161,7 +348,7 @@ void ogl::unit::set_mesh()
     {
         const mesh *m = surf->get_mesh(i);
 
-        my_mesh.insert(mesh_m::value_type(m, new mesh));
+        my_mesh.push_back(cache(m, new mesh, mesh_key(m)));
 
         vc += m->count_verts();
         ec += m->count_lines() * 2
@@ -188,6 +375,22 @@ void ogl::unit::set_ubiq(bool b)
     ubiquitous = b;
 }
 
+// Choose this unit as an occluder, contributing all of its opaque faces.
+
+void ogl::unit::set_occl(bool b)
+{
+    occluder = b;
+    reoccl   = true;
+}
+
+// Set the instance group drawing this unit, if any.
+
+void ogl::unit::set_inst(const inst *p)
+{
+    my_inst = p;
+    rebuff  = true;
+}
+
 //-----------------------------------------------------------------------------
 
 void ogl::unit::transform(const mat4& M, const mat4& I)
@@ -201,6 +404,11 @@ void ogl::unit::transform(const mat4& M, const mat4& I)
     rebuff = true;
 }
 
+void ogl::unit::set_rebuff()
+{
+    rebuff = true;
+}
+
 mat4 ogl::unit::get_world_transform() const
 {
     return my_node->get_world_transform() * M;
@@ -208,11 +416,78 @@ mat4 ogl::unit::get_world_transform() const
 
 //-----------------------------------------------------------------------------
 
-void ogl::unit::merge_batch(mesh_m& meshes)
+// Select the opaque faces this unit contributes to occlusion. A unit not
+// chosen as an occluder is simplified to its few largest faces, and only
+// those large enough to hide something. Any subset of the faces of a unit
+// occludes no more than the whole.
+
+void ogl::unit::find_occl()
+{
+    std::vector<std::pair<double, size_t> > a;
+    std::vector<vec3>                       v;
+
+    for (size_t i = 0; surf && i < surf->max_mesh(); ++i)
+    {
+        const mesh *m = surf->get_mesh(i);
+
+        if (m->state() && !m->state()->opaque())
+            continue;
+
+        const GLvec3_v& p = m->get_verts();
+        const face_v&   f = m->get_faces();
+
+        for (face_c j = f.begin(); j != f.end(); ++j)
+        {
+            const vec3 x(p[j->i].v[0], p[j->i].v[1], p[j->i].v[2]);
+            const vec3 y(p[j->j].v[0], p[j->j].v[1], p[j->j].v[2]);
+            const vec3 z(p[j->k].v[0], p[j->k].v[1], p[j->k].v[2]);
+
+            a.push_back(std::make_pair(length(cross(y - x, z - x)) / 2,
+                                       v.size()));
+            v.push_back(x);
+            v.push_back(y);
+            v.push_back(z);
+        }
+    }
+
+    occl.clear();
+
+    if (occluder)
+        occl.swap(v);
+    else
+    {
+        const size_t n = ::conf->get_i("pool_occlusion_faces", 16);
+        const double s = ::conf->get_f("pool_occlusion_area",  0.5);
+
+        std::sort(a.rbegin(), a.rend());
+
+        for (size_t k = 0; k < n && k < a.size() && a[k].first >= s; ++k)
+            occl.insert(occl.end(), v.begin() + a[k].second,
+                                    v.begin() + a[k].second + 3);
+    }
+    reoccl = false;
+}
+
+// Add the occluder faces of this unit to the given depth buffer.
+
+void ogl::unit::occlude(occlusion& o)
+{
+    if (reoccl)
+        find_occl();
+
+    if (active && !occl.empty())
+        o.add(get_world_transform(), occl);
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::unit::merge_batch(cache_v& meshes)
 {
-    // Merge local meshes with the given set.  Meshes are sorted by material.
+    // Append local meshes to the given list. Instanced units are merged by
+    // their group instead.
 
-    if (active) meshes.insert(my_mesh.begin(), my_mesh.end());
+    if (active && !my_inst)
+        meshes.insert(meshes.end(), my_mesh.begin(), my_mesh.end());
 }
 
 #if 0
@@ -231,12 +506,27 @@ void ogl::unit::buff(bool b)
     {
         my_aabb = aabb();
 
-        // Transform and cache each mesh.  Accumulate bounding volumes.
+        if (my_inst)
+        {
+            // An instanced unit caches nothing. Transform the surface bound.
+
+            aabb b;
 
-        for (mesh_m::iterator i = my_mesh.begin(); i != my_mesh.end(); ++i)
+            for (size_t i = 0; surf && i < surf->max_mesh(); ++i)
+                b.merge(surf->get_mesh(i)->get_bound());
+
+            if (b.isvalid())
+                my_aabb = aabb(b, M);
+        }
+        else
         {
-            i->second->cache_verts(i->first, M, I, get_id());
-            my_aabb.merge(i->second->get_bound());
+            // Transform and cache each mesh.  Accumulate bounding volumes.
+
+            for (cache_i i = my_mesh.begin(); i != my_mesh.end(); ++i)
+            {
+                i->dst->cache_verts(i->src, M, I, get_id());
+                my_aabb.merge(i->dst->get_bound());
+            }
         }
     }
     rebuff = false;
@@ -244,17 +534,36 @@ void ogl::unit::buff(bool b)
 
 //=============================================================================
 
+ogl::inst::~inst()
+{
+    for (cache_i i = meshes.begin(); i != meshes.end(); ++i)
+        delete i->dst;
+}
+
+//=============================================================================
+
 ogl::node::node() :
     vc(0), ec(0),
+    vs(0), es(0),
+    vbase(-1),
+    ebase(-1),
+    sbase(-1),
+    resort(true),
     rebuff(true),
-    my_pool(0),
-    test_cache(0xFFFFFFFF),
-    hint_cache(0x00000000)
+    reinst(false),
+    rebound(false),
+    leaf(-1),
+    version(0),
+    my_pool(0)
 {
 }
 
 ogl::node::~node()
 {
+    if (ogl::context) drop_query();
+
+    ungroup();
+
     for (unit_s::iterator i = my_unit.begin(); i != my_unit.end(); ++i)
         delete (*i);
 }
@@ -271,11 +580,22 @@ void ogl::node::set_rebuff()
 {
     if (my_pool) my_pool->set_rebuff();
     rebuff = true;
+    version++;
 }
 
 void ogl::node::set_resort()
 {
     if (my_pool) my_pool->set_resort();
+    resort = true;
+    version++;
+}
+
+// Set the offsets of this node's vertex and element ranges in its pool.
+
+void ogl::node::set_range(GLsizei v, GLsizei e)
+{
+    vbase = v;
+    ebase = e;
 }
 
 //-----------------------------------------------------------------------------
@@ -283,6 +603,7 @@ void ogl::node::set_resort()
 void ogl::node::set_pool(pool_p p)
 {
     my_pool = p;
+    test_cache.clear();
 }
 
 void ogl::node::add_unit(unit_p p)
@@ -302,9 +623,9 @@ void ogl::node::add_unit(unit_p p)
         if (my_pool) my_pool->add_vcount(+p->vcount());
         if (my_pool) my_pool->add_ecount(+p->ecount());
 
-        // Mark this node's pool for a resort.
+        // Mark this node and its pool for a resort.
 
-        if (my_pool) my_pool->set_resort();
+        set_resort();
     }
 }
 
@@ -312,6 +633,10 @@ void ogl::node::rem_unit(unit_p p)
 {
     if (p && my_unit.find(p) != my_unit.end())
     {
+        // Dissolve any instance groups, which will be regrouped on resort.
+
+        if (p->get_inst()) ungroup();
+
         // Erase the given unit from the unit set.
 
         my_unit.erase(p);
@@ -325,218 +650,1029 @@ void ogl::node::rem_unit(unit_p p)
         if (my_pool) my_pool->add_vcount(-p->vcount());
         if (my_pool) my_pool->add_ecount(-p->ecount());
 
-        // Mark this node's pool for a resort.
+        // Mark this node and its pool for a resort.
 
-        if (my_pool) my_pool->set_resort();
+        set_resort();
     }
 }
 
 //-----------------------------------------------------------------------------
 
-void ogl::node::buff(GLfloat *v, GLfloat *n, GLfloat *t, GLfloat *u, bool b)
+// Group active units sharing a surface, if there are at least k of them, for
+// instanced rendering. Determine the vertex and element counts of the result,
+// which include each grouped surface only once.
+
+void ogl::node::group(int k)
 {
-    if (b || rebuff)
+    ungroup();
+
+    if (k > 0)
     {
-        // Have each unit pretransform its vertex data and compute its bound.
+        typedef std::map<const surface *, unit_v> surf_m;
 
-        my_aabb = aabb();
+        surf_m S;
 
         for (unit_s::iterator i = my_unit.begin(); i != my_unit.end(); ++i)
-        {
-            (*i)->buff(b);
-            my_aabb.merge((*i)->get_bound());
-        }
+            if ((*i)->is_mode() && (*i)->get_surf())
+                S[(*i)->get_surf()].push_back(*i);
 
-        // Upload each mesh's vertex data to the bound buffer object.
+        for (surf_m::iterator i = S.begin(); i != S.end(); ++i)
+            if (i->second.size() >= size_t(k))
+            {
+                inst *g = new inst(i->first);
 
-        for (mesh_m::iterator i = my_mesh.begin(); i != my_mesh.end(); ++i)
-        {
-            const GLsizei vc = i->second->count_verts();
+                g->units = i->second;
 
-            i->second->buffv(v, n, t, u);
+                for (size_t j = 0; j < i->first->max_mesh(); ++j)
+                {
+                    const mesh *m = i->first->get_mesh(j);
+                    g->meshes.push_back(cache(m, new mesh, mesh_key(m)));
+                }
+                sort_caches(g->meshes);
 
-            v += vc * 3;
-            n += vc * 3;
-            t += vc * 3;
-            u += vc * 3;
-        }
-    }
-    rebuff = false;
-}
+                for (unit_v::iterator j = g->units.begin();
+                                      j != g->units.end(); ++j)
+                    (*j)->set_inst(g);
 
-void ogl::node::sort(GLuint *e, GLuint d)
-{
-    // Create a list of all meshes of this node, sorted by material.
+                my_inst.push_back(g);
+            }
+    }
 
-    my_mesh.clear();
-    ubiquitous = false;
+    vs = 0;
+    es = 0;
 
     for (unit_s::iterator i = my_unit.begin(); i != my_unit.end(); ++i)
+        if ((*i)->get_inst() == 0)
+        {
+            vs += (*i)->vcount();
+            es += (*i)->ecount();
+        }
+
+    for (inst_v::iterator i = my_inst.begin(); i != my_inst.end(); ++i)
     {
-        (*i)->merge_batch(my_mesh);
-        ubiquitous |= (*i)->is_ubiq();
+        vs += (*i)->units.front()->vcount();
+        es += (*i)->units.front()->ecount();
     }
+}
 
-    // Create a list of all element batches of this node.
-
-    elem_v my_elem;
+// Release all instance groups.
 
-    for (mesh_m::iterator i = my_mesh.begin(); i != my_mesh.end(); ++i)
+void ogl::node::ungroup()
+{
+    for (inst_v::iterator i = my_inst.begin(); i != my_inst.end(); ++i)
     {
-        const GLsizei dc = i->first->count_verts();
-        const GLsizei fc = i->first->count_faces() * 3;
-        const GLsizei lc = i->first->count_lines() * 2;
-
-        // Cache each offset mesh.
-
-        i->second->cache_faces(i->first, d);
-        i->second->cache_lines(i->first, d);
+        for (unit_v::iterator j = (*i)->units.begin();
+                              j != (*i)->units.end(); ++j)
+            (*j)->set_inst(0);
 
-        // Upload elements to the bound buffer object.
-
-        i->second->buffe(e);
-
-        // Create a batch for each set of primatives.
-
-        if (fc) my_elem.push_back(elem(i->first->state(), e, GL_TRIANGLES, fc,
-                                       i->second->get_min(),
-                                       i->second->get_max()));
-        e += fc;
-
-        if (lc) my_elem.push_back(elem(i->first->state(), e, GL_LINES,     lc,
-                                       i->second->get_min(),
-                                       i->second->get_max()));
-        e += lc;
-        d += dc;
+        delete (*i);
     }
+    my_inst.clear();
+    instances.clear();
+}
 
-    // Create a minimal vector of batches for each draw mode.
-
-    opaque_depth.clear();
-    opaque_color.clear();
-    masked_depth.clear();
-    masked_color.clear();
+// Gather the transform and unit ID of each instance, as rows of 16 floats,
+// for the pool's instance buffer.
 
-    for (elem_v::iterator i = my_elem.begin(); i != my_elem.end(); ++i)
+void ogl::node::buff_inst()
+{
+    if (!my_inst.empty())
     {
-        if (i->opaque())
-        {
-            // Opaque depth batches
-
-            if (opaque_depth.empty() || !opaque_depth.back().depth_eq(*i))
-                opaque_depth.push_back(*i);
-            else
-                opaque_depth.back().merge(*i);
+        instances.clear();
 
-            // Opaque color batches
-
-            if (opaque_color.empty() || !opaque_color.back().color_eq(*i))
-                opaque_color.push_back(*i);
-            else
-                opaque_color.back().merge(*i);
-        }
-        else
-        {
-            // Masked depth batches
+        for (inst_v::iterator i = my_inst.begin(); i != my_inst.end(); ++i)
+            for (unit_v::iterator j = (*i)->units.begin();
+                                  j != (*i)->units.end(); ++j)
+            {
+                const mat4& T = (*j)->get_transform();
 
-            if (masked_depth.empty() || !masked_depth.back().depth_eq(*i))
-                masked_depth.push_back(*i);
-            else
-                masked_depth.back().merge(*i);
+                for (int r = 0; r < 3; ++r)
+                    for (int c = 0; c < 4; ++c)
+                        instances.push_back(GLfloat(T[r][c]));
 
-            // Masked color batches
+                instances.push_back(GLfloat((*j)->get_id()));
+                instances.push_back(0.0f);
+                instances.push_back(0.0f);
+                instances.push_back(0.0f);
+            }
 
-            if (masked_color.empty() || !masked_color.back().color_eq(*i))
-                masked_color.push_back(*i);
-            else
-                masked_color.back().merge(*i);
-        }
+        reinst = true;
     }
 }
 
-//-----------------------------------------------------------------------------
-
-void ogl::node::transform(const mat4& M)
+const GLfloat *ogl::node::get_instances() const
 {
-    this->M = M;
+    return instances.empty() ? 0 : &instances.front();
 }
 
-mat4 ogl::node::get_world_transform() const
+// Set the offset of this node's first instance in the pool's instance buffer.
+
+void ogl::node::set_ibase(GLsizei b)
 {
-    return M;
+    for (inst_v::iterator i = my_inst.begin(); i != my_inst.end(); ++i)
+    {
+        (*i)->ibase = b;
+        b += GLsizei((*i)->units.size());
+    }
+    reinst = false;
 }
 
-//-----------------------------------------------------------------------------
+// Set the index of this node's first transform slot. The node's own meshes use
+// this slot and each instance group uses one of the following.
 
-ogl::aabb ogl::node::view(int id, const vec4 *V, int n)
+void ogl::node::set_sbase(GLsizei b)
 {
-    if (!ubiquitous)
-    {
-        // Get the cached culler hint.
+    sbase = b;
+}
+
+// Queue the slot index of each vertex for upload to the given slot plane.
 
-        int bit, hint = get_oct(hint_cache, id);
+void ogl::node::index(GLfloat *k, stream& s)
+{
+    GLsizei n = 0;
 
-        // Test the bounding box and set the visibility bit.
+    slots.clear();
 
-        if (V == 0 || my_aabb.test(V, n, M, hint))
-            test_cache = set_bit(test_cache, id, (bit = 1));
-        else
-            test_cache = set_bit(test_cache, id, (bit = 0));
+    for (cache_i i = my_mesh.begin(); i != my_mesh.end(); ++i)
+        n += i->dst->count_verts();
 
-        // Set the cached culler hint.
+    slots.insert(slots.end(), n, GLfloat(sbase));
 
-        hint_cache = set_oct(hint_cache, id, hint);
+    for (size_t j = 0; j < my_inst.size(); ++j)
+    {
+        n = 0;
 
-        // If this node is visible, return the world-space AABB.
+        for (cache_i i = my_inst[j]->meshes.begin();
+                              i != my_inst[j]->meshes.end(); ++i)
+            n += i->dst->count_verts();
 
-        if (bit && V)
-            return ogl::aabb(my_aabb, M);
+        slots.insert(slots.end(), n, GLfloat(sbase + 1 + j));
     }
-    return ogl::aabb();
+
+    if (!slots.empty())
+        s.add(GL_ARRAY_BUFFER, GLintptr(k), slots.size() * sizeof (GLfloat),
+                                            &slots.front());
 }
 
-void ogl::node::draw(int id, bool color, bool alpha)
+// Queue the texture array layer of each vertex for upload to the given layer
+// plane. Vertices take the layer of their mesh's binding.
+
+static void layer_meshes(const ogl::cache_v& meshes, std::vector<GLfloat>& v)
 {
-    // Proceed if this node passed visibility test ID.
+    for (ogl::cache_c i = meshes.begin(); i != meshes.end(); ++i)
+        v.insert(v.end(), i->dst->count_verts(),
+                 GLfloat(i->src->state() ? i->src->state()->get_layer() : 0));
+}
 
-    if (ubiquitous || get_bit(test_cache, id))
-    {
-        // Select the batch vector.  Confirm that it is non-empty.
+void ogl::node::layer(GLfloat *l, stream& s)
+{
+    layers.clear();
 
-        elem_i b;
-        elem_i e;
+    layer_meshes(my_mesh, layers);
 
-        if (color)
-            if (alpha) { b = masked_color.begin(); e = masked_color.end(); }
-            else       { b = opaque_color.begin(); e = opaque_color.end(); }
-        else
-            if (alpha) { b = masked_depth.begin(); e = masked_depth.end(); }
-            else       { b = opaque_depth.begin(); e = opaque_depth.end(); }
+    for (size_t j = 0; j < my_inst.size(); ++j)
+        layer_meshes(my_inst[j]->meshes, layers);
 
-        if (b != e)
-        {
-            // if (alpha) { glEnable(GL_ALPHA_TEST); };
+    if (!layers.empty())
+        s.add(GL_ARRAY_BUFFER, GLintptr(l), layers.size() * sizeof (GLfloat),
+                                            &layers.front());
+}
 
-            // Render the selected batches.
+// Append the transform slot records of this node: rows 0-2 of the node
+// transform followed by the quantization of the node or instance group.
 
+static void buff_record(std::vector<GLfloat>& v, const mat4& M, const mat4& Q)
+{
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            v.push_back(GLfloat(M[r][c]));
+
+    v.push_back(GLfloat(Q[0][3]));
+    v.push_back(GLfloat(Q[1][3]));
+    v.push_back(GLfloat(Q[2][3]));
+    v.push_back(GLfloat(Q[0][0]));
+}
+
+void ogl::node::buff_slot(std::vector<GLfloat>& v) const
+{
+    buff_record(v, M, Q);
+
+    for (inst_v::const_iterator i = my_inst.begin(); i != my_inst.end(); ++i)
+        buff_record(v, M, (*i)->Q);
+}
+
+//-----------------------------------------------------------------------------
+
+// Transform the given units, spreading them across all worker threads. This
+// touches only the units' own cache meshes, so no GL calls are made here.
+
+struct unit_task
+{
+    ogl::unit_v *units;
+    bool         force;
+};
+
+static void buff_unit(void *data, int i)
+{
+    unit_task *task = (unit_task *) data;
+
+    (*task->units)[i]->buff(task->force);
+}
+
+static void buff_units(ogl::unit_v& units, bool b)
+{
+    unit_task task;
+
+    task.units = &units;
+    task.force = b;
+
+    etc::parallel(int(units.size()), buff_unit, &task);
+}
+
+//-----------------------------------------------------------------------------
+
+// Append this node's units to the given list if it needs a rebuff.
+
+void ogl::node::need(unit_v& units, bool b) const
+{
+    if (b || rebuff) units.insert(units.end(), my_unit.begin(), my_unit.end());
+}
+
+void ogl::node::buff(GLfloat *v, GLfloat *n, GLfloat *t, GLfloat *u, bool b,
+                     stream& s)
+{
+    // Have each unit pretransform its vertex data, then upload it.
+
+    unit_v units;
+
+    need(units, b);
+    buff_units(units, b);
+    upld(v, n, t, u, b, s);
+}
+
+void ogl::node::upld(GLfloat *v, GLfloat *n, GLfloat *t, GLfloat *u, bool b,
+                     stream& s)
+{
+    if (b || rebuff)
+    {
+        // Accumulate the bounds of the pretransformed units.
+
+        my_aabb = aabb();
+
+        for (unit_s::iterator i = my_unit.begin(); i != my_unit.end(); ++i)
+            my_aabb.merge((*i)->get_bound());
+
+        set_rebound();
+
+        Q = mat4();
+
+        // Queue each mesh's vertex data for upload to the bound buffer object.
+        // Instanced meshes follow the node's own.
+
+        for (cache_i i = my_mesh.begin(); i != my_mesh.end(); ++i)
+        {
+            const GLsizei vc = i->dst->count_verts();
+
+            i->dst->buffv(v, n, t, u, s);
+
+            v += vc * 3;
+            n += vc * 3;
+            t += vc * 3;
+            u += vc * 3;
+        }
+
+        for (inst_v::iterator j = my_inst.begin(); j != my_inst.end(); ++j)
+        {
+            (*j)->Q = mat4();
+
+            for (cache_i i = (*j)->meshes.begin();
+                                  i != (*j)->meshes.end(); ++i)
+            {
+                const GLsizei vc = i->dst->count_verts();
+
+                i->dst->buffv(v, n, t, u, s);
+
+                v += vc * 3;
+                n += vc * 3;
+                t += vc * 3;
+                u += vc * 3;
+            }
+        }
+        buff_inst();
+    }
+    rebuff = false;
+}
+
+// Determine the cube quantizing vertex data with the given bound. A uniform
+// scale keeps the normal matrix a rotation.
+
+static mat4 quantize(const ogl::aabb& b, vec3& c, double& h)
+{
+    c = vec3(0.0, 0.0, 0.0);
+    h = 1.0;
+
+    if (b.isvalid())
+    {
+        const vec3 l = b.length();
+
+        c = b.center();
+        h = std::max(std::max(l[0], l[1]), l[2]) / 2.0;
+        h = std::max(h, 1e-6);
+    }
+    return translation(c) * scale(vec3(h, h, h) / 32767.0);
+}
+
+// Encode the vertex data of the given meshes, starting at vertex vi of the
+// packed planes, and queue any changes for upload.
+
+static void pack_meshes(ogl::cache_v& meshes, std::vector<GLshort>& packed,
+                        GLsizei vn, GLsizei& vi, GLubyte *p, GLubyte *n,
+                        GLubyte *u, const vec3& c, double h, bool all,
+                        ogl::stream& s)
+{
+    for (ogl::cache_i i = meshes.begin(); i != meshes.end(); ++i)
+    {
+        const GLsizei vc = i->dst->count_verts();
+
+        GLshort  *pp = vc ?              &packed[4 * (vn * 0 + vi)]  : 0;
+        GLshort  *np = vc ?              &packed[4 * (vn * 1 + vi)]  : 0;
+        GLushort *up = vc ? (GLushort *) &packed[4 * (vn * 2 + vi)]  : 0;
+
+        if (vc && i->dst->packv(pp, np, up, c, 1.0 / h, all))
+        {
+            s.add(GL_ARRAY_BUFFER, GLintptr(p + 8 * vi), 8 * vc, pp);
+            s.add(GL_ARRAY_BUFFER, GLintptr(n + 8 * vi), 8 * vc, np);
+            s.add(GL_ARRAY_BUFFER, GLintptr(u + 8 * vi), 8 * vc, up);
+        }
+        vi += vc;
+    }
+}
+
+void ogl::node::pack(GLubyte *p, GLubyte *n, GLubyte *u, bool b, stream& s)
+{
+    if (b || rebuff)
+    {
+        // Accumulate the bounds of the pretransformed units.
+
+        aabb a;
+
+        my_aabb = aabb();
+
+        for (unit_s::iterator i = my_unit.begin(); i != my_unit.end(); ++i)
+        {
+            my_aabb.merge((*i)->get_bound());
+
+            if ((*i)->get_inst() == 0)
+                a.merge((*i)->get_bound());
+        }
+        set_rebound();
+
+        // Quantize positions to the bounding cube of the uninstanced units.
+        // Requantize all meshes if the cube moved.
+
+        vec3   c;
+        double h;
+
+        const mat4 R = quantize(a, c, h);
+        const bool all = b || memcmp(&R, &Q, sizeof (mat4));
+
+        Q = R;
+
+        // Encode each mesh's vertex data and queue it for upload.
+
+        GLsizei vn = 0;
+        GLsizei vi = 0;
+
+        for (cache_i i = my_mesh.begin(); i != my_mesh.end(); ++i)
+            vn += i->dst->count_verts();
+
+        for (inst_v::iterator j = my_inst.begin(); j != my_inst.end(); ++j)
+            for (cache_i i = (*j)->meshes.begin();
+                                  i != (*j)->meshes.end(); ++i)
+                vn += i->dst->count_verts();
+
+        packed.resize(12 * vn);
+
+        pack_meshes(my_mesh, packed, vn, vi, p, n, u, c, h, all, s);
+
+        // Quantize each instanced surface to its own untransformed bound.
+
+        for (inst_v::iterator j = my_inst.begin(); j != my_inst.end(); ++j)
+        {
+            aabb l;
+
+            for (cache_i i = (*j)->meshes.begin();
+                                  i != (*j)->meshes.end(); ++i)
+                l.merge(i->dst->get_bound());
+
+            const mat4 R = quantize(l, c, h);
+            const bool all = b || memcmp(&R, &(*j)->Q, sizeof (mat4));
+
+            (*j)->Q = R;
+
+            pack_meshes((*j)->meshes, packed, vn, vi, p, n, u, c, h, all, s);
+        }
+        buff_inst();
+    }
+    rebuff = false;
+}
+
+// Cache the elements of the given meshes at offset e, with vertices offset by
+// d, and queue them for upload. Create an element batch for each primitive
+// set, advancing e and d.
+
+static void sort_meshes(ogl::cache_v& meshes, ogl::elem_v& elems,
+                        GLuint *& e, GLuint& d, ogl::stream& s)
+{
+    for (ogl::cache_i i = meshes.begin(); i != meshes.end(); ++i)
+    {
+        const GLsizei dc = i->src->count_verts();
+        const GLsizei fc = i->src->count_faces() * 3;
+        const GLsizei lc = i->src->count_lines() * 2;
+
+        // Cache each offset mesh.
+
+        i->dst->cache_faces(i->src, d);
+        i->dst->cache_lines(i->src, d);
+
+        // Queue elements for upload to the bound buffer object.
+
+        i->dst->buffe(e, s);
+
+        // Create a batch for each set of primatives.
+
+        if (fc) elems.push_back(ogl::elem(i->src->state(), e, GL_TRIANGLES,
+                                          fc, i->dst->get_min(),
+                                              i->dst->get_max()));
+        e += fc;
+
+        if (lc) elems.push_back(ogl::elem(i->src->state(), e, GL_LINES,
+                                          lc, i->dst->get_min(),
+                                              i->dst->get_max()));
+        e += lc;
+        d += dc;
+    }
+}
+
+// Create a minimal vector of batches for each draw mode.
+
+static void sort_elems(const ogl::elem_v& elems,
+                       ogl::elem_v& opaque_depth, ogl::elem_v& opaque_color,
+                       ogl::elem_v& masked_depth, ogl::elem_v& masked_color)
+{
+    opaque_depth.clear();
+    opaque_color.clear();
+    masked_depth.clear();
+    masked_color.clear();
+
+    for (ogl::elem_i i = elems.begin(); i != elems.end(); ++i)
+    {
+        if (i->opaque())
+        {
+            // Opaque depth batches
+
+            if (opaque_depth.empty() || !opaque_depth.back().depth_eq(*i))
+                opaque_depth.push_back(*i);
+            else
+                opaque_depth.back().merge(*i);
+
+            // Opaque color batches
+
+            if (opaque_color.empty() || !opaque_color.back().color_eq(*i))
+                opaque_color.push_back(*i);
+            else
+                opaque_color.back().merge(*i);
+        }
+        else
+        {
+            // Masked depth batches
+
+            if (masked_depth.empty() || !masked_depth.back().depth_eq(*i))
+                masked_depth.push_back(*i);
+            else
+                masked_depth.back().merge(*i);
+
+            // Masked color batches
+
+            if (masked_color.empty() || !masked_color.back().color_eq(*i))
+                masked_color.push_back(*i);
+            else
+                masked_color.back().merge(*i);
+        }
+    }
+}
+
+void ogl::node::sort(GLuint *e, GLuint d, stream& s)
+{
+    // Create a list of all meshes of this node in unit order, and sort it by
+    // material. The sort is stable, so the result is deterministic.
+
+    unit_v units(my_unit.begin(), my_unit.end());
+
+    std::sort(units.begin(), units.end(), unit_lt);
+
+    my_mesh.clear();
+    ubiquitous = false;
+
+    for (unit_v::iterator i = units.begin(); i != units.end(); ++i)
+    {
+        (*i)->merge_batch(my_mesh);
+        ubiquitous |= (*i)->is_ubiq();
+    }
+
+    sort_caches(my_mesh);
+
+    // Create the element batches of this node.
+
+    elem_v my_elem;
+
+    sort_meshes(my_mesh, my_elem, e, d, s);
+    sort_elems (my_elem, opaque_depth, opaque_color,
+                         masked_depth, masked_color);
+
+    // Cache each instanced surface untransformed and create its batches.
+
+    for (inst_v::iterator j = my_inst.begin(); j != my_inst.end(); ++j)
+    {
+        elem_v inst_elem;
+
+        for (cache_i i = (*j)->meshes.begin();
+                              i != (*j)->meshes.end(); ++i)
+            i->dst->cache_verts(i->src, mat4(), mat4(), 0);
+
+        sort_meshes((*j)->meshes, inst_elem, e, d, s);
+        sort_elems (inst_elem, (*j)->opaque_depth, (*j)->opaque_color,
+                               (*j)->masked_depth, (*j)->masked_color);
+    }
+
+    // The vertex data must now be uploaded to this node's range.
+
+    for (unit_s::iterator i = my_unit.begin(); i != my_unit.end(); ++i)
+        (*i)->set_rebuff();
+
+    set_rebuff();
+    resort = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::node::transform(const mat4& M)
+{
+    this->M = M;
+    set_rebound();
+    version++;
+}
+
+mat4 ogl::node::get_world_transform() const
+{
+    return M;
+}
+
+// Return the world-space bound. An empty node is bounded by its origin.
+
+ogl::aabb ogl::node::get_bound() const
+{
+    if (my_aabb.min()[0] > my_aabb.max()[0])
+    {
+        vec3 o = M * vec3();
+        return aabb(o, o);
+    }
+    return aabb(my_aabb, M);
+}
+
+//-----------------------------------------------------------------------------
+
+// Note a change of world-space bound with the pool, once per view.
+
+void ogl::node::set_rebound()
+{
+    if (my_pool && !rebound)
+    {
+        my_pool->set_rebound(this);
+        rebound = true;
+    }
+}
+
+void ogl::node::insert(bvh& tree)
+{
+    leaf    = tree.insert(get_bound(), this);
+    rebound = false;
+}
+
+void ogl::node::remove(bvh& tree)
+{
+    if (leaf >= 0) tree.remove(leaf);
+    leaf = -1;
+}
+
+void ogl::node::refit(bvh& tree)
+{
+    if (leaf >= 0) tree.move(leaf, get_bound());
+    rebound = false;
+}
+
+void ogl::node::insert(boxes& flat)
+{
+    leaf    = flat.insert(get_bound(), this);
+    rebound = false;
+}
+
+void ogl::node::remove(boxes& flat)
+{
+    if (leaf >= 0) flat.remove(leaf);
+    leaf = -1;
+}
+
+void ogl::node::refit(boxes& flat)
+{
+    if (leaf >= 0) flat.move(leaf, get_bound());
+    rebound = false;
+}
+
+//-----------------------------------------------------------------------------
+
+// Test this node against the c frusta of n planes given, for IDs id through
+// id + c - 1, skipping those not flagged in mask m. A null frustum passes all.
+// Stamp each ID for which the node is visible with the given pass.
+
+ogl::aabb ogl::node::view(int id, int c, const vec4 *const *V, int n,
+                          unsigned m, unsigned pass)
+{
+    bool any = false;
+
+    if (!ubiquitous)
+    {
+        if (test_cache.size() < size_t(id + c))
+        {
+            test_cache.resize(id + c, 0);
+            hint_cache.resize(id + c, 0);
+        }
+
+        for (int f = 0; f < c; ++f)
+            if (m & (1U << f))
+            {
+                // Test the bounding box using the cached culler hint.
+
+                int  hint = hint_cache[id + f];
+                bool bit  = (V[f] == 0 || my_aabb.test(V[f], n, M, hint));
+
+                hint_cache[id + f] = GLubyte(hint);
+
+                if (bit)
+                {
+                    test_cache[id + f] = pass;
+                    any |= (V[f] != 0);
+
+                    // Test each instance of a visible node individually.
+
+                    for (inst_v::iterator i = my_inst.begin();
+                                          i != my_inst.end(); ++i)
+                        view_inst(*i, id + f, V[f], n);
+                }
+            }
+    }
+
+    // If this node is visible, return the world-space AABB.
+
+    if (any)
+        return ogl::aabb(my_aabb, M);
+    else
+        return ogl::aabb();
+}
+
+// Test each unit of an instance group against frustum ID, setting its flag
+// and culler hint.
+
+void ogl::node::view_inst(inst *g, int id, const vec4 *V, int n) const
+{
+    if (g->test_cache.size() <= size_t(id))
+        g->test_cache.resize(id + 1);
+
+    std::vector<GLubyte>& r = g->test_cache[id];
+
+    r.resize(g->units.size(), 8);
+
+    for (size_t j = 0; j < g->units.size(); ++j)
+    {
+        int h = r[j] & 7;
+
+        if (V == 0 || g->units[j]->get_bound().test(V, n, M, h))
+            r[j] = GLubyte(h | 8);
+        else
+            r[j] = GLubyte(h);
+    }
+}
+
+// Return true if this node passed the last visibility test of ID, or if no
+// test of ID has been made.
+
+bool ogl::node::is_visible(int id) const
+{
+    if (ubiquitous)
+        return true;
+    else
+    {
+        const unsigned p = my_pool ? my_pool->get_pass(id) : 0;
+
+        return (p == 0 || (size_t(id) < test_cache.size()
+                                     && test_cache[id] == p));
+    }
+}
+
+// Add the occluder faces of all units to the given depth buffer.
+
+void ogl::node::occlude(occlusion& o) const
+{
+    for (unit_s::const_iterator i = my_unit.begin(); i != my_unit.end(); ++i)
+        (*i)->occlude(o);
+}
+
+// Mark this node hidden to ID by the current pass.
+
+void ogl::node::hide(int id)
+{
+    if (size_t(id) < test_cache.size())
+        test_cache[id] = 0;
+}
+
+// Mark this node visible to ID by the current pass.
+
+void ogl::node::show(int id)
+{
+    if (my_pool && size_t(id) < test_cache.size())
+        test_cache[id] = my_pool->get_pass(id);
+}
+
+//-----------------------------------------------------------------------------
+
+// Read the result of any pending occlusion query of ID. While the result is
+// unavailable a node keeps its last state if conditional rendering will draw
+// it should it reappear, and is otherwise assumed visible. It is also assumed
+// visible while its bound reaches the near plane, where the query box may be
+// clipped.
+
+void ogl::node::poll(int id, const vec4& near)
+{
+    if (size_t(id) < query_state.size())
+    {
+        GLubyte& s = query_state[id];
+
+        if (s & query_pending)
+        {
+            GLuint n = 0;
+
+            glGetQueryObjectuiv(query_object[id], GL_QUERY_RESULT_AVAILABLE, &n);
+
+            if (n)
+            {
+                glGetQueryObjectuiv(query_object[id], GL_QUERY_RESULT, &n);
+
+                s = GLubyte((s & query_wait) | (n ? 0 : query_hidden));
+            }
+            else if (!ogl::has_conditional_render)
+                s = GLubyte(s & ~query_hidden);
+        }
+
+        if ((s & query_hidden) && get_bound().min(near) <= 0)
+            s = GLubyte(s & ~query_hidden);
+    }
+}
+
+// Query the bound of this node against the depth of the nodes drawn so far,
+// if it is hidden to ID, or if it is visible and due. Visible nodes are due
+// once every given number of frames, staggered among nodes.
+
+void ogl::node::query(int id, const vec4& near, int interval)
+{
+    if (ubiquitous || !is_visible(id) || my_aabb.min()[0] > my_aabb.max()[0])
+        return;
+
+    if (query_state.size() <= size_t(id))
+    {
+        query_object.resize(id + 1, 0);
+        query_state .resize(id + 1, GLubyte(size_t(this) / sizeof (node)
+                                                        % interval));
+    }
+
+    GLubyte& s = query_state[id];
+
+    if (s & query_pending)
+        return;
+
+    if ((s & query_hidden) || (s & query_wait) == 0)
+    {
+        if (get_bound().min(near) > 0)
+        {
+            if (query_object[id] == 0)
+                glGenQueries(1, &query_object[id]);
+
+            glBeginQuery(GL_SAMPLES_PASSED, query_object[id]);
             glPushMatrix();
             {
                 glMultMatrixd(transpose(M));
-
-                for (elem_i i = b; i != e; ++i)
-                    i->draw(color);
+                my_aabb.fill();
             }
             glPopMatrix();
+            glEndQuery(GL_SAMPLES_PASSED);
 
-            // if (alpha) { glDisable(GL_ALPHA_TEST); };
+            s = GLubyte((s & query_hidden) | query_pending | (interval - 1));
         }
     }
+    else s--;
+}
+
+// Draw the selected batches of this node conditioned on the result of its
+// pending query of ID, without waiting for it on the CPU. Given a map, gather
+// and draw multi-draw batches.
+
+void ogl::node::draw_cond(int id, bool color, bool alpha, multi_m *batch)
+{
+    if (size_t(id) < query_state.size() && (query_state[id] & query_pending))
+    {
+        glBeginConditionalRender(query_object[id], GL_QUERY_WAIT);
+        {
+            if (batch)
+            {
+                clear_multi(*batch);
+                enqueue(id, color, alpha, *batch);
+                draw_multi(*batch, color);
+            }
+            else
+                render(id, color, alpha);
+        }
+        glEndConditionalRender();
+    }
+}
+
+void ogl::node::drop_query()
+{
+    for (size_t i = 0; i < query_object.size(); ++i)
+        if (query_object[i])
+            glDeleteQueries(1, &query_object[i]);
+
+    query_object.clear();
+    query_state .clear();
+}
+
+void ogl::node::draw(int id, bool color, bool alpha)
+{
+    // Proceed if this node passed visibility test ID and was not found hidden
+    // by its last occlusion query.
+
+    if (is_visible(id) && !is_hidden(id))
+        render(id, color, alpha);
+}
+
+void ogl::node::render(int id, bool color, bool alpha)
+{
+    // Select the batch vector.  Confirm that it or an instance group is
+    // non-empty.
+
+    elem_i b;
+    elem_i e;
+
+    select(opaque_depth, opaque_color,
+           masked_depth, masked_color, color, alpha, b, e);
+
+    if (b != e || !my_inst.empty())
+    {
+        // if (alpha) { glEnable(GL_ALPHA_TEST); };
+
+        // Render the selected batches. Any quantization is given to the
+        // shader in attribute 5.
+
+        set_quant(Q);
+
+        glPushMatrix();
+        {
+            glMultMatrixd(transpose(M));
+
+            for (elem_i i = b; i != e; ++i)
+                i->draw(color);
+
+            for (inst_v::const_iterator i = my_inst.begin();
+                                        i != my_inst.end(); ++i)
+                draw_inst(*i, id, color, alpha);
+        }
+        glPopMatrix();
+
+        // if (alpha) { glDisable(GL_ALPHA_TEST); };
+    }
+}
+
+// Queue the selected batches of this node for multi-draw with those of other
+// nodes. Node transforms are applied by the shader, so instance groups are
+// drawn immediately, without changing the modelview.
+
+void ogl::node::queue(int id, bool color, bool alpha, multi_m& batch)
+{
+    if (is_visible(id) && !is_hidden(id))
+        enqueue(id, color, alpha, batch);
+}
+
+void ogl::node::enqueue(int id, bool color, bool alpha, multi_m& batch)
+{
+    elem_i b;
+    elem_i e;
+
+    select(opaque_depth, opaque_color,
+           masked_depth, masked_color, color, alpha, b, e);
+
+    for (elem_i i = b; i != e; ++i)
+        i->queue(batch);
+
+    for (inst_v::const_iterator i = my_inst.begin();
+                                i != my_inst.end(); ++i)
+        draw_inst(*i, id, color, alpha);
+}
+
+// Render each run of consecutive visible instances of the given group with a
+// single instanced draw per batch. The pool binds the instance buffer.
+
+void ogl::node::draw_inst(const inst *g, int id, bool color, bool alpha) const
+{
+    elem_i b;
+    elem_i e;
+
+    select(g->opaque_depth, g->opaque_color,
+           g->masked_depth, g->masked_color, color, alpha, b, e);
+
+    if (b != e)
+    {
+        const size_t n = g->units.size();
+
+        // Find the visibility of each instance, if tested.
+
+        const GLubyte *v = 0;
+
+        if (size_t(id) < g->test_cache.size() && !g->test_cache[id].empty()
+                                              && !ubiquitous)
+            v = &g->test_cache[id].front();
+
+        set_quant(g->Q);
+
+        for (GLuint a = 9; a < 13; ++a)
+            glEnableVertexAttribArray(a);
+
+        size_t j = 0;
+        size_t k = 0;
+
+        while (j < n)
+        {
+            // Skip hidden instances and find the following visible run.
+
+            while (j < n && v && !(v[j] & 8))
+                j++;
+
+            k = j;
+
+            while (k < n && (v == 0 || (v[k] & 8)))
+                k++;
+
+            if (k > j)
+            {
+                const GLfloat *p = (const GLfloat *) 0 + (g->ibase + j) * 16;
+
+                glVertexAttribPointer( 9, 4, GL_FLOAT, 0, 64, p +  0);
+                glVertexAttribPointer(10, 4, GL_FLOAT, 0, 64, p +  4);
+                glVertexAttribPointer(11, 4, GL_FLOAT, 0, 64, p +  8);
+                glVertexAttribPointer(12, 4, GL_FLOAT, 0, 64, p + 12);
+
+                for (elem_i i = b; i != e; ++i)
+                    i->draw(color, GLsizei(k - j));
+            }
+            j = k;
+        }
+
+        for (GLuint a = 9; a < 13; ++a)
+            glDisableVertexAttribArray(a);
+
+        // The current attribute values are undefined after array use.
+
+        set_instance(mat4(), -1.0);
+    }
 }
 
 //=============================================================================
 
-ogl::pool::pool() : vc(0), ec(0), resort(true), rebuff(true), vbo(0), ebo(0)
+unsigned long long ogl::pool::culled = 0;
+
+ogl::pool::pool() :
+    vc(0), ec(0), resort(true), rebuff(true), packed(false),
+    vbo(0), ebo(0), ibo(0), instance(0), multidraw(false), tbo(0), tex(0),
+    layered(false), compact(false),
+    culling(std::max(0, std::min(::conf->get_i("pool_cull", cull_tree),
+                                 int(cull_flat)))),
+    serial(0),
+    occl(0),
+    occl_faces(::conf->get_i("pool_occlusion_budget", 4096)),
+    querying(false),
+    query_interval(1)
 {
+    if (::conf->get_i("pool_occlusion", 0))
+        occl = new occlusion(::conf->get_i("pool_occlusion_width",  256),
+                             ::conf->get_i("pool_occlusion_height", 128));
+
     init();
 }
 
@@ -545,9 +1681,18 @@ ogl::pool::~pool()
     for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
         delete (*i);
 
+    delete occl;
+
     fini();
 }
 
+// Return the total number of nodes culled by occlusion in all pools.
+
+unsigned long long ogl::pool::get_culled()
+{
+    return culled;
+}
+
 //-----------------------------------------------------------------------------
 
 void ogl::pool::set_resort()
@@ -560,6 +1705,11 @@ void ogl::pool::set_rebuff()
     rebuff = true;
 }
 
+void ogl::pool::set_rebound(node_p p)
+{
+    if (culling) moved.push_back(p);
+}
+
 void ogl::pool::add_vcount(GLsizei vc)
 {
     this->vc += vc;
@@ -579,14 +1729,17 @@ void ogl::pool::add_node(node_p p)
     my_node.insert(p);
     p->set_pool(this);
 
+    if (culling == cull_tree) p->insert(tree);
+    if (culling == cull_flat) p->insert(flat);
+
     // Include the node's vertex and element counts.
 
     vc += p->vcount();
     ec += p->ecount();
 
-    // Mark this pool and its pool for a resort.
+    // Mark this node and its pool for a resort.
 
-    set_resort();
+    p->set_resort();
 }
 
 void ogl::pool::rem_node(node_p p)
@@ -596,6 +1749,20 @@ void ogl::pool::rem_node(node_p p)
     my_node.erase(p);
     p->set_pool(0);
 
+    // Drop the node from its culling structure.
+
+    if (culling)
+    {
+        if (culling == cull_tree) p->remove(tree);
+        if (culling == cull_flat) p->remove(flat);
+
+        moved.erase(std::remove(moved.begin(), moved.end(), p), moved.end());
+    }
+
+    // Release the node's buffer ranges.
+
+    leave(p);
+
     // Omit the node's vertex and element counts.
 
     vc -= p->vcount();
@@ -608,128 +1775,611 @@ void ogl::pool::rem_node(node_p p)
 
 //-----------------------------------------------------------------------------
 
+// Give a node vertex and element ranges that fit its counts, keeping its
+// current ranges if they are still of the right size class.
+
+void ogl::pool::place(node_p p)
+{
+    GLsizei v = p->get_vbase();
+    GLsizei e = p->get_ebase();
+
+    if (v < 0 || !vheap.fits(v, p->vsize()))
+    {
+        if (v >= 0)
+        {
+            vheap.free(v);
+            vowner.erase(v);
+        }
+        v = vheap.alloc(p->vsize());
+        vowner[v] = p;
+    }
+
+    if (e < 0 || !eheap.fits(e, p->esize()))
+    {
+        if (e >= 0)
+        {
+            eheap.free(e);
+            eowner.erase(e);
+        }
+        e = eheap.alloc(p->esize());
+        eowner[e] = p;
+    }
+
+    p->set_range(v, e);
+}
+
+// Release a node's vertex and element ranges.
+
+void ogl::pool::leave(node_p p)
+{
+    if (p->get_vbase() >= 0)
+    {
+        vheap.free(p->get_vbase());
+        vowner.erase(p->get_vbase());
+    }
+    if (p->get_ebase() >= 0)
+    {
+        eheap.free(p->get_ebase());
+        eowner.erase(p->get_ebase());
+    }
+    p->set_range(-1, -1);
+}
+
+// Release all ranges and mark all nodes for placement, as after the buffer
+// objects are recreated.
+
+void ogl::pool::reset()
+{
+    vheap.clear();
+    eheap.clear();
+    vowner.clear();
+    eowner.clear();
+
+    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+    {
+        (*i)->set_range(-1, -1);
+        (*i)->set_resort();
+    }
+    resort = true;
+    rebuff = true;
+}
+
+//-----------------------------------------------------------------------------
+
 void ogl::pool::buff(bool force)
 {
-    // Compute buffer object offsets for each vertex attribute.
+    const GLsizei c = vheap.get_cap();
+
+    // Pretransform the units of all nodes in need, in parallel.
+
+    unit_v units;
+
+    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+        (*i)->need(units, force);
+
+    buff_units(units, force);
+
+    // Upload all nodes from this thread, which holds the GL context. Each
+    // vertex attribute array spans the capacity of the vertex heap.
+
+    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+    {
+        const GLsizei b = (*i)->get_vbase();
+
+        if (packed)
+        {
+            GLubyte *p = (GLubyte *) 0 + (c * 0 + b) * 8;
+            GLubyte *n = (GLubyte *) 0 + (c * 1 + b) * 8;
+            GLubyte *u = (GLubyte *) 0 + (c * 2 + b) * 8;
+
+            (*i)->pack(p, n, u, force, upload);
+        }
+        else
+        {
+            GLfloat *v = (GLfloat *) ((c * 0 + b) * sizeof (GLvec3));
+            GLfloat *n = (GLfloat *) ((c * 1 + b) * sizeof (GLvec3));
+            GLfloat *t = (GLfloat *) ((c * 2 + b) * sizeof (GLvec3));
+            GLfloat *u = (GLfloat *) ((c * 3 + b) * sizeof (GLvec3));
+
+            (*i)->upld(v, n, t, u, force, upload);
+        }
+    }
 
-    GLfloat *v = (GLfloat *) (0);
-    GLfloat *n = (GLfloat *) (vc * sizeof (GLfloat) * 3);
-    GLfloat *t = (GLfloat *) (vc * sizeof (GLfloat) * 6);
-    GLfloat *u = (GLfloat *) (vc * sizeof (GLfloat) * 9);
+    // If any node's instances changed then rebuild the instance buffer.
 
-    // Rebuff all nodes.
+    bool reinst = false;
 
     for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+        reinst |= (*i)->get_reinst();
+
+    if (reinst && ibo)
     {
-        const GLsizei vc = (*i)->vcount();
+        std::vector<GLfloat> data;
+
+        for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+        {
+            const GLfloat *p = (*i)->get_instances();
 
-        (*i)->buff(v, n, t, u, force);
+            (*i)->set_ibase(GLsizei(data.size() / 16));
+            data.insert(data.end(), p, p + (*i)->isize() * 16);
+        }
 
-        v += vc * 3;
-        n += vc * 3;
-        t += vc * 3;
-        u += vc * 3;
+        ogl::bind_buffer(GL_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof (GLfloat),
+                     data.empty() ? 0 : &data.front(), GL_DYNAMIC_DRAW);
+        ogl::bind_buffer(GL_ARRAY_BUFFER, vbo);
     }
     rebuff = false;
 }
 
 void ogl::pool::sort()
 {
-    GLsizei vsz = vc * sizeof (GLfloat) * 12;
-    GLsizei esz = ec * sizeof (GLuint);
+    const GLsizei vcap = vheap.get_cap();
+    const GLsizei ecap = eheap.get_cap();
+
+    // Group the instances of and place all nodes in need of a resort.
+
+    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+        if ((*i)->get_resort())
+        {
+            (*i)->group(instance);
+            place(*i);
+        }
+
+    // If the heaps grew then the buffer objects must grow. Their contents are
+    // lost, so all nodes must be resorted. Doubling amortizes this.
+
+    bool all = false;
+
+    if (vheap.get_cap() != vcap || eheap.get_cap() != ecap)
+    {
+        GLsizei vsz = vheap.get_cap() * ((packed ? 24 : sizeof (GLvec3) * 4)
+                                     + (multidraw ? sizeof (GLfloat) : 0)
+                                     + (layered   ? sizeof (GLfloat) : 0));
+        GLsizei esz = eheap.get_cap() * sizeof (GLuint);
+
+        glBufferData(GL_ARRAY_BUFFER,         vsz, 0, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, esz, 0, GL_STATIC_DRAW);
 
-    // Initialize vertex and element buffer sizes.
+        all = true;
+    }
 
-    glBufferData(GL_ARRAY_BUFFER,         vsz, 0, GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, esz, 0, GL_STATIC_DRAW);
+    // Resort the affected nodes into their ranges. This marks them for rebuff.
+    // Assign transform slots and reindex any node resorted or reassigned.
 
-    // Resort all nodes.
+    const GLsizei c = vheap.get_cap();
 
-    GLuint *e = 0;
-    GLuint  d = 0;
+    GLfloat *k = (GLfloat *) 0 + c * (packed ? 6 : 12);
+    GLfloat *l = k + (multidraw ? c : 0);
+    GLsizei  b = 0;
 
     for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
     {
-        (*i)->sort(e, d);
+        bool r = (all || (*i)->get_resort());
+
+        if (r)
+            (*i)->sort((GLuint *) 0 + (*i)->get_ebase(),
+                        GLuint((*i)->get_vbase()), upload);
 
-        e += (*i)->ecount();
-        d += (*i)->vcount();
+        if (multidraw)
+        {
+            if (r || (*i)->get_sbase() != b)
+            {
+                (*i)->set_sbase(b);
+                (*i)->index(k + (*i)->get_vbase(), upload);
+            }
+            b += (*i)->ssize();
+        }
+
+        if (layered && r)
+            (*i)->layer(l + (*i)->get_vbase(), upload);
     }
-    resort = false;
 
-    // Force-rebuff all nodes.
+    resort  = false;
+    compact = true;
+}
+
+// Compact the buffers by moving nodes from the top of each heap into free
+// blocks below, a few per frame. Each moved node is marked for a resort, which
+// rewrites only its own ranges. A heap is compacted only when more than a
+// quarter of it is free.
 
-    buff(true);
+#define DEFRAG_STEPS 8
+
+void ogl::pool::defrag()
+{
+    GLsizei src;
+    GLsizei dst;
+
+    if (compact)
+    {
+        int n = 0;
+
+        while (n < DEFRAG_STEPS && 4 * (vheap.get_top() - vheap.get_use())
+                                              > vheap.get_top()
+                                && vheap.defrag(src, dst))
+        {
+            node_p p = vowner[src];
+
+            vowner.erase(src);
+            vowner[dst] = p;
+
+            p->set_range(dst, p->get_ebase());
+            p->set_resort();
+            n++;
+        }
+
+        while (n < DEFRAG_STEPS && 4 * (eheap.get_top() - eheap.get_use())
+                                              > eheap.get_top()
+                                && eheap.defrag(src, dst))
+        {
+            node_p p = eowner[src];
+
+            eowner.erase(src);
+            eowner[dst] = p;
+
+            p->set_range(p->get_vbase(), dst);
+            p->set_resort();
+            n++;
+        }
+
+        // Stop trying until the next resort if nothing could be moved.
+
+        if (n == 0) compact = false;
+    }
 }
 
 //-----------------------------------------------------------------------------
 
 void ogl::pool::prep()
 {
+    // Continue any compaction of the buffers.
+
+    if (!resort) defrag();
+
     // Bind the VBO and EBO.
 
     if (resort || rebuff)
     {
-        glBindBuffer(GL_ARRAY_BUFFER,         vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        ogl::bind_buffer(GL_ARRAY_BUFFER,         vbo);
+        ogl::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     }
 
     // Update the VBO and EBO as necessary.
 
     if (resort) sort(     );
     if (rebuff) buff(false);
+    if (multidraw) move();
+
+    // Upload all dirty ranges at once.
+
+    upload.flush();
 
     // Unbind the VBO and EBO.
 
-    glBindBuffer(GL_ARRAY_BUFFER,         0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    ogl::bind_buffer(GL_ARRAY_BUFFER,         0);
+    ogl::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-ogl::aabb ogl::pool::view(int id, const vec4 *V, int n)
+// Upload the transform slots of all nodes to the texture buffer.
+
+void ogl::pool::move()
+{
+    transforms.clear();
+
+    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+        (*i)->buff_slot(transforms);
+
+    if (!transforms.empty())
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER_ARB, tbo);
+        glBufferData(GL_TEXTURE_BUFFER_ARB,
+                     transforms.size() * sizeof (GLfloat),
+                    &transforms.front(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER_ARB, 0);
+    }
+}
+
+// Update the culling structure with the bounds of all nodes moved since the
+// last view.
+
+void ogl::pool::refit()
 {
+    for (node_v::iterator i = moved.begin(); i != moved.end(); ++i)
+        if (culling == cull_tree)
+            (*i)->refit(tree);
+        else
+            (*i)->refit(flat);
+
+    moved.clear();
+}
+
+// Test all nodes against c frusta of n planes each, for IDs starting at id,
+// in a single pass. Return the union of the bounds of all visible nodes.
+
+ogl::aabb ogl::pool::view(int id, int c, const vec4 *const *V, int n)
+{
+    const unsigned pass = ++serial;
+
     ogl::aabb b;
+    bool      all = (culling != cull_linear);
 
-    // Test all nodes for visibility. Find the union of their bounds.
+    if (passes.size() < size_t(id + c))
+        passes.resize(id + c, 0);
 
-    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
-        b.merge((*i)->view(id, V, n));
+    for (int f = 0; f < c; ++f)
+    {
+        passes[id + f] = pass;
+        all = all && V[f];
+    }
+
+    shown.clear();
+
+    // Work through the frusta 32 at a time.
+
+    for (int f = 0; f < c; f += 32)
+    {
+        const int      k = std::min(c - f, 32);
+        const unsigned m = (k < 32) ? (1U << k) - 1 : ~0U;
+
+        if (all)
+        {
+            // Test only those nodes not culled by hierarchy or SIMD box test,
+            // each against only the frusta it may touch.
 
+            refit();
+
+            found.clear();
+            masks.clear();
+
+            if (culling == cull_tree)
+                tree.cull(V + f, k, n, found, masks);
+            else
+                flat.cull(V + f, k, n, found, masks);
+
+            for (size_t i = 0; i < found.size(); ++i)
+                b.merge(node_p(found[i])->view(id + f, k, V + f, n,
+                                               masks[i], pass));
+            if (occl)
+                for (size_t i = 0; i < found.size(); ++i)
+                    shown.push_back(node_p(found[i]));
+        }
+        else
+        {
+            // Test all nodes for visibility.
+
+            for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+                b.merge((*i)->view(id + f, k, V + f, n, m, pass));
+        }
+    }
+
+    // A node found by more than one group of frusta is shown only once.
+
+    if (occl && c > 32)
+    {
+        std::sort(shown.begin(), shown.end());
+        shown.erase(std::unique(shown.begin(), shown.end()), shown.end());
+    }
     return b;
 }
 
+ogl::aabb ogl::pool::view(int id, const vec4 *V, int n)
+{
+    return view(id, 1, &V, n);
+}
+
+// Hide from frustum ID those nodes of the last pass that are occluded, given
+// the world-to-clip transform of the frustum. The nearest visible nodes are
+// rasterized as occluders, up to the triangle budget, and all visible nodes
+// are tested against the result.
+
+void ogl::pool::occlude(int id, const mat4& T)
+{
+    if (occl && get_pass(id))
+    {
+        if (culling == cull_linear)
+            shown.assign(my_node.begin(), my_node.end());
+
+        // Order the nodes visible to ID by distance from the near plane.
+
+        order.clear();
+
+        for (node_v::iterator i = shown.begin(); i != shown.end(); ++i)
+            if (!(*i)->is_ubiq() && (*i)->is_visible(id))
+            {
+                const vec4 p = T * vec4((*i)->get_bound().center(), 1);
+                order.push_back(std::make_pair(p[2] + p[3], *i));
+            }
+
+        std::sort(order.begin(), order.end());
+
+        // Rasterize the nearest occluders and test all against them.
+
+        occl->clear(T);
+
+        for (size_t i = 0; i < order.size() && occl->size() < occl_faces; ++i)
+            order[i].second->occlude(*occl);
+
+        occl->draw();
+
+        for (size_t i = 0; i < order.size(); ++i)
+            if (!occl->test(order[i].second->get_bound()))
+            {
+                order[i].second->hide(id);
+                culled++;
+            }
+    }
+}
+
 //-----------------------------------------------------------------------------
 
 void ogl::pool::draw_init()
 {
     // Bind the VBO and EBO.
 
-    glBindBuffer(GL_ARRAY_BUFFER,         vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    ogl::bind_buffer(GL_ARRAY_BUFFER,         vbo);
+    ogl::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
     // Enable and attach the vertex arrays.
 
     glEnableVertexAttribArray(6);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_VERTEX_ARRAY);
 
-    GLfloat *v = (GLfloat *) (0);
-    GLfloat *n = (GLfloat *) (vc * sizeof (GLfloat) * 3);
-    GLfloat *t = (GLfloat *) (vc * sizeof (GLfloat) * 6);
-    GLfloat *u = (GLfloat *) (vc * sizeof (GLfloat) * 9);
+    const GLsizei c = vheap.get_cap();
+
+    if (packed)
+    {
+        // Positions are 16-bit integers scaled and offset into node space by
+        // attribute 5. Normal and tangent are octahedral snorm16, decoded
+        // by glsl/vertex-attrib.vert along with the unit ID in attribute 7.
+
+        GLubyte *p = (GLubyte *) 0 + c * 0 * 8;
+        GLubyte *n = (GLubyte *) 0 + c * 1 * 8;
+        GLubyte *u = (GLubyte *) 0 + c * 2 * 8;
+
+        glEnableVertexAttribArray(7);
+
+        glVertexAttribPointer(7, 1, GL_UNSIGNED_INT, 0, 8, u + 4);
+        glTexCoordPointer    (   2, GL_HALF_FLOAT,     8, u);
+        glVertexAttribPointer(6, 4, GL_SHORT,      1,  8, n);
+        glVertexPointer      (   3, GL_SHORT,          8, p);
+    }
+    else
+    {
+        GLfloat *v = (GLfloat *) (c * 0 * sizeof (GLvec3));
+        GLfloat *n = (GLfloat *) (c * 1 * sizeof (GLvec3));
+        GLfloat *t = (GLfloat *) (c * 2 * sizeof (GLvec3));
+        GLfloat *u = (GLfloat *) (c * 3 * sizeof (GLvec3));
+
+        glEnableClientState(GL_NORMAL_ARRAY);
+
+        glTexCoordPointer    (   3, GL_FLOAT,    sizeof (GLvec3), u);
+        glVertexAttribPointer(6, 3, GL_FLOAT, 0, sizeof (GLvec3), t);
+        glNormalPointer      (      GL_FLOAT,    sizeof (GLvec3), n);
+        glVertexPointer      (   3, GL_FLOAT,    sizeof (GLvec3), v);
+    }
+
+    // Node transforms are fetched from the texture buffer by slot.
+
+    if (multidraw)
+    {
+        GLfloat *k = (GLfloat *) 0 + c * (packed ? 6 : 12);
+
+        glEnableVertexAttribArray(13);
+        glVertexAttribPointer(13, 1, GL_FLOAT, 0, sizeof (GLfloat), k);
+
+        ogl::bind_texture(GL_TEXTURE_BUFFER_ARB, GL_TEXTURE16, tex);
+    }
+
+    // Texture array layers are given per vertex.
+
+    if (layered)
+    {
+        GLfloat *l = (GLfloat *) 0 + c * (packed ? 6 : 12) + (multidraw ? c : 0);
+
+        glEnableVertexAttribArray(14);
+        glVertexAttribPointer(14, 1, GL_FLOAT, 0, sizeof (GLfloat), l);
+    }
+
+    // Instance transforms are attached per run of instances by the node. The
+    // instance buffer stays bound for this. Uninstanced geometry sees the
+    // identity.
+
+    if (instance)
+    {
+        for (GLuint a = 9; a < 13; ++a)
+            glVertexAttribDivisorARB(a, 1);
 
-    glTexCoordPointer    (   3, GL_FLOAT,    sizeof (GLvec3), u);
-    glVertexAttribPointer(6, 3, GL_FLOAT, 0, sizeof (GLvec3), t);
-    glNormalPointer      (      GL_FLOAT,    sizeof (GLvec3), n);
-    glVertexPointer      (   3, GL_FLOAT,    sizeof (GLvec3), v);
+        set_instance(mat4(), -1.0);
+
+        ogl::bind_buffer(GL_ARRAY_BUFFER, ibo);
+    }
 }
 
+// Draw the nodes visible to ID. With occlusion queries, the first opaque draw
+// after each view reads the results of the last frame and skips the nodes
+// found hidden. It then queries the bounds of the hidden nodes, and of some
+// visible ones, and draws the hidden conditionally on their queries. Later
+// draws of the same view, opaque or masked, draw the hidden conditionally on
+// the same queries.
+
 void ogl::pool::draw(int id, bool color, bool alpha)
 {
-    // Draw all nodes.
+    vec4 near;
+    bool first = false;
 
-    for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
-        (*i)->draw(id, color, alpha);
+    if (querying)
+    {
+        near = get_near();
+
+        const unsigned pass = get_pass(id);
+
+        if (polled.size() <= size_t(id))
+            polled.resize(id + 1, 0);
+
+        if (!alpha && (pass == 0 || polled[id] != pass))
+        {
+            for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+            {
+                (*i)->poll(id, near);
+
+                if ((*i)->is_hidden(id) && (*i)->is_visible(id))
+                    culled++;
+            }
+            polled[id] = pass;
+            first      = true;
+        }
+    }
+
+    if (multidraw)
+    {
+        // Gather the batches of all nodes by state and draw each state once.
+        // The map is kept across frames to reuse its storage.
+
+        clear_multi(batch);
+
+        for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+            (*i)->queue(id, color, alpha, batch);
+
+        draw_multi(batch, color);
+    }
+    else
+    {
+        // Draw all nodes.
+
+        for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+            (*i)->draw(id, color, alpha);
+    }
+
+    if (querying)
+    {
+        if (first)
+        {
+            // Draw the query boxes without shading or writing.
+
+            glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT
+                                             | GL_ENABLE_BIT);
+            {
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                glDepthMask(GL_FALSE);
+                glDisable(GL_CULL_FACE);
+                glDisable(GL_ALPHA_TEST);
+
+                ogl::bind_program(0);
+
+                for (node_s::iterator i = my_node.begin();
+                                      i != my_node.end(); ++i)
+                    (*i)->query(id, near, query_interval);
+            }
+            glPopAttrib();
+        }
+
+        if (ogl::has_conditional_render)
+            for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+                if ((*i)->is_hidden(id) && (*i)->is_visible(id))
+                    (*i)->draw_cond(id, color, alpha, multidraw ? &cond : 0);
+    }
 }
 
 void ogl::pool::draw_fini()
@@ -740,11 +2390,26 @@ void ogl::pool::draw_fini()
     glDisableClientState(GL_NORMAL_ARRAY);
     glDisableClientState(GL_TEXTURE_COORD_ARRAY);
     glDisableVertexAttribArray(6);
+    glDisableVertexAttribArray(7);
+
+    if (instance)
+        for (GLuint a = 9; a < 13; ++a)
+            glVertexAttribDivisorARB(a, 0);
+
+    if (layered)
+        glDisableVertexAttribArray(14);
+
+    if (multidraw)
+    {
+        glDisableVertexAttribArray(13);
+
+        ogl::bind_texture(GL_TEXTURE_BUFFER_ARB, GL_TEXTURE16, 0);
+    }
 
     // Unbind the VBO and EBO.
 
-    glBindBuffer(GL_ARRAY_BUFFER,         0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    ogl::bind_buffer(GL_ARRAY_BUFFER,         0);
+    ogl::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 //-----------------------------------------------------------------------------
@@ -753,11 +2418,36 @@ void ogl::pool::init()
 {
     if (ogl::context)
     {
+        querying       = ogl::do_occlusion_query;
+        query_interval = std::max(1, std::min(63,
+                                   ::conf->get_i("pool_query_interval", 4)));
+
         glGenBuffers(1, &vbo);
         glGenBuffers(1, &ebo);
 
-        resort = true;
-        rebuff = true;
+        packed   = ogl::do_compact_vertex;
+        instance = ogl::do_instancing ? ::conf->get_i("pool_instance", 0) : 0;
+
+        if (instance) glGenBuffers(1, &ibo);
+
+        // Attach the transform slot buffer to its texture.
+
+        if ((multidraw = ogl::do_multidraw))
+        {
+            glGenBuffers (1, &tbo);
+            glGenTextures(1, &tex);
+
+            glBindBuffer     (GL_TEXTURE_BUFFER_ARB, tbo);
+            ogl::bind_texture(GL_TEXTURE_BUFFER_ARB, GL_TEXTURE0, tex);
+            glTexBufferARB   (GL_TEXTURE_BUFFER_ARB, GL_RGBA32F_ARB, tbo);
+            ogl::bind_texture(GL_TEXTURE_BUFFER_ARB, GL_TEXTURE0, 0);
+            glBindBuffer     (GL_TEXTURE_BUFFER_ARB, 0);
+        }
+
+        layered = ogl::do_texture_array;
+
+        upload.init();
+        reset();
     }
 }
 
@@ -765,9 +2455,27 @@ void ogl::pool::fini()
 {
     if (ogl::context)
     {
+        for (node_s::iterator i = my_node.begin(); i != my_node.end(); ++i)
+            (*i)->drop_query();
+
+        polled.clear();
+
+        upload.fini();
+
+        ogl::drop_texture(tex);
+        ogl::drop_buffer (ibo);
+        ogl::drop_buffer (ebo);
+        ogl::drop_buffer (vbo);
+
+        if (tex) glDeleteTextures(1, &tex);
+        if (tbo) glDeleteBuffers(1, &tbo);
+        if (ibo) glDeleteBuffers(1, &ibo);
         if (ebo) glDeleteBuffers(1, &ebo);
         if (vbo) glDeleteBuffers(1, &vbo);
 
+        tex = 0;
+        tbo = 0;
+        ibo = 0;
         ebo = 0;
         vbo = 0;
     }
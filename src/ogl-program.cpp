@@ -10,8 +10,10 @@
 //  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
 //  General Public License for more details.
 
+#include <stdexcept>
 #include <cstring>
 #include <cstdio>
+#include <vector>
 
 #include <etc-log.hpp>
 #include <ogl-uniform.hpp>
@@ -25,7 +27,8 @@
 const ogl::program *ogl::program::current = NULL;
 
 ogl::program::program(std::string name) :
-    name(name), vert(0), frag(0), prog(0), bindable(false), discard(false)
+    name(name), vert(0), frag(0), prog(0), bindable(false), discard(false),
+    layered(false)
 {
     init();
 }
@@ -41,22 +44,33 @@ void ogl::program::prep() const
 {
     if (bindable)
     {
-        uniform_map::const_iterator u;
+        uniform_map::iterator       u;
         process_map::const_iterator p;
 
-        bind();
+        // Set all uniform values changed since the last prep, binding only if
+        // there are any.
 
-        // Set all uniform values.
+        bool bound = false;
 
         for (u = uniforms.begin(); u != uniforms.end(); ++u)
-            u->first->apply(u->second);
+            if (u->second.loc >= 0 && u->second.ver != u->first->get_version())
+            {
+                if (!bound)
+                {
+                    bind();
+                    bound = true;
+                }
+                u->first->apply(u->second.loc);
+                u->second.ver = u->first->get_version();
+            }
 
         // Bind all process samplers.
 
         for (p = processes.begin(); p != processes.end(); ++p)
             p->first->bind(p->second);
 
-        free();
+        if (bound)
+            free();
     }
 }
 
@@ -64,7 +78,7 @@ void ogl::program::bind() const
 {
     if (bindable)
     {
-        glUseProgram(prog);
+        ogl::bind_program(prog);
         current = this;
     }
 }
@@ -75,8 +89,18 @@ void ogl::program::free() const
 
 //-----------------------------------------------------------------------------
 
+// Expanded text of each shader file loaded since the last fini, shared by all
+// programs so that common headers are read and expanded only once.
+
+static std::map<std::string, std::string> loaded;
+
 std::string ogl::program::load(const std::string& name)
 {
+    std::map<std::string, std::string>::const_iterator i;
+
+    if ((i = loaded.find(name)) != loaded.end())
+        return i->second;
+
     std::string            base;
     std::string::size_type incl = 0;
 
@@ -104,9 +128,45 @@ std::string ogl::program::load(const std::string& name)
         base.replace(incl, rq - incl + 1, load(file));
     }
 
-    // Return the final string.
+    // Remember and return the final string.
+
+    return (loaded[name] = base);
+}
+
+// Insert definitions reflecting the GL options into the given shader text,
+// following any version directive. Programs sampling material textures from
+// texture arrays are told so.
 
-    return base;
+static std::string define(const std::string& text, bool layered)
+{
+    std::string            defs;
+    std::string::size_type line = 0;
+
+    if (ogl::do_compact_vertex)
+        defs.append("#define VERTEX_COMPACT 1\n");
+    if (ogl::do_instancing)
+        defs.append("#define VERTEX_INSTANCE 1\n");
+    if (ogl::do_multidraw)
+        defs.append("#extension GL_EXT_gpu_shader4 : require\n"
+                    "#define VERTEX_MULTIDRAW 1\n");
+    if (ogl::do_uniform_block)
+        defs.append("#extension GL_ARB_uniform_buffer_object : require\n"
+                    "#define UNIFORM_BLOCK 1\n");
+    if (layered)
+        defs.append("#extension GL_EXT_texture_array : require\n"
+                    "#define TEXTURE_ARRAY 1\n");
+
+    if (text.empty() || defs.empty())
+        return text;
+
+    if (text.compare(0, 8, "#version") == 0)
+    {
+        if ((line = text.find('\n')) == std::string::npos)
+            line = text.size();
+        else
+            line = line + 1;
+    }
+    return std::string(text).insert(line, defs);
 }
 
 void ogl::program::init_attributes(app::node p)
@@ -169,11 +229,33 @@ void ogl::program::init_uniforms(app::node p)
         if (!uniform.empty())
         {
             if (ogl::uniform *u = ::glob->load_uniform(uniform, size))
-                uniforms[u] = glGetUniformLocation(prog, name.c_str());
+            {
+                uniforms[u].loc = glGetUniformLocation(prog, name.c_str());
+                uniforms[u].ver = 0;
+            }
         }
     }
 }
 
+void ogl::program::init_blocks(app::node p)
+{
+    // Attach the uniform blocks to their binding points. Members of a block
+    // have no uniform location and are skipped by prep.
+
+    if (ogl::do_uniform_block)
+
+        for (app::node n = p.find("block"); n; n = p.next(n, "block"))
+        {
+            const std::string name    = n.get_s("name");
+            const int         binding = n.get_i("binding");
+
+            GLuint index = glGetUniformBlockIndex(prog, name.c_str());
+
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(prog, index, binding);
+        }
+}
+
 //-----------------------------------------------------------------------------
 
 bool ogl::program::program_log(GLuint handle, const std::string& name)
@@ -248,6 +330,153 @@ GLuint ogl::program::compile(GLenum type, const std::string& name,
 
 //-----------------------------------------------------------------------------
 
+// The binary cache holds the linked program of each program file, tagged with
+// a hash of the expanded shader text, the attribute bindings, and the GL
+// vendor, renderer, and version, so that a binary is only offered back to the
+// driver that produced it. The driver may still reject it, in which case the
+// program is compiled and linked as usual.
+
+#define CACHE_MAGIC   0x4E494250 // "PBIN"
+#define CACHE_VERSION 1
+
+struct cache_head
+{
+    GLuint             magic;
+    GLuint             version;
+    GLenum             format;
+    GLuint             size;
+    unsigned long long key;
+};
+
+static std::string cache_name(const std::string& path)
+{
+    return path + ".cache";
+}
+
+// Accumulate a 64-bit FNV-1a hash of the given string.
+
+static unsigned long long hash(unsigned long long h, const std::string& s)
+{
+    for (std::string::size_type i = 0; i < s.size(); ++i)
+    {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211ULL;
+    }
+    return h ^ s.size();
+}
+
+static unsigned long long hash(unsigned long long h, const GLubyte *s)
+{
+    return hash(h, std::string(s ? (const char *) s : ""));
+}
+
+// Compute the cache key of a program with the given source.
+
+static unsigned long long cache_key(app::node p, const std::string& vert,
+                                                 const std::string& frag)
+{
+    unsigned long long h = 14695981039346656037ULL;
+
+    h = hash(h, vert);
+    h = hash(h, frag);
+
+    for (app::node n = p.find("attribute"); n; n = p.next(n, "attribute"))
+    {
+        h = hash(h, n.get_s("name"));
+        h = hash(h, n.get_s("location"));
+    }
+
+    h = hash(h, glGetString(GL_VENDOR));
+    h = hash(h, glGetString(GL_RENDERER));
+    h = hash(h, glGetString(GL_VERSION));
+
+    return h;
+}
+
+// Load the cached binary of this program, if current, and confirm that the
+// driver accepts it.
+
+bool ogl::program::read_binary(const std::string& path, unsigned long long key)
+{
+    const std::string file = cache_name(path);
+
+    bool ok = false;
+
+    if (::data->find(file))
+    {
+        size_t         n;
+        const GLubyte *p = (const GLubyte *) ::data->load(file, &n);
+
+        cache_head h;
+
+        if (n >= sizeof (cache_head))
+        {
+            memcpy(&h, p, sizeof (cache_head));
+
+            if (h.magic   == CACHE_MAGIC   &&
+                h.version == CACHE_VERSION &&
+                h.key     == key           &&
+                h.size    == n - sizeof (cache_head))
+            {
+                GLint status = 0;
+
+                glProgramBinary(prog, h.format, p + sizeof (cache_head),
+                                                GLsizei(h.size));
+                glGetProgramiv (prog, GL_LINK_STATUS, &status);
+
+                // A rejected binary may leave the program in any state.
+
+                if (!(ok = (status != 0)))
+                {
+                    glDeleteProgram(prog);
+                    prog = glCreateProgram();
+                }
+            }
+        }
+        ::data->free(file);
+    }
+    return ok;
+}
+
+// Store the binary of this freshly-linked program.
+
+void ogl::program::save_binary(const std::string& path, unsigned long long key)
+{
+    GLint len = 0;
+
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+
+    if (len > 0)
+    {
+        std::vector<GLubyte> v(sizeof (cache_head) + len);
+
+        cache_head h;
+        GLsizei    n = 0;
+
+        glGetProgramBinary(prog, len, &n, &h.format, &v[sizeof (cache_head)]);
+
+        h.magic   = CACHE_MAGIC;
+        h.version = CACHE_VERSION;
+        h.size    = GLuint(n);
+        h.key     = key;
+
+        memcpy(&v.front(), &h, sizeof (cache_head));
+
+        // The cache is an optimization. Failure to write it is not an error.
+
+        try
+        {
+            size_t s = sizeof (cache_head) + n;
+            ::data->save(cache_name(path), &v.front(), &s);
+        }
+        catch (std::runtime_error&)
+        {
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
 void ogl::program::init()
 {
     if (ogl::context)
@@ -262,30 +491,50 @@ void ogl::program::init()
             const std::string frag_name = root.get_s("frag");
 
             discard = root.get_i("discard") ? true : false;
+            layered = root.get_i("array") && ogl::do_texture_array;
 
             // Load the shader files.
 
-            const std::string vert_text = load(vert_name);
-            const std::string frag_text = load(frag_name);
+            const std::string vert_text = define(load(vert_name), layered);
+            const std::string frag_text = define(load(frag_name), layered);
 
-            // Compile the shaders.
+            // Use the cached binary if the driver accepts it.
 
-            vert = compile(GL_VERTEX_SHADER,   vert_name, vert_text);
-            frag = compile(GL_FRAGMENT_SHADER, frag_name, frag_text);
-
-            // Link the shader objects to a program object.
+            const bool cache = ogl::do_program_cache;
+            const unsigned long long key = cache ?
+                cache_key(root, vert_text, frag_text) : 0;
 
             prog = glCreateProgram();
 
-            if (vert) glAttachShader(prog, vert);
-            if (frag) glAttachShader(prog, frag);
+            if (cache && read_binary(path, key))
+                bindable = true;
+            else
+            {
+                // Compile the shaders.
+
+                vert = compile(GL_VERTEX_SHADER,   vert_name, vert_text);
+                frag = compile(GL_FRAGMENT_SHADER, frag_name, frag_text);
 
-            // Link the program.
+                // Link the shader objects to a program object.
 
-            init_attributes(root);
-            glLinkProgram(prog);
+                if (vert) glAttachShader(prog, vert);
+                if (frag) glAttachShader(prog, frag);
 
-            bindable = !program_log(prog, path);
+                // Link the program and cache the result.
+
+                init_attributes(root);
+
+                if (cache)
+                    glProgramParameteri(prog,
+                                        GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                        GL_TRUE);
+                glLinkProgram(prog);
+
+                bindable = !program_log(prog, path);
+
+                if (cache && bindable)
+                    save_binary(path, key);
+            }
 
             // Configure the program.
 
@@ -296,6 +545,7 @@ void ogl::program::init()
                     init_textures (root);
                     init_processes(root);
                     init_uniforms (root);
+                    init_blocks   (root);
                 }
                 free();
                 prep();
@@ -320,6 +570,9 @@ void ogl::program::fini()
         uniforms.clear();
         processes.clear();
         textures.clear();
+        loaded.clear();
+
+        ogl::drop_program(prog);
 
         if (prog) glDeleteProgram(prog);
         if (vert) glDeleteShader(vert);
@@ -0,0 +1,223 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+
+#include <ogl-s3tc.hpp>
+
+//-----------------------------------------------------------------------------
+
+// Pack an 8-bit color to 5:6:5 and expand it back.
+
+static GLushort pack565(const int *c)
+{
+    return GLushort(((c[0] * 31 + 127) / 255) << 11 |
+                    ((c[1] * 63 + 127) / 255) <<  5 |
+                    ((c[2] * 31 + 127) / 255));
+}
+
+static void unpack565(GLushort p, int *c)
+{
+    const int r = (p >> 11) & 31;
+    const int g = (p >>  5) & 63;
+    const int b = (p      ) & 31;
+
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void put16(GLubyte *p, GLuint v)
+{
+    p[0] = GLubyte(v      );
+    p[1] = GLubyte(v >>  8);
+}
+
+static void put32(GLubyte *p, GLuint v)
+{
+    p[0] = GLubyte(v      );
+    p[1] = GLubyte(v >>  8);
+    p[2] = GLubyte(v >> 16);
+    p[3] = GLubyte(v >> 24);
+}
+
+//-----------------------------------------------------------------------------
+
+// Encode the colors of a block of 16 RGBA pixels as 8 bytes of DXT1, always
+// in four-color mode.
+
+static void encode_color(const int B[16][4], GLubyte *dst)
+{
+    int lo[3] = { 255, 255, 255 };
+    int hi[3] = {   0,   0,   0 };
+
+    for (int i = 0; i < 16; ++i)
+        for (int k = 0; k < 3; ++k)
+        {
+            lo[k] = std::min(lo[k], B[i][k]);
+            hi[k] = std::max(hi[k], B[i][k]);
+        }
+
+    // Inset the bounding box slightly to reduce the error at the ends.
+
+    for (int k = 0; k < 3; ++k)
+    {
+        const int d = (hi[k] - lo[k]) / 16;
+
+        lo[k] += d;
+        hi[k] -= d;
+    }
+
+    GLushort c0 = pack565(hi);
+    GLushort c1 = pack565(lo);
+    GLuint   ix = 0;
+
+    if (c0 < c1) std::swap(c0, c1);
+
+    if (c0 != c1)
+    {
+        int P[4][3];
+
+        unpack565(c0, P[0]);
+        unpack565(c1, P[1]);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            P[2][k] = (2 * P[0][k] + P[1][k]) / 3;
+            P[3][k] = (P[0][k] + 2 * P[1][k]) / 3;
+        }
+
+        // Choose the nearest palette entry for each pixel.
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0;
+            int dmin = 0x7FFFFFFF;
+
+            for (int j = 0; j < 4; ++j)
+            {
+                const int dr = B[i][0] - P[j][0];
+                const int dg = B[i][1] - P[j][1];
+                const int db = B[i][2] - P[j][2];
+                const int d  = dr * dr + dg * dg + db * db;
+
+                if (d < dmin)
+                {
+                    dmin = d;
+                    best = j;
+                }
+            }
+            ix |= GLuint(best) << (2 * i);
+        }
+    }
+
+    put16(dst + 0, c0);
+    put16(dst + 2, c1);
+    put32(dst + 4, ix);
+}
+
+// Encode the alphas of a block of 16 RGBA pixels as 8 bytes of DXT5, always
+// in eight-alpha mode.
+
+static void encode_alpha(const int B[16][4], GLubyte *dst)
+{
+    int a0 = 0;
+    int a1 = 255;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        a0 = std::max(a0, B[i][3]);
+        a1 = std::min(a1, B[i][3]);
+    }
+
+    unsigned long long ix = 0;
+
+    if (a0 != a1)
+    {
+        // Index 0 is a0, index 1 is a1, and indices 2 through 7 interpolate
+        // between them.
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int t = ((a0 - B[i][3]) * 7 + (a0 - a1) / 2) / (a0 - a1);
+            int j = (t == 0) ? 0 : (t == 7) ? 1 : t + 1;
+
+            ix |= (unsigned long long) j << (3 * i);
+        }
+    }
+
+    dst[0] = GLubyte(a0);
+    dst[1] = GLubyte(a1);
+
+    for (int k = 0; k < 6; ++k)
+        dst[2 + k] = GLubyte(ix >> (8 * k));
+}
+
+//-----------------------------------------------------------------------------
+
+// Return the compressed format for C channels, or zero if not compressible.
+
+GLenum ogl::s3tc_format(GLsizei c)
+{
+    switch (c)
+    {
+    case 3: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case 4: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+    return 0;
+}
+
+// Return the compressed size of a W by H image with C channels.
+
+GLsizei ogl::s3tc_size(GLsizei w, GLsizei h, GLsizei c)
+{
+    return ((w + 3) / 4) * ((h + 3) / 4) * (c == 4 ? 16 : 8);
+}
+
+// Encode a W by H image with C channels from SRC to DST.
+
+void ogl::s3tc_encode(GLsizei w, GLsizei h, GLsizei c, const GLubyte *src,
+                                                             GLubyte *dst)
+{
+    int B[16][4];
+
+    for     (GLsizei y = 0; y < h; y += 4)
+        for (GLsizei x = 0; x < w; x += 4)
+        {
+            // Gather the block, replicating the edges of partial blocks.
+
+            for     (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j)
+                {
+                    const GLsizei r = std::min(y + i, h - 1);
+                    const GLsizei s = std::min(x + j, w - 1);
+                    const GLubyte *p = src + (r * w + s) * c;
+
+                    B[i * 4 + j][0] = p[0];
+                    B[i * 4 + j][1] = p[1];
+                    B[i * 4 + j][2] = p[2];
+                    B[i * 4 + j][3] = (c == 4) ? p[3] : 255;
+                }
+
+            // Encode it.
+
+            if (c == 4)
+            {
+                encode_alpha(B, dst);
+                dst += 8;
+            }
+            encode_color(B, dst);
+            dst += 8;
+        }
+}
+
+//-----------------------------------------------------------------------------
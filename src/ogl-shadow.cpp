@@ -24,7 +24,9 @@ ogl::shadow::shadow(const std::string& name) :
 
     size(::conf->get_i("shadow_map_resolution", 1024)),
     buff(::glob->new_frame(size, size, GL_TEXTURE_2D,
-                           GL_RGBA8, false, true, false))
+                           GL_RGBA8, false, true, false)),
+    save(0),
+    saved(false)
 {
 }
 
@@ -32,6 +34,8 @@ ogl::shadow::~shadow()
 {
     assert(buff);
     ::glob->free_frame(buff);
+
+    if (save) ::glob->free_frame(save);
 }
 
 //-----------------------------------------------------------------------------
@@ -48,6 +52,34 @@ void ogl::shadow::free_frame() const
     buff->free();
 }
 
+// Copy the shadow map to a second buffer, allocated as needed, from which it
+// may later be restored.
+
+void ogl::shadow::save_frame()
+{
+    assert(buff);
+
+    if (save == 0)
+        save = ::glob->new_frame(size, size, GL_TEXTURE_2D,
+                                 GL_RGBA8, false, true, false);
+    save->copy(buff);
+    saved = true;
+}
+
+// Restore the last saved shadow map, if it remains.
+
+bool ogl::shadow::load_frame() const
+{
+    assert(buff);
+
+    if (saved)
+    {
+        buff->copy(save);
+        return true;
+    }
+    return false;
+}
+
 void ogl::shadow::bind(GLenum unit) const
 {
     assert(buff);
@@ -68,4 +100,11 @@ void ogl::shadow::bind(GLenum unit) const
     glActiveTexture(GL_TEXTURE0);
 }
 
+// The saved shadow map does not survive the context.
+
+void ogl::shadow::fini()
+{
+    saved = false;
+}
+
 //-----------------------------------------------------------------------------
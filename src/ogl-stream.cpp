@@ -0,0 +1,328 @@
+//  Copyright (C) 2007-2011 Robert Kooima
+//
+//  THUMB is free software; you can redistribute it and/or modify it under
+//  the terms of  the GNU General Public License as  published by the Free
+//  Software  Foundation;  either version 2  of the  License,  or (at your
+//  option) any later version.
+//
+//  This program  is distributed in the  hope that it will  be useful, but
+//  WITHOUT   ANY  WARRANTY;   without  even   the  implied   warranty  of
+//  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
+//  General Public License for more details.
+
+#include <algorithm>
+#include <cstring>
+
+#include <ogl-stream.hpp>
+#include <app-conf.hpp>
+
+//-----------------------------------------------------------------------------
+
+unsigned long long ogl::stream::bytes = 0;
+
+ogl::stream::stream() :
+    mode(stream_sub), buffer(0), size(0), head(0), ptr(0), touch(0)
+{
+    for (int s = 0; s < fences; ++s)
+        fence[s] = 0;
+}
+
+ogl::stream::~stream()
+{
+}
+
+// Return the total number of bytes uploaded by all streams.
+
+unsigned long long ogl::stream::get_bytes()
+{
+    return bytes;
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::stream::add(GLenum target, GLintptr off, GLsizeiptr siz,
+                                                   const GLvoid *dat)
+{
+    if (siz > 0)
+        queue.push_back(range(target, off, siz, (const GLubyte *) dat));
+}
+
+void ogl::stream::flush()
+{
+    if (!queue.empty())
+    {
+        if (mode != stream_sub)
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+        // Sort the queue by destination and write each contiguous run.
+
+        std::sort(queue.begin(), queue.end());
+
+        for (size_t i = 0, j = 1; i < queue.size(); i = j++)
+        {
+            while (j < queue.size() && queue[j].target == queue[i].target
+                                    && queue[j].off == queue[j - 1].off
+                                                     + queue[j - 1].siz)
+                ++j;
+
+            write(i, j);
+        }
+
+        if (mode != stream_sub)
+        {
+            mark();
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        queue.clear();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Write the contiguous run of queued ranges [i, j).
+
+void ogl::stream::write(size_t i, size_t j)
+{
+    const GLenum target = queue[i].target;
+
+    GLintptr   dst = queue[i].off;
+    GLsizeiptr len = queue[j - 1].off + queue[j - 1].siz - dst;
+
+    if (mode == stream_sub)
+    {
+        // Upload a lone range directly. Gather a longer run first.
+
+        if (j - i == 1)
+            write(target, dst, len, queue[i].dat);
+        else
+        {
+            cache.resize(len);
+
+            for (size_t k = i; k < j; ++k)
+                memcpy(&cache[queue[k].off - dst], queue[k].dat, queue[k].siz);
+
+            write(target, dst, len, &cache.front());
+        }
+    }
+    else
+    {
+        // Gather the run into the ring, a ring-full at a time, and copy each
+        // piece to its destination.
+
+        size_t     k = i;
+        GLsizeiptr q = 0;
+
+        while (len > 0)
+        {
+            GLsizeiptr n = std::min(len, size);
+            GLsizeiptr m = 0;
+            GLubyte   *p = reserve(n);
+
+            while (m < n)
+            {
+                GLsizeiptr c = std::min(n - m, queue[k].siz - q);
+
+                memcpy(p + m, queue[k].dat + q, c);
+
+                m += c;
+                q += c;
+
+                if (q == queue[k].siz)
+                {
+                    q = 0;
+                    k++;
+                }
+            }
+            commit(target, dst, n);
+
+            dst += n;
+            len -= n;
+        }
+    }
+}
+
+// Upload a single range to the bound buffer object.
+
+void ogl::stream::write(GLenum target, GLintptr off, GLsizeiptr siz,
+                                                     const GLubyte *dat)
+{
+    const GLsizeiptr max = 1024 * 256;
+
+    // This works around an apparent bug under OSX 10.5.6 (using an NVIDIA
+    // GeForce 8800GT) that corrupts uploads larger than about a megabyte.
+
+    bytes += siz;
+
+    while (siz > 0)
+    {
+        GLsizeiptr len = std::min(siz, max);
+
+        glBufferSubData(target, off, len, dat);
+
+        off += len;
+        dat += len;
+        siz -= len;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Return a pointer to n bytes of the ring, wrapping as needed. A persistent
+// ring waits for the GPU to finish reading any section about to be reused.
+// An orphaned ring is given fresh storage instead.
+
+GLubyte *ogl::stream::reserve(GLsizeiptr n)
+{
+    head = (head + 63) & ~GLintptr(63);
+
+    if (head + n > size)
+    {
+        if (mode == stream_orphan)
+            glBufferData(GL_COPY_READ_BUFFER, size, 0, GL_STREAM_DRAW);
+        else
+            mark();
+
+        head = 0;
+    }
+
+    if (mode == stream_persist)
+    {
+        const GLsizeiptr sec = size / fences;
+
+        for (int s = int(head / sec); s <= int((head + n - 1) / sec); ++s)
+        {
+            wait(s);
+            touch |= 1U << s;
+        }
+        return ptr + head;
+    }
+    else
+        return (GLubyte *) glMapBufferRange(GL_COPY_READ_BUFFER, head, n,
+                                            GL_MAP_WRITE_BIT |
+                                            GL_MAP_INVALIDATE_RANGE_BIT |
+                                            GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+// Copy n bytes from the head of the ring to the given destination.
+
+void ogl::stream::commit(GLenum target, GLintptr dst, GLsizeiptr n)
+{
+    if (mode == stream_orphan)
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, target, head, dst, n);
+
+    bytes += n;
+    head  += n;
+}
+
+// Wait for the GPU to finish reading section s of the ring.
+
+void ogl::stream::wait(int s)
+{
+    if (fence[s])
+    {
+        while (glClientWaitSync(fence[s], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fence[s]);
+        fence[s] = 0;
+    }
+}
+
+// Fence all sections of the ring written since the last mark.
+
+void ogl::stream::mark()
+{
+    for (int s = 0; s < fences; ++s)
+        if (touch & (1U << s))
+        {
+            if (fence[s]) glDeleteSync(fence[s]);
+            fence[s] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+    touch = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::stream::init()
+{
+    if (ogl::context)
+    {
+        // Choose the best staging mode allowed by the configuration.
+
+        int want = ::conf->get_i("pool_stream", stream_persist);
+
+        size = ::conf->get_i("pool_stream_size", 4194304);
+        size = std::max(size, GLsizeiptr(65536)) & ~GLsizeiptr(255);
+        head = 0;
+        mode = stream_sub;
+
+        if (!ogl::has_copy_buffer)
+            want = stream_sub;
+
+        if (want >= stream_persist && ogl::has_buffer_storage)
+        {
+            const GLbitfield bits = GL_MAP_WRITE_BIT
+                                  | GL_MAP_PERSISTENT_BIT
+                                  | GL_MAP_COHERENT_BIT;
+
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glBufferStorage(GL_COPY_READ_BUFFER, size, 0, bits);
+
+            if ((ptr = (GLubyte *) glMapBufferRange(GL_COPY_READ_BUFFER,
+                                                    0, size, bits)))
+                mode = stream_persist;
+            else
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                glDeleteBuffers(1, &buffer);
+                buffer = 0;
+            }
+        }
+
+        if (want >= stream_orphan && mode == stream_sub
+                                  && ogl::has_map_buffer_range)
+        {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glBufferData(GL_COPY_READ_BUFFER, size, 0, GL_STREAM_DRAW);
+
+            mode = stream_orphan;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+}
+
+void ogl::stream::fini()
+{
+    if (ogl::context)
+    {
+        for (int s = 0; s < fences; ++s)
+            if (fence[s])
+            {
+                glDeleteSync(fence[s]);
+                fence[s] = 0;
+            }
+
+        if (ptr)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+
+        if (buffer) glDeleteBuffers(1, &buffer);
+
+        buffer = 0;
+        ptr    = 0;
+        touch  = 0;
+        mode   = stream_sub;
+    }
+    queue.clear();
+}
+
+//-----------------------------------------------------------------------------
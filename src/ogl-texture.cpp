@@ -10,11 +10,21 @@
 //  MERCHANTABILITY  or FITNESS  FOR A  PARTICULAR PURPOSE.   See  the GNU
 //  General Public License for more details.
 
+#include <algorithm>
 #include <stdexcept>
+#include <cstring>
+#include <list>
+#include <memory>
 
 #include <png.h>
+#include <SDL.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #include <ogl-texture.hpp>
+#include <ogl-s3tc.hpp>
 #include <app-file.hpp>
 #include <app-conf.hpp>
 #include <app-data.hpp>
@@ -25,7 +35,15 @@
 
 //-----------------------------------------------------------------------------
 
-ogl::texture::texture(std::string name) : name(name), object(0), w(0), h(0), c(0)
+// A flat normal, shown until the image is resident or if it fails to load.
+
+const GLubyte ogl::texture::placeholder[4] = { 128, 128, 255, 255 };
+
+//-----------------------------------------------------------------------------
+
+ogl::texture::texture(std::string name) :
+    name(name), object(0), w(0), h(0), c(0), ready(false), failed(false),
+    params(false)
 {
     init();
 }
@@ -58,13 +76,48 @@ static void png_user_read(png_structp rp, png_bytep buf, png_size_t len)
 
 //-----------------------------------------------------------------------------
 
+// Halve an image in place by box filter. RGBA rows are filtered two output
+// pixels at a time with SSE2, where available, giving the same truncated
+// average as the scalar loop.
+
 static void downsample(GLsizei W, GLsizei H, GLsizei C, std::vector<GLubyte>& P)
 {
     const GLsizei w = W / 2;
     const GLsizei h = H / 2;
 
-    for         (GLsizei i = 0; i < h; i++)
-        for     (GLsizei j = 0; j < w; j++)
+    for (GLsizei i = 0; i < h; i++)
+    {
+        GLsizei j = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+        if (C == 4)
+        {
+            const __m128i z = _mm_setzero_si128();
+
+            for (; j + 1 < w; j += 2)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)
+                                  &P[((2 * i + 0) * W + 2 * j) * 4]);
+                __m128i b = _mm_loadu_si128((const __m128i *)
+                                  &P[((2 * i + 1) * W + 2 * j) * 4]);
+
+                // Sum vertically, then horizontally, in 16 bits.
+
+                __m128i l = _mm_add_epi16(_mm_unpacklo_epi8(a, z),
+                                          _mm_unpacklo_epi8(b, z));
+                __m128i r = _mm_add_epi16(_mm_unpackhi_epi8(a, z),
+                                          _mm_unpackhi_epi8(b, z));
+                __m128i s = _mm_add_epi16(_mm_unpacklo_epi64(l, r),
+                                          _mm_unpackhi_epi64(l, r));
+
+                s = _mm_srli_epi16(s, 2);
+
+                _mm_storel_epi64((__m128i *) &P[(i * w + j) * 4],
+                                 _mm_packus_epi16(s, s));
+            }
+        }
+#endif
+        for (; j < w; j++)
             for (GLsizei k = 0; k < C; k++)
             {
                 GLuint b = GLuint(P[((2 * i + 0) * W + (2 * j + 0)) * C + k])
@@ -74,11 +127,57 @@ static void downsample(GLsizei W, GLsizei H, GLsizei C, std::vector<GLubyte>& P)
 
                 P[(i * w + j) * C + k] = GLubyte(b / 4);
             }
+    }
 }
 
 //-----------------------------------------------------------------------------
 
-void ogl::texture::load_png(const void *buf, size_t len, std::vector<GLubyte>& p)
+// Determine the size and channel count that load_png will give the named PNG
+// data, from its header, without decoding it. Return false if the data is not
+// a PNG.
+
+static bool png_header(const void *buf, size_t len,
+                          GLsizei& w, GLsizei& h, GLsizei& c)
+{
+    const GLubyte *p = (const GLubyte *) buf;
+
+    if (len < 33 || png_sig_cmp((png_bytep) p, 0, 8))
+        return false;
+
+    w = GLsizei((GLuint(p[16]) << 24) | (GLuint(p[17]) << 16)
+              | (GLuint(p[18]) <<  8) |  GLuint(p[19]));
+    h = GLsizei((GLuint(p[20]) << 24) | (GLuint(p[21]) << 16)
+              | (GLuint(p[22]) <<  8) |  GLuint(p[23]));
+
+    // Expansion adds alpha to any image with a transparency chunk.
+
+    bool trns = false;
+
+    for (size_t i = 8; i + 8 <= len; )
+    {
+        size_t n = (size_t(p[i + 0]) << 24) | (size_t(p[i + 1]) << 16)
+                 | (size_t(p[i + 2]) <<  8) |  size_t(p[i + 3]);
+
+        if (memcmp(p + i + 4, "tRNS", 4) == 0) trns = true;
+        if (memcmp(p + i + 4, "IDAT", 4) == 0) break;
+
+        i += n + 12;
+    }
+
+    switch (p[25])
+    {
+        case PNG_COLOR_TYPE_GRAY:       c = trns ? 2 : 1; break;
+        case PNG_COLOR_TYPE_GRAY_ALPHA: c = 2;            break;
+        case PNG_COLOR_TYPE_PALETTE:
+        case PNG_COLOR_TYPE_RGB:        c = trns ? 4 : 3; break;
+        case PNG_COLOR_TYPE_RGB_ALPHA:  c = 4;            break;
+        default: return false;
+    }
+    return true;
+}
+
+void ogl::texture::load_png(const void *buf, size_t len, std::vector<GLubyte>& p,
+                            GLsizei& w, GLsizei& h, GLsizei& c)
 {
     // Initialize all PNG import data structures.
 
@@ -127,6 +226,11 @@ void ogl::texture::load_png(const void *buf, size_t len, std::vector<GLubyte>& p
             for (GLsizei i = 0, j = h - 1; i < h; ++i, --j)
                 memcpy(&p[w * c * i], bp[j], (w * c));
     }
+    else
+    {
+        png_destroy_read_struct(&rp, &ip, 0);
+        throw std::runtime_error("Failure reading PNG");
+    }
 
     // Release all resources.
 
@@ -242,7 +346,11 @@ void ogl::texture::load_prm(std::string name)
                 GLenum key = wrap_key(n.get_s("axis"));
                 GLenum val = wrap_val(n.get_s("value"));
 
-                if (key && val) glTexParameteri(GL_TEXTURE_2D, key, val);
+                if (key && val)
+                {
+                    glTexParameteri(GL_TEXTURE_2D, key, val);
+                    params = true;
+                }
             }
 
             // Parse and apply filter modes.
@@ -252,68 +360,217 @@ void ogl::texture::load_prm(std::string name)
                 GLenum key = filter_key(n.get_s("type"));
                 GLenum val = filter_val(n.get_s("value"));
 
-                if (key && val) glTexParameteri(GL_TEXTURE_2D, key, val);
+                if (key && val)
+                {
+                    glTexParameteri(GL_TEXTURE_2D, key, val);
+                    params = true;
+                }
             }
         }
     }
 }
 
-void ogl::texture::load_img(std::string name, std::map<int, vec4>& scale)
+//-----------------------------------------------------------------------------
+
+// The texture cache holds the complete mipmap chain of a texture with all
+// scale options applied, optionally S3TC-compressed, ready for upload with no
+// decoding. It is tagged with the size and modification stamp of the source
+// image and a hash of the options so that a stale cache is never used. Each
+// level is preceded by its size and padded to four bytes. All values are
+// native-endian. A change in layout must increment the version.
+
+#define CACHE_MAGIC   0x43584554 // "TEXC"
+#define CACHE_VERSION 1
+
+struct cache_head
 {
-    std::vector<GLubyte> pixels;
+    GLuint    magic;
+    GLuint    version;
+    GLsizei   w;
+    GLsizei   h;
+    GLsizei   c;
+    GLenum    format;
+    GLuint    compressed;
+    GLuint    levels;
+    GLuint    options;
+    long long len;
+    long long stamp;
+};
+
+static std::string cache_name(const std::string& name)
+{
+    return name + ".cache";
+}
+
+// Return the number of mipmap levels in the cache representation in [P, P+N).
+// An image that failed to decode has none.
+
+static GLuint cache_levels(const GLubyte *p, size_t n)
+{
+    cache_head head;
+
+    if (p == 0 || n < sizeof (cache_head))
+        return 0;
+
+    memcpy(&head, p, sizeof (cache_head));
+    return head.levels;
+}
 
-    // Load and parse the data file.
+// Give the bound texture a 1x1 placeholder image.
 
-    size_t      len;
-    const void *buf = ::data->load(name, &len);
+static void load_placeholder()
+{
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, ogl::texture::placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
 
-    if (buf) load_png(buf, len, pixels);
+// Hash the options that alter the cached pixels.
 
-    ::data->free(name);
+static GLuint cache_options(const std::map<int, vec4>& scale)
+{
+    GLuint h = 2166136261U;
 
-    // Initialize the OpenGL texture object.
+    for (std::map<int, vec4>::const_iterator i = scale.begin();
+                                             i != scale.end(); ++i)
+    {
+        GLfloat v[5] = { GLfloat(i->first),
+                         GLfloat(i->second[0]), GLfloat(i->second[1]),
+                         GLfloat(i->second[2]), GLfloat(i->second[3]) };
 
-    GLenum f = GL_RGBA;
+        for (size_t k = 0; k < sizeof (v); ++k)
+        {
+            h ^= ((const GLubyte *) v)[k];
+            h *= 16777619U;
+        }
+    }
+    return ogl::do_texture_compression ? ~h : h;
+}
 
+// Apply a scale to N pixels of C channels, clamping as glPixelTransfer does.
+// Luminance scales by red.
+
+static void scale_pixels(GLsizei n, GLsizei c, const vec4& s,
+                         const GLubyte *src, GLubyte *dst)
+{
+    int k[4] = { 0, 1, 2, 3 };
+
+    if (c < 3) k[1] = 3;
+
+    for     (GLsizei i = 0; i < n; ++i)
+        for (GLsizei j = 0; j < c; ++j)
+        {
+            double v = src[i * c + j] * s[k[j]] + 0.5;
+
+            dst[i * c + j] = GLubyte(std::min(v, 255.0));
+        }
+}
+
+// Return the pixel format of an image of C channels.
+
+static GLenum pixel_format(GLsizei c)
+{
     switch (c)
     {
-        case 1: f = GL_LUMINANCE;
-        case 2: f = GL_LUMINANCE_ALPHA;
-        case 3: f = GL_RGB;
+        case 1:  return GL_LUMINANCE;
+        case 2:  return GL_LUMINANCE_ALPHA;
+        case 3:  return GL_RGB;
+        default: return GL_RGBA;
     }
+}
+
+// Append V to vector P, padded to four bytes.
+
+static void append(std::vector<GLubyte>& p, const void *v, size_t n)
+{
+    p.insert(p.end(), (const GLubyte *) v, (const GLubyte *) v + n);
+    p.resize((p.size() + 3) & ~size_t(3), 0);
+}
+
+//-----------------------------------------------------------------------------
+
+// Decode the given PNG data and build the cache representation of its
+// mipmaps. This touches no GL or data state and may run on any thread.
+
+void ogl::texture::make_mip(const void *buf, size_t n,
+                            const std::map<int, vec4>& scale,
+                            std::vector<GLubyte>& v,
+                            size_t len, long long stamp, GLuint opt)
+{
+    std::vector<GLubyte> pixels;
+    std::vector<GLubyte> level;
+    std::vector<GLubyte> block;
+
+    GLsizei w = 0;
+    GLsizei h = 0;
+    GLsizei c = 0;
 
-    ogl::bind_texture(GL_TEXTURE_2D, GL_TEXTURE0, object);
+    if (buf) load_png(buf, n, pixels, w, h, c);
+
+    // Choose the format.
+
+    GLenum f = pixel_format(c);
+    GLenum z = ogl::do_texture_compression ? ogl::s3tc_format(c) : 0;
+
+    // Write the header, counting levels as they are added.
+
+    cache_head head;
+
+    head.magic      = CACHE_MAGIC;
+    head.version    = CACHE_VERSION;
+    head.w          = w;
+    head.h          = h;
+    head.c          = c;
+    head.format     = z ? z : f;
+    head.compressed = z ? 1 : 0;
+    head.levels     = 0;
+    head.options    = opt;
+    head.len        = (long long) len;
+    head.stamp      = stamp;
+
+    v.clear();
+    append(v, &head, sizeof (cache_head));
 
-    GLubyte *p = &pixels.front();
     GLsizei ww = w;
     GLsizei hh = h;
 
     // Enumerate the mipmap levels.
 
-    for (GLint l = 0; ww > 0 && hh > 0; l++)
+    for (GLint l = 0; ww > 0 && hh > 0 && !pixels.empty(); l++)
     {
-        std::map<int, vec4>::iterator it;
+        std::map<int, vec4>::const_iterator it;
 
-        // Set the scale for this mipmap.
+        // Apply the scale for this mipmap.
 
-        if ((it = scale.find(l)) == scale.end())
+        const GLubyte *p = &pixels.front();
+
+        if ((it = scale.find(l)) != scale.end())
         {
-            glPixelTransferf(GL_RED_SCALE,   1.f);
-            glPixelTransferf(GL_GREEN_SCALE, 1.f);
-            glPixelTransferf(GL_BLUE_SCALE,  1.f);
-            glPixelTransferf(GL_ALPHA_SCALE, 1.f);
+            level.resize(ww * hh * c);
+            scale_pixels(ww * hh, c, it->second, p, &level.front());
+            p = &level.front();
         }
-        else
+
+        // Compress it if requested, and append it.
+
+        if (z)
         {
-            glPixelTransferf(GL_RED_SCALE,   GLfloat(it->second[0]));
-            glPixelTransferf(GL_GREEN_SCALE, GLfloat(it->second[1]));
-            glPixelTransferf(GL_BLUE_SCALE,  GLfloat(it->second[2]));
-            glPixelTransferf(GL_ALPHA_SCALE, GLfloat(it->second[3]));
-        }
+            GLuint k = GLuint(ogl::s3tc_size(ww, hh, c));
 
-        // Copy the pixels.
+            block.resize(k);
+            ogl::s3tc_encode(ww, hh, c, p, &block.front());
 
-        glTexImage2D(GL_TEXTURE_2D, l, f, ww, hh, 0, f, GL_UNSIGNED_BYTE, p);
+            append(v, &k, sizeof (GLuint));
+            append(v, &block.front(), k);
+        }
+        else
+        {
+            GLuint k = GLuint(ww * hh * c);
+
+            append(v, &k, sizeof (GLuint));
+            append(v, p, k);
+        }
+        head.levels++;
 
         // Prepare for the next mipmap level.
 
@@ -322,14 +579,540 @@ void ogl::texture::load_img(std::string name, std::map<int, vec4>& scale)
         hh /= 2;
     }
 
-    // Initialize the default texture parameters.
+    memcpy(&v.front(), &head, sizeof (cache_head));
+}
+
+// Upload all mipmap levels from the cache representation in [P, E) to the
+// bound texture. Return false if the data is truncated. If PBO is set, then
+// the same data is in the bound pixel unpack buffer, starting at offset 0.
+
+bool ogl::texture::load_mip(const GLubyte *p, const GLubyte *e, bool pbo)
+{
+    const GLubyte *b = p;
+
+    cache_head head;
+
+    if (size_t(e - p) < sizeof (cache_head))
+        return false;
+
+    memcpy(&head, p, sizeof (cache_head));
+    p += (sizeof (cache_head) + 3) & ~size_t(3);
+
+    w = head.w;
+    h = head.h;
+    c = head.c;
+
+    GLsizei ww = head.w;
+    GLsizei hh = head.h;
+
+    for (GLuint l = 0; l < head.levels; ++l)
+    {
+        GLuint k;
+
+        if (size_t(e - p) < sizeof (GLuint))
+            return false;
+
+        memcpy(&k, p, sizeof (GLuint));
+        p += (sizeof (GLuint) + 3) & ~size_t(3);
+
+        if (size_t(e - p) < k)
+            return false;
+
+        const GLvoid *d = pbo ? (const GLvoid *) size_t(p - b) : p;
+
+        if (head.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, head.format, ww, hh, 0,
+                                   GLsizei(k), d);
+        else
+            glTexImage2D(GL_TEXTURE_2D, l, head.format, ww, hh, 0,
+                         head.format, GL_UNSIGNED_BYTE, d);
+
+        p += (size_t(k) + 3) & ~size_t(3);
+
+        ww /= 2;
+        hh /= 2;
+    }
+
+    // A non-square chain ends before 1x1. Mark the last level given.
+
+    if (head.levels)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, head.levels - 1);
+
+    return true;
+}
+
+// Map the cached mipmaps of the named image, if current, and return a pointer
+// to them with their size in N. The caller frees the cache name when done.
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+const GLubyte *ogl::texture::map_cache(const std::string& name, size_t len,
+                                                                long long stamp,
+                                                                GLuint opt,
+                                                                size_t& n)
+{
+    const std::string path = cache_name(name);
+
+    if (::data->find(path))
+    {
+        const GLubyte *p = (const GLubyte *) ::data->map(path, &n);
+
+        cache_head head;
+
+        if (p && n >= sizeof (cache_head))
+        {
+            memcpy(&head, p, sizeof (cache_head));
+
+            if (head.magic   == CACHE_MAGIC   &&
+                head.version == CACHE_VERSION &&
+                head.options == opt           &&
+                head.len     == (long long) len && head.stamp == stamp &&
+                head.levels  >  0)
+
+                return p;
+        }
+        ::data->free(path);
+    }
+    return 0;
+}
+
+void ogl::texture::save_cache(const std::string& name,
+                              const std::vector<GLubyte>& v)
+{
+    // The cache is an optimization. Failure to write it is not an error.
 
-    if (ogl::has_anisotropic)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
-                                                ogl::max_anisotropy);
+    try
+    {
+        size_t n = v.size();
+        ::data->save(cache_name(name), &v.front(), &n);
+    }
+    catch (std::runtime_error&)
+    {
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void ogl::texture::load_img(std::string name, std::map<int, vec4>& scale)
+{
+    size_t    len   = 0;
+    long long stamp = 0;
+
+    const GLuint opt = cache_options(scale);
+
+    // Use the texture cache if it is current. Otherwise build and recache.
+
+    bool cache = (::conf->get_i("texture_cache", 1)
+                  && ::data->stat(name, &len, &stamp));
+
+    size_t         n = 0;
+    const GLubyte *p = cache ? map_cache(name, len, stamp, opt, n) : 0;
+
+    if (p)
+    {
+        load_mip(p, p + n);
+        ::data->free(cache_name(name));
+    }
+    else
+    {
+        std::vector<GLubyte> v;
+
+        const void *buf = ::data->load(name, &n);
+
+        try
+        {
+            make_mip(buf, n, scale, v, len, stamp, opt);
+        }
+        catch (std::exception&)
+        {
+            v.clear();
+        }
+
+        ::data->free(name);
+
+        // On failure the texture resolves to its placeholder.
+
+        if (cache_levels(v.empty() ? 0 : &v.front(), v.size()))
+        {
+            load_mip(&v.front(), &v.front() + v.size());
+
+            if (cache) save_cache(name, v);
+        }
+        else
+        {
+            load_placeholder();
+            failed = true;
+        }
+    }
+    ready = true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Background textures are decoded by a pool of worker threads. A job moves
+// from the todo list to the busy list while a worker decodes it, and on to
+// the done list to await upload by the render thread. A texture finalized
+// while its job is busy nulls the job's texture pointer, and the worker drops
+// it. File access and all GL calls remain on the render thread.
+
+namespace
+{
+    struct texture_job
+    {
+        ogl::texture *tex;
+
+        std::string          name;
+        std::map<int, vec4>  scale;
+        size_t               len;
+        long long            stamp;
+        GLuint               opt;
+        bool                 save;
+
+        std::vector<GLubyte> src;    // PNG data to decode
+        std::vector<GLubyte> mip;    // Decoded cache representation
+        const GLubyte       *ptr;    // ... or a mapped cache file
+        size_t               siz;
+    };
+
+    typedef std::list<texture_job *> texture_job_l;
+
+    struct texture_loader
+    {
+        std::vector<SDL_Thread *> thread;
+
+        SDL_mutex *mutex;
+        SDL_cond  *wake;
+
+        texture_job_l todo;
+        texture_job_l busy;
+        texture_job_l done;
+
+        bool quit;
+
+        texture_loader() : mutex(0), wake(0), quit(false) { }
+       ~texture_loader();
+
+        void init(SDL_ThreadFunction);
+        void drop(texture_job_l&, const ogl::texture *);
+    };
+
+    texture_loader loader;
+
+    texture_loader::~texture_loader()
+    {
+        if (mutex)
+        {
+            SDL_LockMutex(mutex);
+            {
+                quit = true;
+                SDL_CondBroadcast(wake);
+            }
+            SDL_UnlockMutex(mutex);
+
+            for (size_t i = 0; i < thread.size(); ++i)
+                SDL_WaitThread(thread[i], 0);
+
+            // Data may already be gone at exit. Release the jobs only.
+
+            for (texture_job_l::iterator i = todo.begin(); i != todo.end(); ++i)
+                delete (*i);
+            for (texture_job_l::iterator i = done.begin(); i != done.end(); ++i)
+                delete (*i);
+
+            SDL_DestroyCond (wake);
+            SDL_DestroyMutex(mutex);
+        }
+    }
+
+    // Start the configured number of workers, by default one per additional
+    // CPU, on first use.
+
+    void texture_loader::init(SDL_ThreadFunction func)
+    {
+        if (mutex == 0)
+        {
+            mutex = SDL_CreateMutex();
+            wake  = SDL_CreateCond();
+
+            int n = ::conf->get_i("texture_threads", 0);
+
+            if (n <= 0)
+                n = std::max(SDL_GetCPUCount() - 1, 1);
+
+            for (int i = 0; i < n; ++i)
+                if (SDL_Thread *t = SDL_CreateThread(func, "ogl::texture", this))
+                    thread.push_back(t);
+        }
+    }
+
+    // Delete all jobs of the given texture. The mutex must be held.
+
+    void texture_loader::drop(texture_job_l& l, const ogl::texture *tex)
+    {
+        for (texture_job_l::iterator i = l.begin(); i != l.end(); )
+            if ((*i)->tex == tex)
+            {
+                if ((*i)->ptr)
+                    ::data->free(cache_name((*i)->name));
+
+                delete (*i);
+                i = l.erase(i);
+            }
+            else ++i;
+    }
+}
+
+int ogl::texture::work(void *data)
+{
+    texture_loader *p = (texture_loader *) data;
+
+    while (true)
+    {
+        texture_job *job = 0;
+
+        // Wait for a job or a request to quit.
+
+        SDL_LockMutex(p->mutex);
+        {
+            while (!p->quit && p->todo.empty())
+                SDL_CondWait(p->wake, p->mutex);
+
+            if (!p->quit)
+            {
+                job = p->todo.front();
+                p->todo.pop_front();
+                p->busy.push_back(job);
+            }
+        }
+        SDL_UnlockMutex(p->mutex);
+
+        if (job == 0) break;
+
+        // Decode the image. On failure the texture keeps its placeholder.
+
+        try
+        {
+            if (!job->src.empty())
+                make_mip(&job->src.front(), job->src.size(), job->scale,
+                          job->mip, job->len, job->stamp, job->opt);
+        }
+        catch (std::exception&)
+        {
+            job->mip.clear();
+        }
+        job->src.clear();
+
+        // Queue the result for upload, unless the texture is gone.
+
+        SDL_LockMutex(p->mutex);
+        {
+            p->busy.remove(job);
+
+            if (job->tex)
+                p->done.push_back(job);
+            else
+                delete job;
+        }
+        SDL_UnlockMutex(p->mutex);
+    }
+    return 0;
+}
+
+// Queue the named image for background load and give the texture a 1x1
+// flat-normal placeholder until it is resident. A current cache is mapped
+// here and needs only upload. Otherwise the image data is read here and
+// decoded by a worker. The channel count is read from the image header now so
+// that opacity is known before the texture arrives.
+
+void ogl::texture::load_bg(std::string name, std::map<int, vec4>& scale)
+{
+    std::auto_ptr<texture_job> job(new texture_job);
+
+    job->tex   = this;
+    job->name  = name;
+    job->scale = scale;
+    job->len   = 0;
+    job->stamp = 0;
+    job->opt   = cache_options(scale);
+    job->ptr   = 0;
+    job->siz   = 0;
+
+    job->save = (::conf->get_i("texture_cache", 1)
+                 && ::data->stat(name, &job->len, &job->stamp));
+
+    if (job->save &&
+       (job->ptr = map_cache(name, job->len, job->stamp, job->opt, job->siz)))
+    {
+        cache_head head;
+
+        memcpy(&head, job->ptr, sizeof (cache_head));
+        w = head.w;
+        h = head.h;
+        c = head.c;
+    }
+    else
+    {
+        size_t      n;
+        const void *buf = ::data->load(name, &n);
+
+        job->src.assign((const GLubyte *) buf, (const GLubyte *) buf + n);
+        png_header(buf, n, w, h, c);
+
+        ::data->free(name);
+    }
+
+    load_placeholder();
+
+    loader.init(work);
+
+    SDL_LockMutex(loader.mutex);
+    {
+        if (job->ptr)
+            loader.done.push_back(job.release());
+        else
+        {
+            loader.todo.push_back(job.release());
+            SDL_CondSignal(loader.wake);
+        }
+    }
+    SDL_UnlockMutex(loader.mutex);
+}
+
+// Upload textures completed by the workers, up to a per-call byte budget,
+// staging each through a pixel buffer object where supported. Call once per
+// frame on the render thread.
+
+void ogl::texture::sync()
+{
+    if (loader.mutex == 0)
+        return;
+
+    const size_t budget = size_t(::conf->get_i("texture_upload_budget",
+                                               16777216));
+    size_t bytes = 0;
+    GLuint pbo   = 0;
+
+    while (bytes < budget)
+    {
+        texture_job *job = 0;
+
+        SDL_LockMutex(loader.mutex);
+        {
+            if (!loader.done.empty())
+            {
+                job = loader.done.front();
+                loader.done.pop_front();
+            }
+        }
+        SDL_UnlockMutex(loader.mutex);
+
+        if (job == 0) break;
+
+        const GLubyte *p = job->ptr;
+        size_t         n = job->siz;
+
+        if (p == 0 && !job->mip.empty())
+        {
+            p = &job->mip.front();
+            n =  job->mip.size();
+        }
+
+        if (cache_levels(p, n))
+        {
+            bool staged = false;
+
+            ogl::bind_texture(GL_TEXTURE_2D, GL_TEXTURE0, job->tex->object);
+
+            // Copy the data to a fresh pixel buffer and source the upload
+            // from it, falling back to a direct upload if the map fails.
+
+            if (ogl::has_pixel_buffer)
+            {
+                if (pbo == 0)
+                    glGenBuffers(1, &pbo);
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, n, 0, GL_STREAM_DRAW);
+
+                if (GLvoid *q = glMapBuffer(GL_PIXEL_UNPACK_BUFFER,
+                                            GL_WRITE_ONLY))
+                {
+                    memcpy(q, p, n);
+                    staged = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)
+                           ? true : false;
+                }
+                if (!staged)
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            job->tex->load_mip(p, p + n, staged);
+            job->tex->ready = true;
+
+            if (staged)
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            if (job->ptr)
+                ::data->free(cache_name(job->name));
+            else if (job->save)
+                save_cache(job->name, job->mip);
+
+            bytes += n;
+        }
+        else
+        {
+            // The decode failed. Resolve the texture with its placeholder.
+
+            if (job->ptr)
+                ::data->free(cache_name(job->name));
+
+            job->tex->ready  = true;
+            job->tex->failed = true;
+        }
+        delete job;
+    }
+
+    if (pbo) glDeleteBuffers(1, &pbo);
+}
+
+// Return the number of textures not yet resident.
+
+int ogl::texture::pending()
+{
+    int n = 0;
+
+    if (loader.mutex)
+    {
+        SDL_LockMutex(loader.mutex);
+        {
+            n = int(loader.todo.size()
+                  + loader.busy.size()
+                  + loader.done.size());
+        }
+        SDL_UnlockMutex(loader.mutex);
+    }
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+
+// Return the internal format of the uploaded image.
+
+GLenum ogl::texture::get_format() const
+{
+    GLenum z = ogl::do_texture_compression ? ogl::s3tc_format(c) : 0;
+
+    return z ? z : pixel_format(c);
+}
+
+// Return the number of mipmap levels of the uploaded image. The chain ends
+// when either dimension reaches zero.
+
+GLint ogl::texture::get_levels() const
+{
+    GLint n = 0;
+
+    for (GLsizei ww = w, hh = h; ww > 0 && hh > 0; ww /= 2, hh /= 2)
+        n++;
+
+    return n;
 }
 
 //-----------------------------------------------------------------------------
@@ -355,18 +1138,57 @@ void ogl::texture::init()
 
         glGenTextures(1, &object);
 
+        ogl::bind_texture(GL_TEXTURE_2D, GL_TEXTURE0, object);
+
+        ready  = false;
+        failed = false;
+        params = false;
+
         load_opt(path, scale);
-        load_img(path, scale);
+
+        if (::conf->get_i("texture_async", 1))
+            load_bg (path, scale);
+        else
+            load_img(path, scale);
+
+        // Initialize the default texture parameters.
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                       GL_LINEAR_MIPMAP_LINEAR);
+
+        if (ogl::has_anisotropic)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+                                                    ogl::max_anisotropy);
         load_prm(path);
     }
 }
 
 void ogl::texture::fini()
 {
+    // Cancel any background load of this texture.
+
+    if (loader.mutex)
+    {
+        SDL_LockMutex(loader.mutex);
+        {
+            loader.drop(loader.todo, this);
+            loader.drop(loader.done, this);
+
+            for (texture_job_l::iterator i = loader.busy.begin();
+                                         i != loader.busy.end(); ++i)
+                if ((*i)->tex == this)
+                    (*i)->tex = 0;
+        }
+        SDL_UnlockMutex(loader.mutex);
+    }
+
     if (ogl::context)
     {
+        ogl::drop_texture(object);
         glDeleteTextures(1, &object);
         object = 0;
+        ready  = false;
     }
 }
 
@@ -11,14 +11,18 @@
 //  General Public License for more details.
 
 #include <cassert>
+#include <cstring>
 
 #include <ogl-uniform.hpp>
 
 //-----------------------------------------------------------------------------
 
-ogl::uniform::uniform(std::string name, GLsizei len) : name(name), len(len)
+ogl::uniform::uniform(std::string name, GLsizei len) :
+    name(name), len(len), ver(1)
 {
     val = new GLfloat[len];
+
+    memset(val, 0, len * sizeof (GLfloat));
 }
 
 ogl::uniform::~uniform()
@@ -28,73 +32,109 @@ ogl::uniform::~uniform()
 
 //-----------------------------------------------------------------------------
 
+// Copy a new value, noting a change of version only if it differs.
+
+void ogl::uniform::store(const GLfloat *v)
+{
+    if (memcmp(val, v, len * sizeof (GLfloat)))
+    {
+        memcpy(val, v, len * sizeof (GLfloat));
+        ver++;
+    }
+}
+
 void ogl::uniform::set(double a)
 {
-    val[0] = GLfloat(a);
+    GLfloat v[16] = { GLfloat(a) };
+
+    assert(len <= 16);
+
+    memcpy(v + 1, val + 1, (len - 1) * sizeof (GLfloat));
+    store(v);
 }
 
 void ogl::uniform::set(const vec2& v)
 {
     assert(len == 2);
 
-    val[0] = GLfloat(v[0]);
-    val[1] = GLfloat(v[1]);
+    GLfloat w[2];
+
+    w[0] = GLfloat(v[0]);
+    w[1] = GLfloat(v[1]);
+
+    store(w);
 }
 
 void ogl::uniform::set(const vec3& v)
 {
     assert(len == 3);
 
-    val[0] = GLfloat(v[0]);
-    val[1] = GLfloat(v[1]);
-    val[2] = GLfloat(v[2]);
+    GLfloat w[3];
+
+    w[0] = GLfloat(v[0]);
+    w[1] = GLfloat(v[1]);
+    w[2] = GLfloat(v[2]);
+
+    store(w);
 }
 
 void ogl::uniform::set(const vec4& v)
 {
     assert(len == 4);
 
-    val[0] = GLfloat(v[0]);
-    val[1] = GLfloat(v[1]);
-    val[2] = GLfloat(v[2]);
-    val[3] = GLfloat(v[3]);
+    GLfloat w[4];
+
+    w[0] = GLfloat(v[0]);
+    w[1] = GLfloat(v[1]);
+    w[2] = GLfloat(v[2]);
+    w[3] = GLfloat(v[3]);
+
+    store(w);
 }
 
 void ogl::uniform::set(const mat3& M)
 {
     assert(len == 9);
 
-    val[0] = GLfloat(M[0][0]);
-    val[1] = GLfloat(M[1][0]);
-    val[2] = GLfloat(M[2][0]);
-    val[3] = GLfloat(M[0][1]);
-    val[4] = GLfloat(M[1][1]);
-    val[5] = GLfloat(M[2][1]);
-    val[6] = GLfloat(M[0][2]);
-    val[7] = GLfloat(M[1][2]);
-    val[8] = GLfloat(M[2][2]);
+    GLfloat w[9];
+
+    w[0] = GLfloat(M[0][0]);
+    w[1] = GLfloat(M[1][0]);
+    w[2] = GLfloat(M[2][0]);
+    w[3] = GLfloat(M[0][1]);
+    w[4] = GLfloat(M[1][1]);
+    w[5] = GLfloat(M[2][1]);
+    w[6] = GLfloat(M[0][2]);
+    w[7] = GLfloat(M[1][2]);
+    w[8] = GLfloat(M[2][2]);
+
+    store(w);
 }
 
 void ogl::uniform::set(const mat4& M)
 {
     assert(len == 16);
 
-    val[ 0] = GLfloat(M[0][0]);
-    val[ 1] = GLfloat(M[1][0]);
-    val[ 2] = GLfloat(M[2][0]);
-    val[ 3] = GLfloat(M[3][0]);
-    val[ 4] = GLfloat(M[0][1]);
-    val[ 5] = GLfloat(M[1][1]);
-    val[ 6] = GLfloat(M[2][1]);
-    val[ 7] = GLfloat(M[3][1]);
-    val[ 8] = GLfloat(M[0][2]);
-    val[ 9] = GLfloat(M[1][2]);
-    val[10] = GLfloat(M[2][2]);
-    val[11] = GLfloat(M[3][2]);
-    val[12] = GLfloat(M[0][3]);
-    val[13] = GLfloat(M[1][3]);
-    val[14] = GLfloat(M[2][3]);
-    val[15] = GLfloat(M[3][3]);
+    GLfloat w[16];
+
+    w[ 0] = GLfloat(M[0][0]);
+    w[ 1] = GLfloat(M[1][0]);
+    w[ 2] = GLfloat(M[2][0]);
+    w[ 3] = GLfloat(M[3][0]);
+    w[ 4] = GLfloat(M[0][1]);
+    w[ 5] = GLfloat(M[1][1]);
+    w[ 6] = GLfloat(M[2][1]);
+    w[ 7] = GLfloat(M[3][1]);
+    w[ 8] = GLfloat(M[0][2]);
+    w[ 9] = GLfloat(M[1][2]);
+    w[10] = GLfloat(M[2][2]);
+    w[11] = GLfloat(M[3][2]);
+    w[12] = GLfloat(M[0][3]);
+    w[13] = GLfloat(M[1][3]);
+    w[14] = GLfloat(M[2][3]);
+    w[15] = GLfloat(M[3][3]);
+
+    store(w);
 }
 
 //-----------------------------------------------------------------------------
@@ -114,4 +154,19 @@ void ogl::uniform::apply(GLint location) const
         }
 }
 
+// Copy the value to the given uniform block storage using the std140 layout,
+// in which each column of a 3x3 matrix is padded to four components.
+
+void ogl::uniform::pack(GLfloat *p) const
+{
+    if (len == 9)
+    {
+        memcpy(p + 0, val + 0, 3 * sizeof (GLfloat));
+        memcpy(p + 4, val + 3, 3 * sizeof (GLfloat));
+        memcpy(p + 8, val + 6, 3 * sizeof (GLfloat));
+    }
+    else
+        memcpy(p, val, len * sizeof (GLfloat));
+}
+
 //-----------------------------------------------------------------------------
@@ -243,17 +243,24 @@ ogl::aabb wrl::constraint::prep(int frusc, const app::frustum *const *frusv)
 
     pool->prep();
 
-    // Cache the visibility and determine the visible bound.
+    // Cache the visibility of all frusta in one pass. Visibility is kept by
+    // the pool, so test all grids, but bound only the current one.
 
-    ogl::aabb b;
+    std::vector<const vec4 *> planes(frusc);
 
     for (int frusi = 0; frusi < frusc; ++frusi)
-        if (mode)
-            b.merge(rot[grid]->view(frusi, frusv[frusi]->get_world_planes(), 5));
-        else
-            b.merge(pos[grid]->view(frusi, frusv[frusi]->get_world_planes(), 5));
+        planes[frusi] = frusv[frusi]->get_world_planes();
+
+    if (frusc)
+        pool->view(0, frusc, &planes.front(), 5);
+
+    ogl::node *node = mode ? rot[grid] : pos[grid];
+
+    for (int frusi = 0; frusi < frusc; ++frusi)
+        if (node->is_visible(frusi))
+            return node->get_bound();
 
-    return b;
+    return ogl::aabb();
 }
 
 void wrl::constraint::draw(int frusi)
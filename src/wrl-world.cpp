@@ -20,6 +20,7 @@
 #include <etc-ode.hpp>
 #include <ogl-pool.hpp>
 #include <ogl-uniform.hpp>
+#include <ogl-block.hpp>
 #include <ogl-process.hpp>
 #include <app-glob.hpp>
 #include <app-conf.hpp>
@@ -37,7 +38,9 @@
 
 wrl::world::world() :
     serial(1),
-    shadow_splits(::conf->get_i("shadow_map_splits", 3))
+    shadow_splits(::conf->get_i("shadow_map_splits", 3)),
+    shadow_snap  (::conf->get_i("shadow_map_snap",  16)),
+    shadow_cache (::conf->get_i("shadow_map_cache",  1) != 0)
 {
     // Initialize the editor physical system.
 
@@ -86,6 +89,21 @@ wrl::world::world() :
     uniform_spot      = ::glob->load_uniform("LightCutoff", 4);
     uniform_unit      = ::glob->load_uniform("LightUnit",   4);
 
+    // Gather the light uniforms into a block, using the std140 layout given
+    // by glsl/light-block.glsl.
+
+    block_light = ::glob->new_block("LightBlock", 0);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        block_light->add(uniform_shadow[i],       64 * i);
+        block_light->add(uniform_light [i], 256 + 16 * i);
+        block_light->add(uniform_split [i], 320 + 16 * i);
+        block_light->add(uniform_bright[i], 384 + 16 * i);
+    }
+    block_light->add(uniform_spot, 448);
+    block_light->add(uniform_unit, 464);
+
     process_shadow[0] = ::glob->load_process("shadow", 0);
     process_shadow[1] = ::glob->load_process("shadow", 1);
     process_shadow[2] = ::glob->load_process("shadow", 2);
@@ -95,6 +113,9 @@ wrl::world::world() :
     process_cookie[2] = ::glob->load_process("cookie", 2);
     process_cookie[3] = ::glob->load_process("cookie", 3);
 
+    for (int i = 0; i < 4; ++i)
+        cache_valid[i] = false;
+
 //  click_selection(new wrl::box("solid/bunny.obj"));
 //  click_selection(new wrl::box("solid/buddha.obj"));
 //  do_create();
@@ -139,6 +160,8 @@ wrl::world::~world()
 
     // Finalize the uniforms and processes.
 
+    ::glob->free_block(block_light);
+
     for (int i = 0; i < 4; ++i)
     {
         ::glob->free_process(process_cookie[i]);
@@ -913,6 +936,19 @@ void wrl::world::save(std::string filename, bool save_all)
 
 //-----------------------------------------------------------------------------
 
+// Gather the world-space planes of all given frusta.
+
+static std::vector<const vec4 *> get_planes(int frusc,
+                                            const app::frustum *const *frusv)
+{
+    std::vector<const vec4 *> planes(frusc);
+
+    for (int frusi = 0; frusi < frusc; ++frusi)
+        planes[frusi] = frusv[frusi]->get_world_planes();
+
+    return planes;
+}
+
 ogl::aabb wrl::world::prep_fill(int frusc, const app::frustum *const *frusv)
 {
     // Set the highlight uniform.
@@ -935,12 +971,23 @@ ogl::aabb wrl::world::prep_fill(int frusc, const app::frustum *const *frusv)
 
     fill_pool->prep();
 
-    // Cache the fill visibility and determine the visible bound.
+    // Cache the fill visibility of all frusta in one pass and determine the
+    // visible bound. Lighting reuses it.
 
-    ogl::aabb bb;
+    const std::vector<const vec4 *> planes = get_planes(frusc, frusv);
+
+    if (frusc)
+        fill_bound = fill_pool->view(0, frusc, &planes.front(), 5);
+    else
+        fill_bound = ogl::aabb();
+
+    // Hide the nodes occluded from each frustum. The bound remains that of
+    // the frustum test.
 
     for (int frusi = 0; frusi < frusc; ++frusi)
-        bb.merge(fill_pool->view(frusi, frusv[frusi]->get_world_planes(), 5));
+        fill_pool->occlude(frusi, frusv[frusi]->get_world_clip());
+
+    ogl::aabb bb(fill_bound);
 
     bb.inflate(1.01);
     return bb;
@@ -952,12 +999,15 @@ ogl::aabb wrl::world::prep_line(int frusc, const app::frustum *const *frusv)
 
     line_pool->prep();
 
-    // Cache the line visibility and determine the visible bound.
+    // Cache the line visibility of all frusta in one pass and determine the
+    // visible bound.
+
+    const std::vector<const vec4 *> planes = get_planes(frusc, frusv);
 
     ogl::aabb bb;
 
-    for (int frusi = 0; frusi < frusc; ++frusi)
-        bb.merge(line_pool->view(frusi, frusv[frusi]->get_world_planes(), 5));
+    if (frusc)
+        bb = line_pool->view(0, frusc, &planes.front(), 5);
 
     bb.inflate(1.01);
     return bb;
@@ -965,17 +1015,179 @@ ogl::aabb wrl::world::prep_line(int frusc, const app::frustum *const *frusv)
 
 //-----------------------------------------------------------------------------
 
-// Set all light parameters and render the light source shadow map.
+// Find the planes bounding the casters of shadows onto the given receivers
+// in the light frustum with world-to-clip transform A. For a spot light these
+// are the sides of the frustum narrowed to the extent of the receivers, a far
+// plane at the farthest receiver, and the near plane. A sun's frustum is
+// already fitted to its receivers, and is used as is, less its near plane, so
+// that casters between the sun and the receivers are kept. Return false if no
+// receiver lies within the frustum.
+
+static bool get_casters(const mat4& A, bool spot, const ogl::aabb& r, vec4 *V)
+{
+    const vec3 a = r.min();
+    const vec3 z = r.max();
+
+    if (a[0] > z[0] || a[1] > z[1] || a[2] > z[2])
+        return false;
+
+    // Find the clip-space extent of the receivers. If any corner lies behind
+    // a spot light, keep the whole frustum.
+
+    double x0 = -1, x1 = 1;
+    double y0 = -1, y1 = 1;
+    double z1 =  1;
+
+    if (spot)
+    {
+        x0 = y0 =  1;
+        x1 = y1 = z1 = -1;
+    }
+
+    for (int i = 0; spot && i < 8; ++i)
+    {
+        const vec4 c = A * vec4((i & 1) ? z[0] : a[0],
+                                (i & 2) ? z[1] : a[1],
+                                (i & 4) ? z[2] : a[2], 1);
+        if (c[3] > 0)
+        {
+            x0 = std::min(x0, c[0] / c[3]);
+            x1 = std::max(x1, c[0] / c[3]);
+            y0 = std::min(y0, c[1] / c[3]);
+            y1 = std::max(y1, c[1] / c[3]);
+            z1 = std::max(z1, c[2] / c[3]);
+        }
+        else
+        {
+            x0 = y0 = -1;
+            x1 = y1 = z1 = 1;
+            break;
+        }
+    }
+
+    x0 = std::max(x0, -1.0);
+    x1 = std::min(x1,  1.0);
+    y0 = std::max(y0, -1.0);
+    y1 = std::min(y1,  1.0);
+    z1 = std::min(z1,  1.0);
+
+    if (x0 >= x1 || y0 >= y1 || z1 <= -1)
+        return false;
+
+    const mat4 B = transpose(A);
+
+    V[0] = normal(B * vec4( 1,  0,  0, -x0)); // L
+    V[1] = normal(B * vec4(-1,  0,  0,  x1)); // R
+    V[2] = normal(B * vec4( 0,  1,  0, -y0)); // B
+    V[3] = normal(B * vec4( 0, -1,  0,  y1)); // T
+    V[4] = normal(B * vec4( 0,  0, -1,  z1)); // F
+
+    if (spot)
+        V[5] = normal(B * vec4(0, 0, 1, 1));  // N
+    else
+        V[5] = vec4(0, 0, 0, 1);
+
+    return true;
+}
+
+static bool same(const mat4& A, const mat4& B)
+{
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            if (A[i][j] != B[i][j])
+                return false;
+
+    return true;
+}
+
+static bool same(const vec4 *V, const vec4 *W, int n)
+{
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < 4; ++j)
+            if (V[i][j] != W[i][j])
+                return false;
+
+    return true;
+}
+
+// Render the fill geometry visible to frustum ID to the shadow buffer.
+
+void wrl::world::draw_shadow(int frusi)
+{
+    fill_pool->draw_init();
+    {
+        glCullFace(GL_FRONT);
+        fill_pool->draw(frusi, false, false);
+        fill_pool->draw(frusi, false, true);
+        glCullFace(GL_BACK);
+    }
+    fill_pool->draw_fini();
+}
+
+// Set all light parameters and render the light source shadow map, given the
+// bound of the receivers of its shadows.
+//
+// The static fill geometry of a directional light's shadow map is saved. As
+// long as the light transform, the casters, and the static geometry remain
+// unchanged, the saved map is restored and only the dynamic nodes, those of
+// bodies, are rendered over it. To keep the transform independent of the
+// bodies and of the view depth, a saved map's depth range is fit to the
+// static geometry alone, with depth clamping catching the bodies beyond it,
+// and its casters are not limited by the depth of the receivers. Spot light
+// maps follow the receivers, which change with every view, and are not saved.
 
 void wrl::world::set_light(int light, const vec4& p,
-                           int frusi, app::frustum *frusp)
+                           int frusi, app::frustum *frusp,
+                           const ogl::aabb& receivers)
 {
-    // Bound the frustum to its visible volume.
+    bool cache = shadow_cache && ogl::has_framebuffer_blit
+                              && p[3] == 0 && !fill_node->is_ubiq();
+
+    // Cull the casters.
+
+    vec4 C[6];
+    bool any = get_casters(frusp->get_world_clip(), p[3] != 0, receivers, C);
 
-    ogl::aabb bound = fill_pool->view(frusi, frusp->get_world_planes(), 5);
+    if (cache)
+        C[4] = vec4(0, 0, 0, 1);
+
+    ogl::aabb bound;
+
+    if (any)
+        bound = fill_pool->view(frusi, C, 6);
+
+    // Find the visible dynamic nodes.
+
+    std::vector<ogl::node *> dynamic;
+
+    cache = cache && any;
+
+    if (any)
+        for (node_map::iterator i = nodes.begin(); i != nodes.end(); ++i)
+            if (i->second->is_visible(frusi))
+            {
+                dynamic.push_back(i->second);
+                cache = cache && !i->second->is_ubiq();
+            }
+
+    // Bound the frustum to the casters.
+
+    if (cache)
+        bound = fill_node->is_visible(frusi) ? fill_node->get_bound()
+                                             : ogl::aabb();
 
     frusp->set_bound(mat4(), bound);
 
+    // Determine whether the saved static shadow map remains valid.
+
+    const mat4     P = frusp->get_transform();
+    const unsigned v = fill_node->get_version();
+
+    bool hit = cache && cache_valid[light]
+                     && cache_version[light] == v
+                     && same(cache_transform[light], P)
+                     && same(cache_planes[light], C, 6);
+
     // Render the fill geometry to the shadow buffer.
 
     process_shadow[light]->bind_frame();
@@ -983,22 +1195,64 @@ void wrl::world::set_light(int light, const vec4& p,
         frusp->load_transform();
 
         glLoadIdentity();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        fill_pool->draw_init();
+        if (cache) glEnable(GL_DEPTH_CLAMP);
+
+        if (hit && process_shadow[light]->load_frame())
         {
-            glCullFace(GL_FRONT);
-            fill_pool->draw(frusi, false, false);
-            fill_pool->draw(frusi, false, true);
-            glCullFace(GL_BACK);
+            // Render only the dynamic nodes over the saved static map.
+
+            fill_node->hide(frusi);
+
+            if (!dynamic.empty())
+                draw_shadow(frusi);
         }
-        fill_pool->draw_fini();
+        else
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            if (cache)
+            {
+                // Render and save the static geometry alone, then render the
+                // dynamic nodes over it.
+
+                std::vector<ogl::node *>::iterator i;
+
+                for (i = dynamic.begin(); i != dynamic.end(); ++i)
+                    (*i)->hide(frusi);
+
+                draw_shadow(frusi);
+
+                process_shadow[light]->save_frame();
+
+                cache_valid    [light] = true;
+                cache_version  [light] = v;
+                cache_transform[light] = P;
+
+                std::copy(C, C + 6, cache_planes[light]);
+
+                if (!dynamic.empty())
+                {
+                    for (i = dynamic.begin(); i != dynamic.end(); ++i)
+                        (*i)->show(frusi);
+
+                    fill_node->hide(frusi);
+                    draw_shadow(frusi);
+                }
+            }
+            else if (any)
+            {
+                cache_valid[light] = false;
+                draw_shadow(frusi);
+            }
+        }
+
+        if (cache) glDisable(GL_DEPTH_CLAMP);
     }
     process_shadow[light]->free_frame();
 
     // Set the position and transform uniforms.
 
-    const mat4 P =  frusp->get_transform();
     const mat4 V = ::view->get_transform();
     const mat4 I = ::view->get_inverse();
     const mat4 S(0.5, 0.0, 0.0, 0.5,
@@ -1019,7 +1273,7 @@ int wrl::world::s_light(int light, const vec3& p, const vec3& v, double c,
     if (light < 4)
     {
         app::perspective_frustum frust(p, -v, c, 1);
-        set_light(light, vec4(p, 1), frusc + light, &frust);
+        set_light(light, vec4(p, 1), frusc + light, &frust, visible);
 
         uniform_split[light]->set(vec2(0, 1));
 
@@ -1047,10 +1301,15 @@ int wrl::world::d_light(int light, const vec3& p, const vec3& v, double c,
 
         bound.intersect(visible);
 
-        // Render a shadow map encompasing this bound.
+        // Render a shadow map encompasing this bound. If the static map may
+        // be saved, snap it to a grid so that it survives small movements of
+        // the view.
+
+        const int k = (shadow_cache && ogl::has_framebuffer_blit)
+                    ? shadow_snap : 0;
 
-        app::orthogonal_frustum frust(bound, v);
-        set_light(light, vec4(v, 0), frusc + light, &frust);
+        app::orthogonal_frustum frust(bound, v, k);
+        set_light(light, vec4(v, 0), frusc + light, &frust, bound);
 
         uniform_split[light]->set(vec2(double(i) / n, double(i + 1) / n));
     }
@@ -1059,12 +1318,9 @@ int wrl::world::d_light(int light, const vec3& p, const vec3& v, double c,
 
 void wrl::world::lite(int frusc, const app::frustum *const *frusv)
 {
-    // Determine the visible bounding volume. TODO: Remove this redundancy.
+    // Use the visible bounding volume found by prep_fill.
 
-    ogl::aabb bound;
-
-    for (int frusi = 0; frusi < frusc; ++frusi)
-        bound.merge(fill_pool->view(frusi, frusv[frusi]->get_world_planes(), 5));
+    const ogl::aabb& bound = fill_bound;
 
     // Enumerate the light sources.
 